@@ -305,6 +305,8 @@ static bool _truncate_db(authdb_connection_t dbconn)
             // Unable to recover successfully if we can't truncate
             abort();
         }
+    } else {
+        rule_rights_cache_invalidate();
     }
     
     return rc == SQLITE_OK;
@@ -1103,46 +1103,12 @@ _preevaluate_rule(engine_t engine, rule_t rule)
 static rule_t
 _find_rule(engine_t engine, authdb_connection_t dbconn, const char * string)
 {
-    rule_t r = NULL;
-    size_t sLen = strlen(string);
+    rule_t r = rule_copy_matching_right(string, dbconn);
     
-    char * buf = calloc(1u, sLen + 1);
-    strlcpy(buf, string, sLen + 1);
-    char * ptr = buf + sLen;
-    __block int64_t count = 0;
-    
-    for (;;) {
-        
-        // lookup rule
-        authdb_step(dbconn, "SELECT COUNT(name) AS cnt FROM rules WHERE name = ? AND type = 1",
-        ^(sqlite3_stmt *stmt) {
-            sqlite3_bind_text(stmt, 1, buf, -1, NULL);
-        }, ^bool(auth_items_t data) {
-            count = auth_items_get_int64(data, "cnt");
-            return false;
-        });
-        
-        if (count > 0) {
-            r = rule_create_with_string(buf, dbconn);
-            goto done;
-        }
-        
-        // if buf ends with a . and we didn't find a rule remove .
-        if (*ptr == '.') {
-            *ptr = '\0';
-        }
-        // find any remaining . and truncate the string
-        ptr = strrchr(buf, '.');
-        if (ptr) {
-            *(ptr+1) = '\0';
-        } else {
-            break;
-        }
+    if (r == NULL) {
+        r = rule_copy_matching_right("", dbconn);
     }
     
-done:
-    free_safe(buf);
-    
     // set default if we didn't find a rule
     if (r == NULL) {
         r = rule_create_with_string("", dbconn);
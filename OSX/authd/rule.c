@@ -12,6 +12,7 @@
 #include <Security/AuthorizationTagsPriv.h>
 #include "server.h"
 #include <libproc.h>
+#include <stdatomic.h>
 
 AUTHD_DEFINE_LOG
 
@@ -828,6 +829,7 @@ done:
     if (!result) {
         os_log_debug(AUTHD_LOG, "rule: commit, failed for %{public}s (%llu)", rule_get_name(rule), rule_get_id(rule));
     } else {
+        rule_rights_cache_invalidate();
         rule_log_manipulation(dbconn, rule, insert ? rule_insert : rule_update, proc);
     }
     return result;
@@ -851,6 +853,7 @@ rule_sql_remove(rule_t rule, authdb_connection_t dbconn, process_t proc)
                          }, NULL);
     
     if (result) {
+        rule_rights_cache_invalidate();
         rule_log_manipulation(dbconn, rule, rule_delete, proc);
     }
     
@@ -858,6 +861,326 @@ done:
     return result;
 }
 
+#pragma mark -
+#pragma mark rights cache
+
+// Every lookup of a right used to cost one COUNT query per dot-truncated
+// prefix plus the fetch of the matching rule. Instead we keep a snapshot of
+// all rights, compiled into rule_t objects and stored in a trie keyed by the
+// dot separated components of their names. The snapshot is stamped with the
+// generation it was built at and rebuilt on the first lookup after a commit
+// or remove bumps the generation.
+//
+// Rules handed out from the snapshot are shared between engines and must be
+// treated as read only.
+
+typedef struct _rights_node_s * rights_node_t;
+struct _rights_node_s {
+    char * label;
+    rule_t right;           // right named by the path to this node
+    rule_t wildcard;        // right named by the path to this node followed by a '.'
+    rights_node_t * children; // sorted by label
+    size_t count;
+    size_t capacity;
+};
+
+static dispatch_queue_t
+_rights_cache_queue()
+{
+    static dispatch_queue_t queue = NULL;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("authd rights cache", DISPATCH_QUEUE_SERIAL);
+    });
+    
+    return queue;
+}
+
+// Bumped without taking the queue: invalidation can be reached from inside
+// authdb_step (corrupt database truncation, rule_sql_commit during a rebuild).
+static _Atomic uint64_t rights_generation = 1;
+
+// these are only touched on _rights_cache_queue()
+static uint64_t rights_snapshot_generation = 0;
+static rights_node_t rights_snapshot = NULL;
+
+static void
+_rights_node_free(rights_node_t node)
+{
+    if (!node) {
+        return;
+    }
+    for (size_t i = 0; i < node->count; i++) {
+        _rights_node_free(node->children[i]);
+    }
+    free_safe(node->children);
+    free_safe(node->label);
+    CFReleaseNull(node->right);
+    CFReleaseNull(node->wildcard);
+    free(node);
+}
+
+static int
+_rights_label_compare(const char * label, const char * component, size_t len)
+{
+    int cmp = strncmp(label, component, len);
+    if (cmp == 0 && label[len] != '\0') {
+        cmp = 1;
+    }
+    return cmp;
+}
+
+static rights_node_t
+_rights_node_child(rights_node_t node, const char * component, size_t len, bool create)
+{
+    size_t lo = 0, hi = node->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = _rights_label_compare(node->children[mid]->label, component, len);
+        if (cmp == 0) {
+            return node->children[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (!create) {
+        return NULL;
+    }
+    
+    if (node->count == node->capacity) {
+        size_t capacity = node->capacity ? node->capacity * 2 : 4;
+        rights_node_t * children = realloc(node->children, capacity * sizeof(rights_node_t));
+        require(children != NULL, fail);
+        node->children = children;
+        node->capacity = capacity;
+    }
+    
+    rights_node_t child = calloc(1u, sizeof(struct _rights_node_s));
+    require(child != NULL, fail);
+    child->label = strndup(component, len);
+    require_action(child->label != NULL, fail, free(child));
+    
+    memmove(&node->children[lo + 1], &node->children[lo], (node->count - lo) * sizeof(rights_node_t));
+    node->children[lo] = child;
+    node->count++;
+    return child;
+    
+fail:
+    return NULL;
+}
+
+static void
+_rights_node_insert(rights_node_t root, rule_t rule)
+{
+    const char * name = rule_get_name(rule);
+    rights_node_t node = root;
+    rule_t * slot = &root->right;
+    
+    require(name != NULL, done);
+    
+    for (const char * p = name; *p != '\0';) {
+        const char * dot = strchr(p, '.');
+        size_t len = dot ? (size_t)(dot - p) : strlen(p);
+        node = _rights_node_child(node, p, len, true);
+        require(node != NULL, done);
+        
+        if (!dot) {
+            slot = &node->right;
+            break;
+        }
+        slot = &node->wildcard;
+        p = dot + 1;
+    }
+    
+    CFRetainSafe(rule);
+    CFReleaseSafe(*slot);
+    *slot = rule;
+    
+done:
+    return;
+}
+
+// Same precedence as the old per-prefix queries: an exact match first, then
+// the longest "prefix." wildcard right.
+static rule_t
+_rights_node_match(rights_node_t root, const char * name)
+{
+    rule_t best = NULL;
+    rights_node_t node = root;
+    
+    if (*name == '\0') {
+        return root->right;
+    }
+    
+    for (const char * p = name; ;) {
+        const char * dot = strchr(p, '.');
+        size_t len = dot ? (size_t)(dot - p) : strlen(p);
+        node = _rights_node_child(node, p, len, false);
+        
+        if (!dot) {
+            if (node && node->right) {
+                best = node->right;
+            }
+            break;
+        }
+        if (!node) {
+            break;
+        }
+        if (node->wildcard) {
+            best = node->wildcard;
+        }
+        if (dot[1] == '\0') {
+            break;
+        }
+        p = dot + 1;
+    }
+    
+    return best;
+}
+
+// Resolve the lazily created members now, so sharing the rule between
+// engines never writes to it.
+static void
+_rule_prepare_shared(rule_t rule)
+{
+    rule_get_requirement(rule);
+    rule_delegates_iterator(rule, ^bool(rule_t delegate) {
+        _rule_prepare_shared(delegate);
+        return true;
+    });
+}
+
+static rights_node_t
+_rights_snapshot_create(authdb_connection_t dbconn)
+{
+    rights_node_t root = calloc(1u, sizeof(struct _rights_node_s));
+    require(root != NULL, done);
+    
+    bool result = authdb_step(dbconn, "SELECT * FROM rules WHERE type = 1",
+    NULL, ^bool(auth_items_t data) {
+        rule_t rule = _rule_create_with_sql(data);
+        if (rule) {
+            _get_sql_mechanisms(rule, dbconn);
+            if (rule_get_class(rule) == RC_RULE) {
+                _get_sql_delegates(rule, dbconn);
+            }
+            _rule_prepare_shared(rule);
+            _rights_node_insert(root, rule);
+            CFReleaseSafe(rule);
+        }
+        return true;
+    });
+    
+    if (!result) {
+        os_log_error(AUTHD_LOG, "rule: failed to load the rights snapshot");
+        _rights_node_free(root);
+        root = NULL;
+    }
+    
+done:
+    return root;
+}
+
+// Uncached lookup, used only when the snapshot could not be built.
+static rule_t
+_copy_matching_right_sql(const char * string, authdb_connection_t dbconn)
+{
+    rule_t r = NULL;
+    size_t sLen = strlen(string);
+    
+    char * buf = calloc(1u, sLen + 1);
+    strlcpy(buf, string, sLen + 1);
+    char * ptr = buf + sLen;
+    __block int64_t count = 0;
+    
+    for (;;) {
+        
+        // lookup rule
+        authdb_step(dbconn, "SELECT COUNT(name) AS cnt FROM rules WHERE name = ? AND type = 1",
+        ^(sqlite3_stmt *stmt) {
+            sqlite3_bind_text(stmt, 1, buf, -1, NULL);
+        }, ^bool(auth_items_t data) {
+            count = auth_items_get_int64(data, "cnt");
+            return false;
+        });
+        
+        if (count > 0) {
+            r = rule_create_with_string(buf, dbconn);
+            goto done;
+        }
+        
+        // if buf ends with a . and we didn't find a rule remove .
+        if (*ptr == '.') {
+            *ptr = '\0';
+        }
+        // find any remaining . and truncate the string
+        ptr = strrchr(buf, '.');
+        if (ptr) {
+            *(ptr+1) = '\0';
+        } else {
+            break;
+        }
+    }
+    
+done:
+    free_safe(buf);
+    return r;
+}
+
+rule_t
+rule_copy_matching_right(const char * string, authdb_connection_t dbconn)
+{
+    __block rule_t r = NULL;
+    __block bool cached = false;
+    
+    dispatch_sync(_rights_cache_queue(), ^{
+        if (rights_snapshot && rights_snapshot_generation == atomic_load(&rights_generation)) {
+            cached = true;
+            r = _rights_node_match(rights_snapshot, string);
+            CFRetainSafe(r);
+        }
+    });
+    
+    if (!cached) {
+        // Build off the queue; the database may call back into
+        // rule_rights_cache_invalidate while we step through it.
+        uint64_t generation = atomic_load(&rights_generation);
+        rights_node_t snapshot = _rights_snapshot_create(dbconn);
+        
+        if (snapshot) {
+            dispatch_sync(_rights_cache_queue(), ^{
+                if (!rights_snapshot || rights_snapshot_generation < generation) {
+                    _rights_node_free(rights_snapshot);
+                    rights_snapshot = snapshot;
+                    rights_snapshot_generation = generation;
+                } else {
+                    _rights_node_free(snapshot);
+                }
+                
+                cached = true;
+                r = _rights_node_match(rights_snapshot, string);
+                CFRetainSafe(r);
+            });
+        }
+    }
+    
+    if (!cached) {
+        r = _copy_matching_right_sql(string, dbconn);
+    }
+    
+    return r;
+}
+
+void
+rule_rights_cache_invalidate()
+{
+    atomic_fetch_add(&rights_generation, 1);
+}
+
 CFMutableDictionaryRef
 rule_copy_to_cfobject(rule_t rule, authdb_connection_t dbconn) {
     CFMutableDictionaryRef dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
@@ -83,6 +83,12 @@ bool rule_sql_commit(rule_t,authdb_connection_t,CFAbsoluteTime,process_t);
 AUTH_NONNULL_ALL
 bool rule_sql_remove(rule_t,authdb_connection_t,process_t);
 
+/* Longest-prefix match against the cached rights, NULL if no right matches. */
+AUTH_WARN_RESULT AUTH_NONNULL_ALL AUTH_RETURNS_RETAINED
+rule_t rule_copy_matching_right(const char *,authdb_connection_t);
+
+void rule_rights_cache_invalidate(void);
+
 AUTH_NONNULL_ALL
 CFMutableDictionaryRef rule_copy_to_cfobject(rule_t,authdb_connection_t);
     
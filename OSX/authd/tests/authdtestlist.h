@@ -3,3 +3,4 @@
 
 ONE_TEST(authd_01_authorizationdb)
 ONE_TEST(authd_02_basicauthorization)
+ONE_TEST(authd_04_rightslookup)
@@ -19,6 +19,11 @@ if (_is) { (IS) = NULL; AuthorizationFreeItemSet(_is); } }
 #define SAMPLE_RIGHT "com.apple.security.syntheticinput"
 #define SAMPLE_SHARED_RIGHT "system.preferences"
 
+#define TEST_WILDCARD_RIGHT "com.apple.security.authd-test."
+#define TEST_RIGHT TEST_WILDCARD_RIGHT "child"
+#define TEST_CHILD_WILDCARD_RIGHT TEST_RIGHT "."
+#define TEST_CHILD_RIGHT TEST_CHILD_WILDCARD_RIGHT "grandchild"
+
 #define CORRECT_UNAME "bats"
 #define CORRECT_PWD "bats"
 #define INCORRECT_UNAME "fs;lgp-984-25opsdakflasdg"
@@ -100,6 +105,65 @@ int authd_02_basicauthorization(int argc, char *const *argv)
 	return 0;
 }
 
+static OSStatus copyRightWithNewRef(const char *rightName)
+{
+	// a fresh AuthorizationRef, so no credential from an earlier lookup can satisfy the rule
+	AuthorizationRef authorizationRef = NULL;
+	OSStatus status = AuthorizationCreate(NULL, NULL, kAuthorizationFlagDefaults, &authorizationRef);
+	if (status != errAuthorizationSuccess)
+		return status;
+
+	AuthorizationItem myItems = {rightName, 0, NULL, 0};
+	AuthorizationRights myRights = {1, &myItems};
+	AuthorizationRights *authorizedRights = NULL;
+	status = AuthorizationCopyRights(authorizationRef, &myRights, kAuthorizationEmptyEnvironment, kAuthorizationFlagExtendRights, &authorizedRights);
+	AuthorizationFreeItemSetNull(authorizedRights);
+	AuthorizationFree(authorizationRef, kAuthorizationFlagDefaults);
+	return status;
+}
+
+int authd_04_rightslookup(int argc, char *const *argv)
+{
+	plan_tests(13);
+
+	AuthorizationRef authorizationRef;
+	OSStatus status = AuthorizationCreate(NULL, NULL, kAuthorizationFlagDefaults, &authorizationRef);
+	ok(status == errAuthorizationSuccess, "AuthorizationRef create");
+
+	// leftovers from an earlier run
+	AuthorizationRightRemove(authorizationRef, TEST_CHILD_WILDCARD_RIGHT);
+	AuthorizationRightRemove(authorizationRef, TEST_WILDCARD_RIGHT);
+
+	NSDictionary *allow = @{ @kAuthorizationRuleClass : @kAuthorizationRuleClassAllow };
+	NSDictionary *deny = @{ @kAuthorizationRuleClass : @kAuthorizationRuleClassDeny };
+
+	status = AuthorizationRightSet(authorizationRef, TEST_WILDCARD_RIGHT, (__bridge CFDictionaryRef)allow, NULL, NULL, NULL);
+	ok(status == errAuthorizationSuccess, "AuthorizationRightSet wildcard right");
+	ok(copyRightWithNewRef(TEST_RIGHT) == errAuthorizationSuccess, "Wildcard right matches");
+
+	// rights are looked up in a snapshot of the database; committing a change has to invalidate it
+	status = AuthorizationRightSet(authorizationRef, TEST_WILDCARD_RIGHT, (__bridge CFDictionaryRef)deny, NULL, NULL, NULL);
+	ok(status == errAuthorizationSuccess, "AuthorizationRightSet modify wildcard right");
+	ok(copyRightWithNewRef(TEST_RIGHT) == errAuthorizationDenied, "Lookup sees the modified wildcard right");
+
+	status = AuthorizationRightSet(authorizationRef, TEST_CHILD_WILDCARD_RIGHT, (__bridge CFDictionaryRef)allow, NULL, NULL, NULL);
+	ok(status == errAuthorizationSuccess, "AuthorizationRightSet nested wildcard right");
+	ok(copyRightWithNewRef(TEST_CHILD_RIGHT) == errAuthorizationSuccess, "Longest wildcard right wins");
+	ok(copyRightWithNewRef(TEST_RIGHT) == errAuthorizationDenied, "Nested wildcard right does not match its own prefix");
+
+	status = AuthorizationRightRemove(authorizationRef, TEST_CHILD_WILDCARD_RIGHT);
+	ok(status == errAuthorizationSuccess, "AuthorizationRightRemove nested wildcard right");
+	ok(copyRightWithNewRef(TEST_CHILD_RIGHT) == errAuthorizationDenied, "Lookup falls back to the outer wildcard right");
+
+	status = AuthorizationRightRemove(authorizationRef, TEST_WILDCARD_RIGHT);
+	ok(status == errAuthorizationSuccess, "AuthorizationRightRemove wildcard right");
+	ok(AuthorizationRightGet(TEST_WILDCARD_RIGHT, NULL) == errAuthorizationDenied, "AuthorizationRightGet removed right");
+	ok(copyRightWithNewRef(TEST_RIGHT) != errAuthorizationSuccess, "Removed right no longer grants anything");
+
+	AuthorizationFree(authorizationRef, kAuthorizationFlagDefaults);
+	return 0;
+}
+
 int authd_03_uiauthorization(int argc, char *const *argv)
 {
 	plan_tests(3);
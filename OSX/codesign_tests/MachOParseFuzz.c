@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// MachOParseFuzz - run signature validation over a fixed corpus of damaged
+// copies of a Mach-O file and make sure every one of them is either accepted
+// or rejected, never crashed on. Each case is validated in a child process
+// so an out-of-bounds access shows up as a signal rather than ending the run.
+//
+// The corpus is deterministic: truncations at structurally interesting
+// lengths, corrupted header, load command, fat_arch and SuperBlob fields,
+// and a fixed sequence of byte flips, applied both to the file itself and to
+// a synthetic one-architecture fat wrapper around it.
+//
+// MachOMapping only maps root-owned files that nobody else can write, and
+// reads anything else instead. To fuzz the in-place (mapped) parse, this must
+// run as root; every case file is made root-owned and mode 0755.
+//
+// usage: sudo MachOParseFuzz [path]		(default /bin/ls)
+//
+
+#include <Security/Security.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <mach-o/loader.h>
+#include <mach-o/fat.h>
+#include <libkern/OSByteOrder.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <string.h>
+#include <err.h>
+
+#define FLIP_CASES	64
+#define FAT_ALIGN	14		// slice alignment (log2) of the synthetic fat wrapper
+
+static char dir[] = "/tmp/MachOParseFuzz.XXXXXX";
+static int cases, accepted, rejected, crashed;
+
+
+//
+// Validate one file in a child process.
+// Returns 0 if accepted, 1 if rejected, -1 if the child died.
+//
+static int
+check(const char *path)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (pid == 0) {
+		alarm(60);		// a hang counts as a crash
+		CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, strlen(path), false);
+		SecStaticCodeRef code = NULL;
+		if (SecStaticCodeCreateWithPath(url, kSecCSDefaultFlags, &code))
+			_exit(1);
+		if (SecStaticCodeCheckValidity(code, kSecCSDoNotValidateResources | kSecCSCheckAllArchitectures, NULL))
+			_exit(1);
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid)
+		err(1, "waitpid");
+	if (WIFEXITED(status) && WEXITSTATUS(status) <= 1)
+		return WEXITSTATUS(status);
+	return -1;
+}
+
+static void
+run(const char *name, const uint8_t *data, size_t length)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/case", dir);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+	if (fd < 0)
+		err(1, "%s", path);
+	if (length && write(fd, data, length) != (ssize_t)length)
+		err(1, "%s", path);
+	if (fchown(fd, 0, 0) || fchmod(fd, 0755))		// so MachOMapping will map it
+		err(1, "%s", path);
+	close(fd);
+
+	cases++;
+	switch (check(path)) {
+	case 0:
+		accepted++;
+		break;
+	case 1:
+		rejected++;
+		break;
+	default:
+		crashed++;
+		printf("CRASH: %s\n", name);
+		break;
+	}
+	unlink(path);
+}
+
+
+//
+// Mutation helpers. Each works on a fresh copy of the input.
+//
+static void
+truncated(const char *what, const uint8_t *data, size_t length, size_t at)
+{
+	char name[128];
+	if (at > length)
+		return;
+	snprintf(name, sizeof(name), "%s truncated at %zu", what, at);
+	run(name, data, at);
+}
+
+static void
+patched32(const char *what, const uint8_t *data, size_t length, size_t offset, uint32_t value, bool bigEndian)
+{
+	char name[128];
+	if (offset + sizeof(value) > length)
+		return;
+	uint8_t *copy = malloc(length);
+	memcpy(copy, data, length);
+	if (bigEndian)
+		OSWriteBigInt32(copy, offset, value);
+	else
+		OSWriteLittleInt32(copy, offset, value);
+	snprintf(name, sizeof(name), "%s = 0x%x", what, value);
+	run(name, copy, length);
+	free(copy);
+}
+
+static void
+flipped(const char *what, const uint8_t *data, size_t length, size_t limit)
+{
+	uint32_t state = 0x5eed;	// fixed, so every run uses the same corpus
+	uint8_t *copy = malloc(length);
+	if (limit > length)
+		limit = length;
+	for (int n = 0; n < FLIP_CASES; n++) {
+		memcpy(copy, data, length);
+		char name[128];
+		state = state * 1103515245 + 12345;
+		size_t offset = (state >> 8) % limit;
+		state = state * 1103515245 + 12345;
+		uint8_t mask = (state >> 16) | 1;
+		copy[offset] ^= mask;
+		snprintf(name, sizeof(name), "%s byte %zu ^= 0x%02x", what, offset, mask);
+		run(name, copy, length);
+	}
+	free(copy);
+}
+
+static const uint32_t nasty[] = { 0, 1, 0x7fffffff, 0x80000000, 0xfffffff0, 0xffffffff };
+#define NASTY (sizeof(nasty) / sizeof(nasty[0]))
+
+
+//
+// Corrupt a thin (little-endian) Mach-O image at base within a file.
+//
+static void
+thinCases(const char *what, const uint8_t *data, size_t length, size_t base)
+{
+	const struct mach_header *mh = (const struct mach_header *)(data + base);
+	size_t headerSize = (mh->magic == MH_MAGIC_64) ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+	size_t commandsEnd = base + headerSize + mh->sizeofcmds;
+	char field[128];
+
+	truncated(what, data, length, base + 4);
+	truncated(what, data, length, base + headerSize - 1);
+	truncated(what, data, length, commandsEnd - 1);
+	truncated(what, data, length, commandsEnd + 1);
+	truncated(what, data, length, (base + length) / 2);
+	truncated(what, data, length, length - 1);
+
+	for (unsigned n = 0; n < NASTY; n++) {
+		snprintf(field, sizeof(field), "%s ncmds", what);
+		patched32(field, data, length, base + offsetof(struct mach_header, ncmds), nasty[n], false);
+		snprintf(field, sizeof(field), "%s sizeofcmds", what);
+		patched32(field, data, length, base + offsetof(struct mach_header, sizeofcmds), nasty[n], false);
+	}
+
+	// walk the load commands (of the intact image) for the code signature and first segment
+	size_t cmdOffset = base + headerSize;
+	for (uint32_t n = 0; n < mh->ncmds && cmdOffset + sizeof(struct load_command) <= commandsEnd; n++) {
+		const struct load_command *lc = (const struct load_command *)(data + cmdOffset);
+		if (n == 0)
+			for (unsigned v = 0; v < NASTY; v++) {
+				snprintf(field, sizeof(field), "%s first cmdsize", what);
+				patched32(field, data, length, cmdOffset + offsetof(struct load_command, cmdsize), nasty[v], false);
+			}
+		if (lc->cmd == LC_CODE_SIGNATURE) {
+			const struct linkedit_data_command *cs = (const struct linkedit_data_command *)lc;
+			size_t blob = base + cs->dataoff;
+			for (unsigned v = 0; v < NASTY; v++) {
+				snprintf(field, sizeof(field), "%s dataoff", what);
+				patched32(field, data, length, cmdOffset + offsetof(struct linkedit_data_command, dataoff), nasty[v], false);
+				snprintf(field, sizeof(field), "%s datasize", what);
+				patched32(field, data, length, cmdOffset + offsetof(struct linkedit_data_command, datasize), nasty[v], false);
+				// SuperBlob: magic, length, count, then the first index entry's type and offset
+				snprintf(field, sizeof(field), "%s SuperBlob length", what);
+				patched32(field, data, length, blob + 4, nasty[v], true);
+				snprintf(field, sizeof(field), "%s SuperBlob count", what);
+				patched32(field, data, length, blob + 8, nasty[v], true);
+				snprintf(field, sizeof(field), "%s SuperBlob index[0].offset", what);
+				patched32(field, data, length, blob + 16, nasty[v], true);
+			}
+			truncated(what, data, length, blob + 8);
+			truncated(what, data, length, blob + 20);
+			snprintf(field, sizeof(field), "%s SuperBlob", what);
+			flipped(field, data, length, blob + 256 < length ? blob + 256 : length);
+		}
+		cmdOffset += lc->cmdsize;
+	}
+
+	snprintf(field, sizeof(field), "%s header", what);
+	flipped(field, data, length, commandsEnd);
+}
+
+
+//
+// Corrupt the fat header and first fat_arch entry of a fat file.
+//
+static void
+fatCases(const char *what, const uint8_t *data, size_t length)
+{
+	char field[128];
+	size_t arch0 = sizeof(struct fat_header);
+
+	truncated(what, data, length, sizeof(struct fat_header) - 1);
+	truncated(what, data, length, arch0 + sizeof(struct fat_arch) - 1);
+
+	for (unsigned n = 0; n < NASTY; n++) {
+		snprintf(field, sizeof(field), "%s nfat_arch", what);
+		patched32(field, data, length, offsetof(struct fat_header, nfat_arch), nasty[n], true);
+		snprintf(field, sizeof(field), "%s arch[0].offset", what);
+		patched32(field, data, length, arch0 + offsetof(struct fat_arch, offset), nasty[n], true);
+		snprintf(field, sizeof(field), "%s arch[0].size", what);
+		patched32(field, data, length, arch0 + offsetof(struct fat_arch, size), nasty[n], true);
+		snprintf(field, sizeof(field), "%s arch[0].align", what);
+		patched32(field, data, length, arch0 + offsetof(struct fat_arch, align), nasty[n], true);
+	}
+}
+
+
+//
+// Wrap a thin image into a one-architecture fat file.
+//
+static uint8_t *
+wrap(const uint8_t *thin, size_t length, size_t *fatLength)
+{
+	size_t sliceOffset = 1 << FAT_ALIGN;
+	const struct mach_header *mh = (const struct mach_header *)thin;
+	*fatLength = sliceOffset + length;
+	uint8_t *fat = calloc(1, *fatLength);
+	struct fat_header *header = (struct fat_header *)fat;
+	struct fat_arch *arch = (struct fat_arch *)(header + 1);
+	header->magic = OSSwapHostToBigInt32(FAT_MAGIC);
+	header->nfat_arch = OSSwapHostToBigInt32(1);
+	arch->cputype = OSSwapHostToBigInt32(mh->cputype);
+	arch->cpusubtype = OSSwapHostToBigInt32(mh->cpusubtype);
+	arch->offset = OSSwapHostToBigInt32((uint32_t)sliceOffset);
+	arch->size = OSSwapHostToBigInt32((uint32_t)length);
+	arch->align = OSSwapHostToBigInt32(FAT_ALIGN);
+	memcpy(fat + sliceOffset, thin, length);
+	return fat;
+}
+
+
+int main(int argc, const char * argv[])
+{
+	const char *seed = (argc > 1) ? argv[1] : "/bin/ls";
+
+	if (geteuid() != 0)
+		errx(1, "must run as root, or the mapped parse isn't exercised at all");
+
+	int fd = open(seed, O_RDONLY);
+	if (fd < 0)
+		err(1, "%s", seed);
+	struct stat st;
+	if (fstat(fd, &st))
+		err(1, "%s", seed);
+	size_t length = st.st_size;
+	uint8_t *data = malloc(length);
+	if (read(fd, data, length) != (ssize_t)length)
+		err(1, "%s", seed);
+	close(fd);
+
+	if (mkdtemp(dir) == NULL)
+		err(1, "mkdtemp");
+
+	// find a thin image to work on: the file itself, or its first slice
+	const uint8_t *thin = data;
+	size_t thinLength = length;
+	bool isFat = length >= sizeof(struct fat_header) && OSSwapBigToHostInt32(*(const uint32_t *)data) == FAT_MAGIC;
+	if (isFat) {
+		const struct fat_arch *arch = (const struct fat_arch *)(data + sizeof(struct fat_header));
+		thin = data + OSSwapBigToHostInt32(arch->offset);
+		thinLength = OSSwapBigToHostInt32(arch->size);
+	}
+	uint32_t magic = *(const uint32_t *)thin;
+	if (magic != MH_MAGIC && magic != MH_MAGIC_64)
+		errx(1, "%s: not a (little-endian) Mach-O file", seed);
+
+	run("intact", thin, thinLength);
+	if (accepted != 1)
+		errx(1, "%s: the intact image does not validate; pick a validly signed seed", seed);
+	run("empty", thin, 0);
+	if (isFat)
+		fatCases("seed", data, length);
+	thinCases("thin", thin, thinLength, 0);
+
+	size_t fatLength;
+	uint8_t *fat = wrap(thin, thinLength, &fatLength);
+	fatCases("wrapped", fat, fatLength);
+	thinCases("wrapped slice", fat, fatLength, 1 << FAT_ALIGN);
+	truncated("wrapped", fat, fatLength, fatLength - 1);
+
+	printf("%s: %d cases, %d accepted, %d rejected, %d crashed\n", seed, cases, accepted, rejected, crashed);
+
+	free(fat);
+	free(data);
+	rmdir(dir);
+	return crashed ? 1 : 0;
+}
@@ -32,10 +32,15 @@ GAESContext::GAESContext(AppleCSPSession &session) :
 	mAesKey(NULL),
 	mInitFlag(false),
 	mRawKeySize(0),
-	mWasEncrypting(false)
+	mWasEncrypting(false),
+	mCCMode(kCCModeECB)
 { 
-	cbcCapable(false);
-	multiBlockCapable(false);
+	/*
+	 * CommonCrypto does the CBC chaining and takes runs of whole blocks
+	 * in one call, which lets it use its accelerated AES implementation.
+	 */
+	cbcCapable(true);
+	multiBlockCapable(true);
 }
 
 GAESContext::~GAESContext()
@@ -53,6 +58,10 @@ GAESContext::~GAESContext()
 	
 void GAESContext::deleteKey()
 {
+	if(mAesKey) {
+		CCCryptorRelease(mAesKey);
+		mAesKey = NULL;
+	}
 	mRawKeySize = 0;
 }
 
@@ -97,22 +106,9 @@ void GAESContext::init(
 		deleteKey();
 	}
 	
-	/* 
-	 * Init key only if key size or key bits have changed, or 
-	 * we're doing a different operation than the previous key
-	 * was scheduled for.
-	 */
-	if(!sameKeySize || (mWasEncrypting != encrypting) ||
-		memcmp(mRawKey, keyData, mRawKeySize)) {
-        (void) CCCryptorCreateWithMode(0, kCCModeECB, kCCAlgorithmAES128, ccDefaultPadding, NULL, keyData, keyLen, NULL, 0, 0, 0, &mAesKey);
-
-		/* save this raw key data */
-		memmove(mRawKey, keyData, keyLen); 
-		mRawKeySize = (uint32)keyLen;
-		mWasEncrypting = encrypting;
-	}
-
-	/* we handle CBC, and hence the IV, ourselves */
+	/* CommonCrypto handles CBC, and hence the IV, for us */
+	CCMode ccMode = kCCModeECB;
+	const void *ivData = NULL;
 	CSSM_ENCRYPT_MODE cssmMode = context.getInt(CSSM_ATTRIBUTE_MODE);
     switch (cssmMode) {
 		/* no mode attr --> 0 == CSSM_ALGMODE_NONE, not currently supported */
@@ -126,11 +122,41 @@ void GAESContext::init(
 			if(iv->Length != kCCBlockSizeAES128) {
 				CssmError::throwMe(CSSMERR_CSP_INVALID_ATTR_INIT_VECTOR);
 			}
+			ccMode = kCCModeCBC;
+			ivData = iv->Data;
 		}
 		break;
 		default:
 		break;
 	}
+
+	/* 
+	 * Init key only if key size or key bits have changed, or 
+	 * we're doing a different operation or mode than the previous 
+	 * key was scheduled for. Otherwise just restart the chain at 
+	 * the new IV.
+	 */
+	if(!sameKeySize || (mAesKey == NULL) || (mWasEncrypting != encrypting) ||
+		(mCCMode != ccMode) || memcmp(mRawKey, keyData, mRawKeySize)) {
+		deleteKey();
+		CCCryptorStatus crtn = CCCryptorCreateWithMode(
+			encrypting ? kCCEncrypt : kCCDecrypt, ccMode, kCCAlgorithmAES128,
+			ccNoPadding, ivData, keyData, keyLen, NULL, 0, 0, 0, &mAesKey);
+		if(crtn != kCCSuccess) {
+			errorLog1("GAESContext::init: CCCryptorCreateWithMode error %d\n", (int)crtn);
+			mAesKey = NULL;
+			CssmError::throwMe(CSSMERR_CSP_INTERNAL_ERROR);
+		}
+
+		/* save this raw key data */
+		memmove(mRawKey, keyData, keyLen); 
+		mRawKeySize = (uint32)keyLen;
+		mWasEncrypting = encrypting;
+		mCCMode = ccMode;
+	}
+	else if(CCCryptorReset(mAesKey, ivData) != kCCSuccess) {
+		CssmError::throwMe(CSSMERR_CSP_INTERNAL_ERROR);
+	}
 	
 	/* Finally, have BlockCryptor do its setup */
 	setup(GLADMAN_BLOCK_SIZE_BYTES, context);
@@ -138,11 +164,11 @@ void GAESContext::init(
 }	
 
 /*
- * Functions called by BlockCryptor
- * FIXME make this multi-block capabl3e 
+ * Functions called by BlockCryptor. Either may be handed any whole number
+ * of blocks; in CBC mode the cryptor carries the chain from call to call.
  */
 void GAESContext::encryptBlock(
-	const void		*plainText,			// length implied (one block)
+	const void		*plainText,			// multiple of the block size
 	size_t			plainTextLen,
 	void 			*cipherText,	
 	size_t			&cipherTextLen,		// in/out, throws on overflow
@@ -151,13 +177,20 @@ void GAESContext::encryptBlock(
 	if(cipherTextLen < plainTextLen) {
 		CssmError::throwMe(CSSMERR_CSP_OUTPUT_LENGTH_ERROR);
 	}
-    (void) CCCryptorEncryptDataBlock(mAesKey, NULL, plainText, plainTextLen, cipherText);
-
-	cipherTextLen = plainTextLen;
+	if(plainTextLen % GLADMAN_BLOCK_SIZE_BYTES) {
+		CssmError::throwMe(CSSMERR_CSP_INPUT_LENGTH_ERROR);
+	}
+	size_t moved = 0;
+	if(CCCryptorUpdate(mAesKey, plainText, plainTextLen,
+			cipherText, cipherTextLen, &moved) != kCCSuccess) {
+		CssmError::throwMe(CSSMERR_CSP_INTERNAL_ERROR);
+	}
+	assert(moved == plainTextLen);
+	cipherTextLen = moved;
 }
 
 void GAESContext::decryptBlock(
-	const void		*cipherText,		// length implied (one cipher block)
+	const void		*cipherText,		// multiple of the block size
 	size_t			cipherTextLen,	
 	void			*plainText,	
 	size_t			&plainTextLen,		// in/out, throws on overflow
@@ -166,7 +199,14 @@ void GAESContext::decryptBlock(
 	if(plainTextLen < cipherTextLen) {
 		CssmError::throwMe(CSSMERR_CSP_OUTPUT_LENGTH_ERROR);
 	}
-    (void) CCCryptorDecryptDataBlock(mAesKey, NULL, cipherText, cipherTextLen, plainText);
-	plainTextLen = cipherTextLen;
+	if(cipherTextLen % GLADMAN_BLOCK_SIZE_BYTES) {
+		CssmError::throwMe(CSSMERR_CSP_INPUT_LENGTH_ERROR);
+	}
+	size_t moved = 0;
+	if(CCCryptorUpdate(mAesKey, cipherText, cipherTextLen,
+			plainText, plainTextLen, &moved) != kCCSuccess) {
+		CssmError::throwMe(CSSMERR_CSP_INTERNAL_ERROR);
+	}
+	assert(moved == cipherTextLen);
+	plainTextLen = moved;
 }
-
@@ -47,15 +47,16 @@ public:
 	// in mRawKey and compare on re-init.
 	bool changed(const Context &context)	 { return true; }
 
-	// called by BlockCryptor
+	// called by BlockCryptor; any whole number of blocks, chained by
+	// CommonCrypto in CBC mode
 	void encryptBlock(
-		const void		*plainText,			// length implied (one block)
+		const void		*plainText,			// multiple of the block size
 		size_t			plainTextLen,
 		void			*cipherText,	
 		size_t			&cipherTextLen,		// in/out, throws on overflow
 		bool			final);
 	void decryptBlock(
-		const void		*cipherText,		// length implied (one cipher block)
+		const void		*cipherText,		// multiple of the block size
 		size_t			cipherTextLen,	
 		void			*plainText,	
 		size_t			&plainTextLen,		// in/out, throws on overflow
@@ -77,6 +78,7 @@ private:
 	uint8				mRawKey[MAX_AES_KEY_BITS / 8];
 	uint32				mRawKeySize;
 	bool				mWasEncrypting;
+	CCMode				mCCMode;			// kCCModeECB or kCCModeCBC
 };	/* AESContext */
 
 #endif //_H_GLADMAN_CONTEXT
@@ -23,6 +23,8 @@
  */
 
 #include "CLCachedEntry.h"
+#include <security_utilities/globalizer.h>
+#include <CommonCrypto/CommonDigest.h>
 
 /*
  * CLCachedEntry base class constructor. Only job here is to cook up 
@@ -33,9 +35,21 @@ CLCachedEntry::CLCachedEntry()
 	mHandle = reinterpret_cast<CSSM_HANDLE>(this);
 }
 
+CLSharedCert::CLSharedCert(
+	const CssmData &encodedCert) :
+		mEncodedCert(Allocator::standard(), encodedCert),
+		mCert(Allocator::standard(), mEncodedCert.get())
+{
+}
+
+CLSharedCert::~CLSharedCert()
+{
+	/* mEncodedCert and mCert auto free */
+}
+
 CLCachedCert::~CLCachedCert()
 {
-	delete &mCert;
+	/* mCert releases its reference */
 }
 
 CLCachedCRL::~CLCachedCRL()
@@ -64,3 +78,78 @@ CLQuery::~CLQuery()
 {
 	/* mFieldId auto frees */
 }
+
+static ModuleNexus<CLDecodedCertCache> decodedCertCache;
+
+CLDecodedCertCache &CLDecodedCertCache::global()
+{
+	return decodedCertCache();
+}
+
+CLDecodedCertCache::CLDecodedCertCache() :
+		mHits(0),
+		mMisses(0),
+		mEvictions(0)
+{
+}
+
+CLDecodedCertCache::~CLDecodedCertCache()
+{
+	/* mLru releases its references */
+}
+
+RefPointer<CLSharedCert> CLDecodedCertCache::lookup(
+	const CssmData &encodedCert)
+{
+	unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+	CC_SHA256(encodedCert.data(), (CC_LONG)encodedCert.length(), digest);
+	std::string key((const char *)digest, sizeof(digest));
+
+	{
+		StLock<Mutex> _(mLock);
+		EntryMap::iterator it = mEntries.find(key);
+		if(it != mEntries.end()) {
+			Entry &entry = *it->second;
+			const CssmData &cached = entry.cert->encodedCert();
+			if((cached.length() == encodedCert.length()) &&
+			   !memcmp(cached.data(), encodedCert.data(), cached.length()) &&
+			   (++entry.lookups < kCLDecodedCertMaxLookups)) {
+				/* move to front */
+				mLru.splice(mLru.begin(), mLru, it->second);
+				mHits++;
+				return entry.cert;
+			}
+		}
+		mMisses++;
+	}
+
+	/* decode without holding the lock; throws on bad DER */
+	RefPointer<CLSharedCert> cert = new CLSharedCert(encodedCert);
+
+	StLock<Mutex> _(mLock);
+	EntryMap::iterator it = mEntries.find(key);
+	if(it != mEntries.end()) {
+		/* stale, lost a race with another decoder, or a digest collision */
+		mLru.erase(it->second);
+		mEntries.erase(it);
+	}
+	Entry entry = { key, cert, 0 };
+	mLru.push_front(entry);
+	mEntries[key] = mLru.begin();
+	while(mLru.size() > kCLDecodedCertCacheSize) {
+		mEntries.erase(mLru.back().digest);
+		mLru.pop_back();
+		mEvictions++;
+	}
+	return cert;
+}
+
+void CLDecodedCertCache::getStats(
+	CSSM_APPLE_CL_CERT_CACHE_STATS &stats)
+{
+	StLock<Mutex> _(mLock);
+	stats.hits = mHits;
+	stats.misses = mMisses;
+	stats.evictions = mEvictions;
+	stats.entries = (uint32)mLru.size();
+}
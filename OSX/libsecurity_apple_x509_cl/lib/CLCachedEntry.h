@@ -26,10 +26,16 @@
 #define _APPLE_X509_CL_CACHED_ENTRY_H_
 
 #include <Security/cssmtype.h>
+#include <Security/cssmapple.h>
 #include <security_utilities/utilities.h>
+#include <security_utilities/refcount.h>
+#include <security_utilities/threading.h>
 #include <security_cdsa_utilities/cssmdata.h>
 #include "DecodedCert.h"
 #include "DecodedCrl.h"
+#include <list>
+#include <map>
+#include <string>
 
 /* 
  * There is one of these per active cached object (cert or CRL). 
@@ -45,16 +51,90 @@ private:
 	CSSM_HANDLE		mHandle;	
 };
 
+/*
+ * A decoded cert shared by all sessions via CLDecodedCertCache. 
+ * DecodedCert's field accessors can allocate from its coder, so 
+ * callers hold this object's lock while they use cert(). 
+ */
+class CLSharedCert : public RefCount, public Mutex
+{
+	NOCOPY(CLSharedCert)
+public:
+	CLSharedCert(
+		const CssmData &encodedCert);
+	~CLSharedCert();
+	DecodedCert		&cert()				{ return mCert; }
+	const CssmData	&encodedCert()		{ return mEncodedCert.get(); }
+private:
+	CssmAutoData	mEncodedCert;		// our copy, which mCert is decoded from
+	DecodedCert		mCert;
+};
+
 class CLCachedCert : public CLCachedEntry
 {
 public:
 	CLCachedCert(
-		DecodedCert &c) : mCert(c) { }
+		CLSharedCert *c) : mCert(c) { }
 	~CLCachedCert();
-	DecodedCert	&cert()	{ return mCert; }
+	CLSharedCert	&cert()	{ return *mCert; }
 private:
-	/* decoded NSS format */
-	DecodedCert &mCert;
+	/* decoded NSS format, possibly in use by other sessions too */
+	RefPointer<CLSharedCert> mCert;
+};
+
+/*
+ * Process-wide cache of decoded certs, keyed by a digest of the 
+ * encoded cert, so that a series of *GetFirstFieldValue calls on 
+ * the same cert - from any session - only decodes it once. Holds
+ * up to kCLDecodedCertCacheSize certs, discarding the least recently
+ * used one when full; certs still in use by a session live on 
+ * until that session is done with them. 
+ */
+#define kCLDecodedCertCacheSize		64
+
+/*
+ * Some field accessors decode into the cert's coder, which only shrinks
+ * when the cert is freed; a cert which has been looked up this many times
+ * is decoded afresh so that memory stays bounded. 
+ */
+#define kCLDecodedCertMaxLookups	1024
+
+class CLDecodedCertCache
+{
+	NOCOPY(CLDecodedCertCache)
+public:
+	CLDecodedCertCache();
+	~CLDecodedCertCache();
+
+	/* 
+	 * Obtain the decoded form of encodedCert, decoding it if it's not
+	 * already cached. Throws CSSMERR_CL_UNKNOWN_FORMAT on bad DER. 
+	 */
+	RefPointer<CLSharedCert> lookup(
+		const CssmData &encodedCert);
+
+	void getStats(
+		CSSM_APPLE_CL_CERT_CACHE_STATS &stats);
+
+	static CLDecodedCertCache &global();
+
+private:
+	struct Entry {
+		std::string					digest;
+		RefPointer<CLSharedCert>	cert;
+		unsigned					lookups;
+	};
+	
+	/* most recently used at the front */
+	typedef std::list<Entry> LruList;
+	typedef std::map<std::string, LruList::iterator> EntryMap;
+	
+	Mutex			mLock;
+	LruList			mLru;
+	EntryMap		mEntries;
+	uint64			mHits;
+	uint64			mMisses;
+	uint64			mEvictions;
 };
 
 class CLCachedCRL : public CLCachedEntry
@@ -40,9 +40,9 @@ DecodedCert::DecodedCert(
 
 /* one-shot constructor, decoding from DER-encoded data */
 DecodedCert::DecodedCert(
-	AppleX509CLSession	&session,
+	Allocator			&alloc,
 	const CssmData 	&encodedCert)
-	: DecodedItem(session)
+	: DecodedItem(alloc)
 {
 	memset(&mCert, 0, sizeof(mCert));
 	PRErrorCode prtn = mCoder.decode(encodedCert.data(), encodedCert.length(), 
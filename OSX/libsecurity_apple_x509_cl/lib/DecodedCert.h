@@ -46,7 +46,7 @@ public:
 	
 	/* one-shot constructor, decoding from DER-encoded data */
 	DecodedCert(
-		AppleX509CLSession	&session,
+		Allocator			&alloc,
 		const CssmData 		&encodedCert);
 		
 	~DecodedCert();
@@ -32,11 +32,10 @@
 
 
 DecodedItem::DecodedItem(
-	AppleX509CLSession	&session)
+	Allocator			&alloc)
 	:	mState(IS_Empty),
-		mAlloc(session),
-		mSession(session),
-		mDecodedExtensions(mCoder, session)
+		mAlloc(alloc),
+		mDecodedExtensions(mCoder, alloc)
 {
 }
 
@@ -152,7 +152,7 @@ class DecodedItem
 {
 public:
 	DecodedItem(
-		AppleX509CLSession	&session);	
+		Allocator			&alloc);	
 
 	virtual ~DecodedItem();
 	
@@ -222,7 +222,6 @@ protected:
 	ItemState			mState;
 	Allocator		&mAlloc;
 	SecNssCoder			mCoder;			// from which all local allocs come
-	AppleX509CLSession	&mSession;
 	DecodedExtensions	mDecodedExtensions;
 	
 };
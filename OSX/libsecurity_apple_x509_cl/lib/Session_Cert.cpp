@@ -57,28 +57,24 @@ AppleX509CLSession::CertGetFirstFieldValue(
 	Value = NULL;
 	CssmAutoData aData(*this);
 	
-	DecodedCert *decodedCert = new DecodedCert(*this, EncodedCert);
+	/* decoded form comes from the cache shared by all sessions */
+	RefPointer<CLSharedCert> sharedCert = 
+		CLDecodedCertCache::global().lookup(EncodedCert);
 	uint32 numMatches;
 	
 	/* this returns false if field not there, throws on bad OID */
-	bool brtn;
-	try {
-		brtn = decodedCert->getCertFieldData(CertField, 
-			0, 				// index
-			numMatches, 
-			aData);
-	}
-	catch (...) {
-		delete decodedCert;
-		throw;
-	}
-	if(!brtn) {
-		delete decodedCert;
-		return CSSM_INVALID_HANDLE;
+	{
+		StLock<Mutex> _(*sharedCert);
+		if(!sharedCert->cert().getCertFieldData(CertField, 
+				0, 				// index
+				numMatches, 
+				aData)) {
+			return CSSM_INVALID_HANDLE;
+		}
 	}
 
 	/* cook up a CLCachedCert, stash it in cache */
-	CLCachedCert *cachedCert = new CLCachedCert(*decodedCert);
+	CLCachedCert *cachedCert = new CLCachedCert(sharedCert);
 	cacheMap.addEntry(*cachedCert, cachedCert->handle());
 	
 	/* cook up a CLQuery, stash it */
@@ -118,9 +114,11 @@ AppleX509CLSession::CertGetNextFieldValue(
 
 	/* fetch the associated cached cert */
 	CLCachedCert *cachedCert = lookupCachedCert(query->cachedObject());
+	CLSharedCert &sharedCert = cachedCert->cert();
 	uint32 dummy;
 	CssmAutoData aData(*this);
-	if(!cachedCert->cert().getCertFieldData(query->fieldId(), 
+	StLock<Mutex> _(sharedCert);
+	if(!sharedCert.cert().getCertFieldData(query->fieldId(), 
 		query->nextIndex(), 
 		dummy,
 		aData))  {
@@ -139,10 +137,11 @@ AppleX509CLSession::CertCache(
 	const CssmData &EncodedCert,
 	CSSM_HANDLE &CertHandle)
 {
-	DecodedCert *decodedCert = new DecodedCert(*this, EncodedCert);
+	RefPointer<CLSharedCert> sharedCert = 
+		CLDecodedCertCache::global().lookup(EncodedCert);
 	
 	/* cook up a CLCachedCert, stash it in cache */
-	CLCachedCert *cachedCert = new CLCachedCert(*decodedCert);
+	CLCachedCert *cachedCert = new CLCachedCert(sharedCert);
 	cacheMap.addEntry(*cachedCert, cachedCert->handle());
 	CertHandle = cachedCert->handle();
 }
@@ -160,15 +159,19 @@ AppleX509CLSession::CertGetFirstCachedFieldValue(
 		CssmError::throwMe(CSSMERR_CL_INVALID_CACHE_HANDLE);
 	}
 	
+	CLSharedCert &sharedCert = cachedCert->cert();
 	CssmAutoData aData(*this);
 	uint32 numMatches;
 
 	/* this returns false if field not there, throws on bad OID */
-	if(!cachedCert->cert().getCertFieldData(CertField, 
-			0, 				// index
-			numMatches, 
-			aData)) {
-		return CSSM_INVALID_HANDLE;
+	{
+		StLock<Mutex> _(sharedCert);
+		if(!sharedCert.cert().getCertFieldData(CertField, 
+				0, 				// index
+				numMatches, 
+				aData)) {
+			return CSSM_INVALID_HANDLE;
+		}
 	}
 
 	/* cook up a CLQuery, stash it */
@@ -404,6 +407,22 @@ AppleX509CLSession::PassThrough(
 			verifyCsr(csrPtr);
 			break;
 		}	
+		case CSSM_APPLEX509CL_GET_CERT_CACHE_STATS:
+		{
+			/*
+			 * Statistics for the decoded cert cache shared by all sessions.
+			 * Input:  Nothing.
+			 * Output: allocated CSSM_APPLE_CL_CERT_CACHE_STATS.
+			 */
+			if(OutputParams == NULL) {
+				CssmError::throwMe(CSSMERR_CL_INVALID_OUTPUT_POINTER);
+			}
+			CSSM_APPLE_CL_CERT_CACHE_STATS *stats = 
+				(CSSM_APPLE_CL_CERT_CACHE_STATS *)malloc(sizeof(CSSM_APPLE_CL_CERT_CACHE_STATS));
+			CLDecodedCertCache::global().getStats(*stats);
+			*OutputParams = stats;
+			break;
+		}
 		default:
 			CssmError::throwMe(CSSMERR_CL_INVALID_PASSTHROUGH_ID);
 	}
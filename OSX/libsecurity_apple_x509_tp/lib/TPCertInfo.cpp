@@ -26,6 +26,7 @@
 #include "certGroupUtils.h"
 #include "TPDatabase.h"
 #include "TPNetwork.h"
+#include "tpVerifyCache.h"
 #include <Security/cssmapi.h>
 #include <Security/x509defs.h>
 #include <Security/oidscert.h>
@@ -247,6 +248,16 @@ CSSM_RETURN TPClItemInfo::verifyWithIssuer(
 		return CSSMERR_CSP_APPLE_PUBLIC_KEY_INCOMPLETE;
 	}
 
+	/*
+	 * Skip the public key op if this exact signature has already been
+	 * verified with this exact key. Verifies using a parameter-bearing
+	 * key are not cached.
+	 */
+	if((paramCert == NULL) && tpVerifyCacheLookup(*mItemData, *issuerCert->pubKey())) {
+		tpVfyDebug("verifyWithIssuer GOOD (cached)");
+		return CSSM_OK;
+	}
+
 	CSSM_CC_HANDLE ccHand;
 	crtn = CSSM_CSP_CreateSignatureContext(mCspHand,
 		mSigAlg,
@@ -281,6 +292,11 @@ CSSM_RETURN TPClItemInfo::verifyWithIssuer(
 
 	switch(crtn) {
 		case CSSM_OK:		// success
+			if(paramCert == NULL) {
+				tpVerifyCacheAdd(*mItemData, *issuerCert->pubKey());
+			}
+			tpVfyDebug("verifyWithIssuer GOOD");
+			break;
 		case CSSMERR_CSP_APPLE_PUBLIC_KEY_INCOMPLETE:	// caller handles
 			tpVfyDebug("verifyWithIssuer GOOD");
 			break;
@@ -912,7 +928,8 @@ TPCertGroup::TPCertGroup(
 		mCertInfo(NULL),
 		mNumCerts(0),
 		mSizeofCertInfo(0),
-		mWhoOwns(whoOwns)
+		mWhoOwns(whoOwns),
+		mSubjectIndexValid(false)
 {
 	tpCertInfoDbg("TPCertGroup simple construct this %p", this);
 	/* nothing for now */
@@ -936,7 +953,8 @@ TPCertGroup::TPCertGroup(
 		mCertInfo(NULL),
 		mNumCerts(0),
 		mSizeofCertInfo(0),
-		mWhoOwns(whoOwns)
+		mWhoOwns(whoOwns),
+		mSubjectIndexValid(false)
 {
 	tpCertInfoDbg("TPCertGroup hard construct this %p", this);
 
@@ -1032,7 +1050,13 @@ void TPCertGroup::appendCert(
 		mCertInfo = (TPCertInfo **)mAlloc.realloc(mCertInfo,
 			mSizeofCertInfo * sizeof(TPCertInfo *));
 	}
-	mCertInfo[mNumCerts++] = certInfo;
+	mCertInfo[mNumCerts] = certInfo;
+	if(mSubjectIndexValid) {
+		const CSSM_DATA *subjectName = certInfo->subjectName();
+		mSubjectIndex[std::string((const char *)subjectName->Data,
+			subjectName->Length)].push_back(mNumCerts);
+	}
+	mNumCerts++;
 }
 
 TPCertInfo *TPCertGroup::certAtIndex(
@@ -1059,6 +1083,10 @@ TPCertInfo *TPCertGroup::removeCertAtIndex(
 		mCertInfo[i] = mCertInfo[i+1];
 	}
 	mNumCerts--;
+
+	/* indices have shifted; rebuild on the next issuer search */
+	mSubjectIndex.clear();
+	mSubjectIndexValid = false;
 	return rtn;
 }
 
@@ -1391,6 +1419,20 @@ void TPCertGroup::encodeIssuers(CSSM_DATA &issuers)
 	}
 }
 
+/*
+ * Index all certs in this group by subject name.
+ */
+void TPCertGroup::buildSubjectIndex()
+{
+	mSubjectIndex.clear();
+	for(unsigned certDex=0; certDex<mNumCerts; certDex++) {
+		const CSSM_DATA *subjectName = mCertInfo[certDex]->subjectName();
+		mSubjectIndex[std::string((const char *)subjectName->Data,
+			subjectName->Length)].push_back(certDex);
+	}
+	mSubjectIndexValid = true;
+}
+
 /*
  * Search unused incoming certs to find an issuer of specified cert or CRL.
  * WARNING this assumes a valid "used" state for all certs in this group.
@@ -1405,8 +1447,24 @@ TPCertInfo *TPCertGroup::findIssuerForCertOrCrl(
 	TPCertInfo *expiredIssuer = NULL;
 	TPCertInfo *unmatchedKeyIDIssuer = NULL;
 
-	for(unsigned certDex=0; certDex<mNumCerts; certDex++) {
-		TPCertInfo *certInfo = certAtIndex(certDex);
+	/*
+	 * Only certs whose subject name is the subject's issuer name are
+	 * candidates; visit them in group order, as a full scan would.
+	 */
+	if(!mSubjectIndexValid) {
+		buildSubjectIndex();
+	}
+	const CSSM_DATA *issuerName = subject.issuerName();
+	assert(issuerName != NULL);
+	SubjectIndex::const_iterator candidates = mSubjectIndex.find(
+		std::string((const char *)issuerName->Data, issuerName->Length));
+	if(candidates == mSubjectIndex.end()) {
+		return NULL;
+	}
+
+	for(std::vector<unsigned>::const_iterator it = candidates->second.begin();
+		it != candidates->second.end(); ++it) {
+		TPCertInfo *certInfo = certAtIndex(*it);
 
 		/* has this one already been used in this search? */
 		if(certInfo->used()) {
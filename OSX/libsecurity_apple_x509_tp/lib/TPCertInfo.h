@@ -30,6 +30,9 @@
 #include <security_utilities/threading.h>
 #include <security_utilities/globalizer.h>
 #include <CoreFoundation/CFDate.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 /* protects TP-wide access to time() and gmtime() */
 extern ModuleNexus<Mutex> tpTimeLock;
@@ -594,7 +597,8 @@ private:
 
 	/*
 	 * Search unused incoming certs to find an issuer of specified
-	 * cert or CRL.
+	 * cert or CRL. Only certs whose subject name matches the
+	 * subject's issuer name, per mSubjectIndex, are considered.
 	 * WARNING this assumes a valied "used" state for all certs
 	 * in this group.
 	 * If partialIssuerKey is true on return, caller must re-verify signature
@@ -622,5 +626,16 @@ private:
 	unsigned				mSizeofCertInfo;	// mallocd space in certInfo
 	TPGroupOwner			mWhoOwns;			// if TGO_Group, we delete certs
 												//    upon destruction
+
+	/*
+	 * Index from normalized subject name to the indices in mCertInfo of
+	 * the certs with that name, in ascending order. Built on the first
+	 * issuer search, kept up to date by appendCert(), and discarded by
+	 * removeCertAtIndex().
+	 */
+	typedef std::unordered_map<std::string, std::vector<unsigned> > SubjectIndex;
+	SubjectIndex			mSubjectIndex;
+	bool					mSubjectIndexValid;
+	void					buildSubjectIndex();
 };
 #endif	/* _TP_CERT_INFO_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ * 
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * tpVerifyCache.cpp - process-wide memo of successful signature verifications.
+ *
+ * Chain building verifies the same (child, issuer) pairs over and over, 
+ * each time with a full public key operation. Entries are keyed by a 
+ * SHA-256 digest of the signed item - which covers both the TBS data and
+ * the signature - and a SHA-256 digest of the issuer's key, so a hit 
+ * means that exactly this signature was proven with exactly this key. 
+ */
+
+#include "tpVerifyCache.h"
+#include "tpdebugging.h"
+#include <security_utilities/globalizer.h>
+#include <security_utilities/threading.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <list>
+#include <map>
+#include <string>
+
+/* SHA-256(item) || SHA-256(key header fields, key data) */
+typedef std::string VerifyCacheKey;
+
+static VerifyCacheKey tpVerifyCacheKey(
+	const CSSM_DATA		&item,
+	const CSSM_KEY		&issuerKey)
+{
+	uint8 digests[2 * CC_SHA256_DIGEST_LENGTH];
+	CC_SHA256(item.Data, (CC_LONG)item.Length, digests);
+
+	CC_SHA256_CTX ctx;
+	CC_SHA256_Init(&ctx);
+	CC_SHA256_Update(&ctx, &issuerKey.KeyHeader.AlgorithmId, 
+		sizeof(issuerKey.KeyHeader.AlgorithmId));
+	CC_SHA256_Update(&ctx, &issuerKey.KeyHeader.BlobType, 
+		sizeof(issuerKey.KeyHeader.BlobType));
+	CC_SHA256_Update(&ctx, &issuerKey.KeyHeader.Format, 
+		sizeof(issuerKey.KeyHeader.Format));
+	CC_SHA256_Update(&ctx, issuerKey.KeyData.Data, (CC_LONG)issuerKey.KeyData.Length);
+	CC_SHA256_Final(digests + CC_SHA256_DIGEST_LENGTH, &ctx);
+
+	return VerifyCacheKey((const char *)digests, sizeof(digests));
+}
+
+#pragma mark ---- global cache object ----
+
+/*
+ * The cache object; ModuleNexus provides each task with at most one of these.
+ * All ops hold mCacheLock.
+ */
+class VerifyCache
+{
+public:
+	VerifyCache() { }
+	~VerifyCache() { }
+
+	bool lookup(
+		const VerifyCacheKey	&key);
+	void add(
+		const VerifyCacheKey	&key);
+
+private:
+	/* most recently used at the front */
+	typedef std::list<VerifyCacheKey> LruList;
+	typedef std::map<VerifyCacheKey, LruList::iterator> EntryMap;
+
+	Mutex			mCacheLock;
+	LruList			mLru;
+	EntryMap		mEntries;
+};
+
+bool VerifyCache::lookup(
+	const VerifyCacheKey	&key)
+{
+	StLock<Mutex> _(mCacheLock);
+	EntryMap::iterator it = mEntries.find(key);
+	if(it == mEntries.end()) {
+		return false;
+	}
+	mLru.splice(mLru.begin(), mLru, it->second);
+	return true;
+}
+
+void VerifyCache::add(
+	const VerifyCacheKey	&key)
+{
+	StLock<Mutex> _(mCacheLock);
+	if(mEntries.find(key) != mEntries.end()) {
+		/* another thread got here first */
+		return;
+	}
+	mLru.push_front(key);
+	mEntries[key] = mLru.begin();
+	if(mLru.size() > TP_VERIFY_CACHE_SIZE) {
+		mEntries.erase(mLru.back());
+		mLru.pop_back();
+	}
+}
+
+static ModuleNexus<VerifyCache> tpVerifyCache;
+
+#pragma mark ---- Public API ----
+
+bool tpVerifyCacheLookup(
+	const CSSM_DATA		&item,
+	const CSSM_KEY		&issuerKey)
+{
+	bool found = tpVerifyCache().lookup(tpVerifyCacheKey(item, issuerKey));
+	tpVfyDebug("tpVerifyCacheLookup: %s", found ? "HIT" : "MISS");
+	return found;
+}
+
+void tpVerifyCacheAdd(
+	const CSSM_DATA		&item,
+	const CSSM_KEY		&issuerKey)
+{
+	tpVerifyCache().add(tpVerifyCacheKey(item, issuerKey));
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ * 
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * tpVerifyCache.h - process-wide memo of successful signature verifications.
+ */
+ 
+#ifndef	_TP_VERIFY_CACHE_H_
+#define _TP_VERIFY_CACHE_H_
+
+#include <Security/cssmtype.h>
+
+/* max number of (item, issuer key) pairs remembered */
+#define TP_VERIFY_CACHE_SIZE	1024
+
+/*
+ * Returns true if the signature on the DER-encoded cert or CRL in item
+ * has already been verified with issuerKey.
+ */
+bool tpVerifyCacheLookup(
+	const CSSM_DATA		&item,
+	const CSSM_KEY		&issuerKey);
+
+/*
+ * Remember that the signature on item verified with issuerKey. Only 
+ * successful verifications are cached; the least recently used entry
+ * is discarded when the cache is full.
+ */
+void tpVerifyCacheAdd(
+	const CSSM_DATA		&item,
+	const CSSM_KEY		&issuerKey);
+
+#endif	/* _TP_VERIFY_CACHE_H_ */
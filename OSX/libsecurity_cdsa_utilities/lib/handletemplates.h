@@ -102,10 +102,10 @@ public:
 // <rdar://problem/28898053> security_filedb build error: instantiation of variable 'Security::MappingHandle<long>::state' required here, but no definition is available
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wundefined-var-template"
-        State &st = state();
+        Shard &shard = state().shardFor(this->handle());
 #pragma clang diagnostic pop
-        StLock<Mutex> _(st);
-        st.erase(this);
+        StLock<Mutex> _(shard);
+        shard.erase(this);
     }
 
     template <class SubType>
@@ -140,23 +140,47 @@ protected:
 
     MappingHandle();
 
-    class State : public Mutex, public HandleMap
+    //
+    // The handle map is striped across independently locked shards, chosen
+    // by a hash of the handle, so concurrent lookups of different handles
+    // rarely contend. All per-handle operations take only that handle's
+    // shard lock.
+    //
+    class Shard : public Mutex, public HandleMap
     {
     public:
-        State();
-        uint32_t nextSeq()  { return ++sequence; }
-
         bool handleInUse(_Handle h);
         MappingHandle<_Handle> *find(_Handle h, CSSM_RETURN error);
         typename HandleMap::iterator locate(_Handle h, CSSM_RETURN error);
         void add(_Handle h, MappingHandle<_Handle> *obj);
         void erase(MappingHandle<_Handle> *obj);
         void erase(typename HandleMap::iterator &it);
+    };
+
+    class State
+    {
+    public:
+        static const unsigned shardCount = 32;     // power of two
+
+        State();
+        uint32_t nextSeq()  { return ++sequence; }
+
+        Shard &shardFor(_Handle h)
+        {
+            // handles are mostly object addresses; mix the bits before striping
+            uint64_t mix = uint64_t(h) * 0x9E3779B97F4A7C15ULL;
+            return mShards[(mix >> 32) & (shardCount - 1)];
+        }
+
+        MappingHandle<_Handle> *find(_Handle h, CSSM_RETURN error)
+        { return shardFor(h).find(h, error); }
+
         // @@@  Remove when 4003540 is fixed
         template <class SubType> void findAllRefs(std::vector<_Handle> &refs);
 
     private:
-        uint32_t sequence;
+        AtomicCounter<uint32_t> sequence;
+        Shard mShards[shardCount];
     };
     
 private:
@@ -192,8 +216,9 @@ inline Subclass &MappingHandle<_Handle>::findAndLock(_Handle handle,
                                              CSSM_RETURN error)
 {
     for (;;) {
-        typename HandleMap::iterator it = state().locate(handle, error);
-        StLock<Mutex> _(state(), true);	// locate() locked it
+        Shard &shard = state().shardFor(handle);
+        typename HandleMap::iterator it = shard.locate(handle, error);
+        StLock<Mutex> _(shard, true);	// locate() locked it
         Subclass *sub;
         if (!(sub = dynamic_cast<Subclass *>(it->second)))
             CssmError::throwMe(error);	// bad type
@@ -212,14 +237,15 @@ inline Subclass &MappingHandle<_Handle>::findAndKill(_Handle handle,
 // <rdar://problem/28898053> security_filedb build error: instantiation of variable 'Security::MappingHandle<long>::state' required here, but no definition is available
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wundefined-var-template"
-        typename HandleMap::iterator it = state().locate(handle, error);
+        Shard &shard = state().shardFor(handle);
 #pragma clang diagnostic pop
-        StLock<Mutex> _(state(), true);	// locate() locked it
+        typename HandleMap::iterator it = shard.locate(handle, error);
+        StLock<Mutex> _(shard, true);	// locate() locked it
         Subclass *sub;
         if (!(sub = dynamic_cast<Subclass *>(it->second)))
             CssmError::throwMe(error);	// bad type
         if (it->second->tryLock()) {	// try to lock it
-            state().erase(it);			// kill the handle
+            shard.erase(it);			// kill the handle
             return *sub;				// okay, go
         }
         Thread::yield();				// object lock failed, backoff and retry
@@ -231,8 +257,9 @@ template <class Subclass>
 inline RefPointer<Subclass> MappingHandle<_Handle>::findRef(_Handle handle,
                                                     CSSM_RETURN error)
 {
-    typename HandleMap::iterator it = state().locate(handle, error);
-    StLock<Mutex> _(state(), true); // locate() locked it
+    Shard &shard = state().shardFor(handle);
+    typename HandleMap::iterator it = shard.locate(handle, error);
+    StLock<Mutex> _(shard, true); // locate() locked it
     Subclass *sub;
     if (!(sub = dynamic_cast<Subclass *>(it->second)))
         CssmError::throwMe(error);
@@ -245,8 +272,9 @@ inline RefPointer<Subclass> MappingHandle<_Handle>::findRefAndLock(_Handle handl
                                                            CSSM_RETURN error)
 {
     for (;;) {
-        typename HandleMap::iterator it = state().locate(handle, error);
-        StLock<Mutex> _(state(), true);	// locate() locked it
+        Shard &shard = state().shardFor(handle);
+        typename HandleMap::iterator it = shard.locate(handle, error);
+        StLock<Mutex> _(shard, true);	// locate() locked it
         Subclass *sub;
         if (!(sub = dynamic_cast<Subclass *>(it->second)))
             CssmError::throwMe(error);	// bad type
@@ -262,13 +290,14 @@ inline RefPointer<Subclass> MappingHandle<_Handle>::findRefAndKill(_Handle handl
                                                            CSSM_RETURN error)
 {
     for (;;) {
-        typename HandleMap::iterator it = state().locate(handle, error);
-        StLock<Mutex> _(state(), true);	// locate() locked it
+        Shard &shard = state().shardFor(handle);
+        typename HandleMap::iterator it = shard.locate(handle, error);
+        StLock<Mutex> _(shard, true);	// locate() locked it
         Subclass *sub;
         if (!(sub = dynamic_cast<Subclass *>(it->second)))
             CssmError::throwMe(error);	// bad type
         if (it->second->tryLock()) {	// try to lock it
-            state().erase(it);			// kill the handle
+            shard.erase(it);			// kill the handle
             return sub;					// okay, go
         }
         Thread::yield();				// object lock failed, backoff and retry
@@ -286,13 +315,16 @@ template <class _Handle>
 template <class Subtype>
 void MappingHandle<_Handle>::State::findAllRefs(std::vector<_Handle> &refs)
 {
-    StLock<Mutex> _(*this);
-    typename HandleMap::iterator it = (*this).begin();
-    for (; it != (*this).end(); ++it)
-    {
-        Subtype *obj = dynamic_cast<Subtype *>(it->second);
-        if (obj)
-            refs.push_back(it->first);
+    for (unsigned n = 0; n < shardCount; n++) {
+        Shard &shard = mShards[n];
+        StLock<Mutex> _(shard);
+        typename HandleMap::iterator it = shard.begin();
+        for (; it != shard.end(); ++it)
+        {
+            Subtype *obj = dynamic_cast<Subtype *>(it->second);
+            if (obj)
+                refs.push_back(it->first);
+        }
     }
 }
 
@@ -71,16 +71,16 @@ MappingHandle<_Handle>::MappingHandle() : TypedHandle<_Handle>()
 template <class _Handle>
 void MappingHandle<_Handle>::make()
 {
-    StLock<Mutex> _(state());
-    
     _Handle hbase = (_Handle)reinterpret_cast<uintptr_t>(this);
     for (;;) {
         _Handle handle = hbase ^ state().nextSeq();
-        if (!state().handleInUse(handle)) {
+        Shard &shard = state().shardFor(handle);
+        StLock<Mutex> _(shard);
+        if (!shard.handleInUse(handle)) {
             // assumes sizeof(unsigned long) >= sizeof(handle)
             secinfo("handleobj", "create %#lx for %p", static_cast<unsigned long>(handle), this);
             TypedHandle<_Handle>::setHandle(handle);
-            state().add(handle, this);
+            shard.add(handle, this);
             return;
         }
     }
@@ -95,7 +95,7 @@ bool MappingHandle<_Handle>::tryLock() { return true; }
     
 
 //
-// MappingHandle::State
+// MappingHandle::State and its Shards
 //
 
 // The default State constructor should not be inlined in a standard
@@ -109,11 +109,11 @@ MappingHandle<_Handle>::State::State()
 
 // 
 // Check if the handle is already in the map.  Caller must already hold 
-// the map lock.  Intended for use by a subclass' implementation of 
+// the shard lock.  Intended for use by a subclass' implementation of 
 // MappingHandle<...>::make().  
 //
 template <class _Handle>
-bool MappingHandle<_Handle>::State::handleInUse(_Handle h)
+bool MappingHandle<_Handle>::Shard::handleInUse(_Handle h)
 {
     return (HandleMap::find(h) != (*this).end());
 }
@@ -124,7 +124,7 @@ bool MappingHandle<_Handle>::State::handleInUse(_Handle h)
 // be found, or it is corrupt.
 //
 template <class _Handle>
-MappingHandle<_Handle> *MappingHandle<_Handle>::State::find(_Handle h, CSSM_RETURN error)
+MappingHandle<_Handle> *MappingHandle<_Handle>::Shard::find(_Handle h, CSSM_RETURN error)
 {
 	StLock<Mutex> _(*this);
 	typename HandleMap::const_iterator it = HandleMap::find(h);
@@ -139,12 +139,12 @@ MappingHandle<_Handle> *MappingHandle<_Handle>::State::find(_Handle h, CSSM_RETU
 //
 // Look up the handle given in the global handle map.
 // If not found, or if the object is corrupt, throw an exception.
-// Otherwise, hold the State lock and return an iterator to the map entry.
-// Caller must release the State lock in a timely manner.
+// Otherwise, hold the Shard lock and return an iterator to the map entry.
+// Caller must release the Shard lock in a timely manner.
 //
 template <class _Handle>
 typename MappingHandle<_Handle>::HandleMap::iterator 
-MappingHandle<_Handle>::State::locate(_Handle h, CSSM_RETURN error)
+MappingHandle<_Handle>::Shard::locate(_Handle h, CSSM_RETURN error)
 {
 	StLock<Mutex> locker(*this);
 	typename HandleMap::iterator it = HandleMap::find(h);
@@ -159,31 +159,31 @@ MappingHandle<_Handle>::State::locate(_Handle h, CSSM_RETURN error)
 
 //
 // Add a handle and its associated object to the map.  Caller must already
-// hold the map lock, and is responsible for collision-checking prior to
+// hold the shard lock, and is responsible for collision-checking prior to
 // calling this method.  Intended for use by a subclass' implementation of 
 // MappingHandle<...>::make().  
 //
 template <class _Handle>
-void MappingHandle<_Handle>::State::add(_Handle h, MappingHandle<_Handle> *obj)
+void MappingHandle<_Handle>::Shard::add(_Handle h, MappingHandle<_Handle> *obj)
 {
     (*this)[h] = obj;
 }
 
 //
 // Clean up the handle for an object that dies.  Caller must already hold
-// the map lock.  
+// the shard lock.  
 // Note that an object MAY clear its handle before (in which case we do nothing).
 // In particular, killHandle will do this.
 //
 template <class _Handle>
-void MappingHandle<_Handle>::State::erase(MappingHandle<_Handle> *obj)
+void MappingHandle<_Handle>::Shard::erase(MappingHandle<_Handle> *obj)
 {
     if (obj->validHandle())
         HandleMap::erase(obj->handle());
 }
 
 template <class _Handle>
-void MappingHandle<_Handle>::State::erase(typename HandleMap::iterator &it)
+void MappingHandle<_Handle>::Shard::erase(typename HandleMap::iterator &it)
 {
     if (it->second->validHandle())
         HandleMap::erase(it);
@@ -113,7 +113,7 @@ public:
 // Construct a SecCodeSigner
 //
 SecCodeSigner::SecCodeSigner(SecCSFlags flags)
-	: mOpFlags(flags), mLimitedAsync(NULL), mRuntimeVersionOverride(0)
+	: mOpFlags(flags), mLimitedAsync(NULL), mRuntimeVersionOverride(0), mHashThreads(0)
 {
 }
 
@@ -337,6 +337,11 @@ SecCodeSigner::Parser::Parser(SecCodeSigner &state, CFDictionaryRef parameters)
 		state.mRuntimeVersionOverride = parseRuntimeVersion(runtime);
 	}
 	state.mPreserveAFSC = getBool(kSecCodeSignerPreserveAFSC);
+
+	if (CFNumberRef threads = get<CFNumberRef>(kSecCodeSignerHashThreads))
+		state.mHashThreads = cfNumber<int>(threads);
+	else
+		state.mHashThreads = 0;
 }
 
 
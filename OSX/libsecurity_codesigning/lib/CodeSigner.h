@@ -95,6 +95,7 @@ public:
 	LimitedAsync *mLimitedAsync;	// limited async workers for verification
 	uint32_t mRuntimeVersionOverride;	// runtime Version Override
 	bool mPreserveAFSC;             // preserve AFSC compression
+	int mHashThreads;				// parallel code hashing workers (0 => serial, negative => one per CPU)
 
 };
 
@@ -140,6 +140,10 @@ CFTypeID SecCodeSignerGetTypeID(void);
 		x is a number between 0 and 255. This parameter is optional. If the signer specifies
 		kSecCodeSignatureRuntime but does not provide this parameter, the runtime version will be the SDK
 		version built into the Mach-O.
+	@constant kSecCodeSignerHashThreads An integer requesting that the code pages of the main executable
+		be hashed by that many parallel workers, with the architectures of a universal binary sharing
+		them. A negative value means one per CPU. Zero or absent hashes on the calling thread.
+		The resulting signature is the same either way.
 
  */
 extern const CFStringRef kSecCodeSignerApplicationData;
@@ -165,6 +169,7 @@ extern const CFStringRef kSecCodeSignerTeamIdentifier;
 extern const CFStringRef kSecCodeSignerPlatformIdentifier;
 extern const CFStringRef kSecCodeSignerRuntimeVersion;
 extern const CFStringRef kSecCodeSignerPreserveAFSC;
+extern const CFStringRef kSecCodeSignerHashThreads;
 
 enum {
     kSecCodeSignerPreserveIdentifier = 1 << 0,		// preserve signing identifier
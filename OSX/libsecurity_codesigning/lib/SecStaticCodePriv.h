@@ -74,6 +74,13 @@ OSStatus SecStaticCodeSetCallback(SecStaticCodeRef code, SecCSFlags flag, SecCod
  
  	@param code A Code or StaticCode object whose validation should be modified.
  	@param conditions A dictionary containing one or more validation conditions. Must not be NULL.
+ 		The "executableThreads" key (a CFNumber) requests that the main executable's code pages
+ 		be hashed by that many parallel workers (a negative value means one per CPU). Zero or
+ 		absent selects the traditional single-threaded scan. The outcome is the same either way.
+ 		The "resourceCache" key (kCFBooleanTrue, or a CFString path) enables a persistent cache of
+ 		resource digests that have already validated, keyed by file identity and metadata, so
+ 		unchanged resource files are not rehashed. "resourceCacheStrict" (kCFBooleanTrue)
+ 		rehashes every resource regardless of the cache, but still refreshes it.
  */
 OSStatus SecStaticCodeSetValidationConditions(SecStaticCodeRef code, CFDictionaryRef conditions);
 	
@@ -67,6 +67,7 @@
 #include <dispatch/private.h>
 #include <os/assumes.h>
 #include <regex.h>
+#include <atomic>
 
 
 namespace Security {
@@ -104,6 +105,7 @@ static inline OSStatus errorForSlot(CodeDirectory::SpecialSlot slot)
 SecStaticCode::SecStaticCode(DiskRep *rep, uint32_t flags)
 	: mCheckfix30814861builder1(NULL),
 	  mRep(rep),
+	  mExecutableThreads(0), mResourceSealCacheStrict(false),
 	  mValidated(false), mExecutableValidated(false), mResourcesValidated(false), mResourcesValidContext(NULL),
 	  mProgressQueue("com.apple.security.validation-progress", false, QOS_CLASS_UNSPECIFIED),
 	  mOuterScope(NULL), mResourceScope(NULL),
@@ -144,6 +146,10 @@ void SecStaticCode::initializeFromParent(const SecStaticCode& parent) {
 	setMonitor(parent.monitor());
 	if (parent.mLimitedAsync)
 		mLimitedAsync = new LimitedAsync(*parent.mLimitedAsync);
+#if TARGET_OS_OSX
+	mResourceSealCache = parent.mResourceSealCache;
+#endif
+	mResourceSealCacheStrict = parent.mResourceSealCacheStrict;
 }
 
 //
@@ -230,6 +236,17 @@ void SecStaticCode::setValidationModifiers(CFDictionaryRef conditions)
 		mAllowOmissions = source.get<CFArrayRef>("omissions");
 		if (CFArrayRef errors = source.get<CFArrayRef>("errors"))
 			CFArrayApplyFunction(errors, CFRangeMake(0, CFArrayGetCount(errors)), addError, &this->mTolerateErrors);
+		if (CFNumberRef threads = source.get<CFNumberRef>("executableThreads"))
+			mExecutableThreads = cfNumber<int>(threads);
+#if TARGET_OS_OSX
+		if (CFTypeRef cache = source.get<CFTypeRef>("resourceCache")) {
+			if (CFGetTypeID(cache) == CFStringGetTypeID())
+				mResourceSealCache = new ResourceSealCache(cfString(CFStringRef(cache)).c_str());
+			else if (cache == kCFBooleanTrue)
+				mResourceSealCache = new ResourceSealCache();
+		}
+		mResourceSealCacheStrict = source.get<CFBooleanRef>("resourceCacheStrict") == kCFBooleanTrue;
+#endif
 	}
 }
 
@@ -1150,16 +1167,26 @@ void SecStaticCode::validateExecutable()
 				MacOSError::throwMe(errSecCSUnsigned);
 			AutoFileDesc fd(mainExecutablePath(), O_RDONLY);
 			fd.fcntl(F_NOCACHE, true);		// turn off page caching (one-pass)
+			size_t pageSize = cd->pageSize ? (1 << cd->pageSize) : 0;
+			if (mExecutableThreads != 0 && pageSize) {
+				off_t base = 0;
+				if (Universal *fat = mRep->mainExecutableImage())
+					base = fat->archOffset();
+				this->validateExecutablePages(fd, base, executableWorkers());
+				mExecutableValidated = true;
+				mExecutableValidResult = errSecSuccess;
+				return;
+			}
 			if (Universal *fat = mRep->mainExecutableImage())
 				fd.seek(fat->archOffset());
-			size_t pageSize = cd->pageSize ? (1 << cd->pageSize) : 0;
 			size_t remaining = cd->signingLimit();
+			CodeDirectory::MultipleHasher hashers(hashAlgorithms());
 			for (uint32_t slot = 0; slot < cd->nCodeSlots; ++slot) {
 				size_t thisPage = remaining;
 				if (pageSize)
 					thisPage = min(thisPage, pageSize);
 				__block bool good = true;
-				CodeDirectory::multipleHashFileData(fd, thisPage, hashAlgorithms(), ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
+				hashers.hashFileData(fd, thisPage, ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
 					const CodeDirectory* cd = (const CodeDirectory*)CFDataGetBytePtr(mCodeDirectories[type]);
 					if (!hasher->verify(cd->getSlot(slot,
 													mValidationFlags & kSecCSValidatePEH)))
@@ -1192,6 +1219,132 @@ void SecStaticCode::validateExecutable()
 }
 
 
+//
+// Figure out how many workers a parallel executable scan should use.
+// A negative setting means "one per online CPU".
+//
+unsigned SecStaticCode::executableWorkers() const
+{
+	if (mExecutableThreads > 0)
+		return mExecutableThreads;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	return (ncpu > 0) ? unsigned(ncpu) : 1;
+}
+
+
+//
+// Parallel form of the executable page scan.
+// The code slot range is cut into contiguous runs, one per worker. Each worker reads
+// its own pages with positional reads (so the workers never share a file offset) and
+// hashes them with its own hashers, one per algorithm, made once per worker and reset
+// after every page (never allocate hashers per page here). A worker gives up once it
+// has moved past the lowest failing slot found so far, which guarantees that we report
+// the same slot (and error) that the serial scan would have reported.
+//
+void SecStaticCode::validateExecutablePages(FileDesc fd, off_t base, unsigned workers)
+{
+	const CodeDirectory *cd = this->codeDirectory();
+	const size_t pageSize = 1 << cd->pageSize;
+	const size_t limit = cd->signingLimit();
+	const uint32_t nSlots = cd->nCodeSlots;
+	const bool preEncrypted = mValidationFlags & kSecCSValidatePEH;
+
+	// collect the CodeDirectories to check against up front (the workers must not touch mCodeDirectories);
+	// these are the same ones the serial scan checks
+	vector<pair<CodeDirectory::HashAlgorithm, const CodeDirectory *> > checks;
+	CodeDirectory::HashAlgorithms types = hashAlgorithms();
+	for (auto it = types.begin(); it != types.end(); ++it)
+		checks.push_back(make_pair(*it, (const CodeDirectory *)CFDataGetBytePtr(mCodeDirectories[*it])));
+	if (checks.empty())
+		MacOSError::throwMe(errSecCSSignatureFailed);
+
+	// don't bother splitting tiny executables into ranges smaller than this
+	static const uint32_t minSlotsPerWorker = 16;
+	workers = max(1u, min(workers, (nSlots + minSlotsPerWorker - 1) / minSlotsPerWorker));
+	const uint32_t slotsPerWorker = (nSlots + workers - 1) / workers;
+
+	std::atomic<uint32_t> lowestFailure(UINT32_MAX);
+	vector<uint32_t> failedSlot(workers, UINT32_MAX);
+	vector<OSStatus> failedStatus(workers, errSecSuccess);
+
+	// (blocks capture C++ objects by copy, so hand them plain pointers)
+	std::atomic<uint32_t> *lowest = &lowestFailure;
+	uint32_t *slots = failedSlot.data();
+	OSStatus *statuses = failedStatus.data();
+	const pair<CodeDirectory::HashAlgorithm, const CodeDirectory *> *checkList = checks.data();
+	size_t checkCount = checks.size();
+
+	dispatch_apply(workers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+		uint32_t start = uint32_t(worker) * slotsPerWorker;
+		uint32_t end = min(nSlots, start + slotsPerWorker);
+		if (start >= end)
+			return;
+		FileDesc file = fd;		// (captured copy is const)
+		std::unique_ptr<CodeDirectory::MultipleHasher> hashers;
+		try {
+			hashers.reset(new CodeDirectory::MultipleHasher(types));
+		} catch (...) {
+			slots[worker] = start;
+			statuses[worker] = errSecAllocate;
+			return;
+		}
+		unsigned char *buffer = (unsigned char *)valloc(pageSize);
+		if (!buffer) {
+			slots[worker] = start;
+			statuses[worker] = errSecAllocate;
+			return;
+		}
+		for (uint32_t slot = start; slot < end; ++slot) {
+			if (slot > lowest->load(std::memory_order_relaxed))
+				break;		// somebody already failed earlier in the file; our result can't matter
+			OSStatus status = errSecSuccess;
+			try {
+				size_t offset = size_t(slot) * pageSize;
+				size_t thisPage = (offset < limit) ? min(pageSize, limit - offset) : 0;
+				size_t got = 0;
+				while (got < thisPage) {
+					size_t n = file.read(buffer + got, thisPage - got, size_t(base + offset + got));
+					if (n == 0)
+						break;		// end of file; hash what we have (and fail below)
+					got += n;
+				}
+				__block bool good = true;
+				hashers->hashData(buffer, got, ^(CodeDirectory::HashAlgorithm type, DynamicHash *hasher) {
+					for (size_t n = 0; n < checkCount; n++)
+						if (checkList[n].first == type && !hasher->verify(checkList[n].second->getSlot(slot, preEncrypted)))
+							good = false;
+				});
+				if (!good)
+					status = errSecCSSignatureFailed;
+			} catch (const CommonError &err) {
+				status = err.osStatus();
+			} catch (...) {
+				status = errSecCSInternalError;
+			}
+			if (status != errSecSuccess) {
+				slots[worker] = slot;
+				statuses[worker] = status;
+				uint32_t current = lowest->load(std::memory_order_relaxed);
+				while (slot < current && !lowest->compare_exchange_weak(current, slot))
+					;
+				break;
+			}
+		}
+		free(buffer);
+	});
+
+	// report the earliest failure, if any
+	unsigned first = workers;
+	for (unsigned worker = 0; worker < workers; worker++)
+		if (failedSlot[worker] != UINT32_MAX && (first == workers || failedSlot[worker] < failedSlot[first]))
+			first = worker;
+	if (first != workers) {
+		CODESIGN_EVAL_STATIC_EXECUTABLE_FAIL(this, (int)failedSlot[first]);
+		MacOSError::throwMe(failedStatus[first]);
+	}
+}
+
+
 //
 // Perform static validation of sealed resources and nested code.
 //
@@ -1249,13 +1402,21 @@ void SecStaticCode::validateResources(SecCSFlags flags)
 			}
 
 			Dispatch::Group group;
-			Dispatch::Group &groupRef = group;  // (into block)
+			ResourceWorkQueue work(*mLimitedAsync, group);
+			ResourceWorkQueue &workRef = work;  // (into block)
 
 			// scan through the resources on disk, checking each against the resourceDirectory
 			__block CFRef<CFMutableDictionaryRef> resourceMap = makeCFMutableDictionary(files);
 			string base = cfString(this->resourceBase());
 			ResourceBuilder resources(base, base, rules, strict, mTolerateErrors);
 			this->mResourceScope = &resources;
+
+			// workers use resources (and resourceMap), so if the scan throws, let them drain before those go away
+			struct GroupDrain {
+				Dispatch::Group &group;
+				~GroupDrain() { dispatch_group_wait(group, DISPATCH_TIME_FOREVER); }
+			} drain = { group };
+
 			diskRep()->adjustResources(resources);
 
 			resources.scan(^(FTSENT *ent, uint32_t ruleFlags, const string relpath, ResourceBuilder::Rule *rule) {
@@ -1267,9 +1428,19 @@ void SecStaticCode::validateResources(SecCSFlags flags)
 					reportProgress();
 				};
 
-				mLimitedAsync->perform(groupRef, validate);
+				// biggest files first; nested code is the most expensive of all, so start it right away
+				off_t cost = 0;
+				if (ent->fts_info == FTS_D)
+					cost = INT64_MAX;
+				else if (!isSymlink && ent->fts_statp)
+					cost = ent->fts_statp->st_size;
+				workRef.submit(cost, validate);
 			});
-			group.wait();	// wait until all async resources have been validated as well
+			work.finish();	// drain what's left and wait until all async resources have been validated as well
+#if TARGET_OS_OSX
+			if (mResourceSealCache)
+				mResourceSealCache->flush();
+#endif
 
 			unsigned leftovers = unsigned(CFDictionaryGetCount(resourceMap));
 			if (leftovers > 0) {
@@ -1602,6 +1773,11 @@ void SecStaticCode::validateResource(CFDictionaryRef files, string path, bool is
 				return ctx.reportProblem(errSecCSBadResource, kSecCFErrorResourceAltered, fullpath); // changed type
 			AutoFileDesc fd(cfString(fullpath), O_RDONLY, FileDesc::modeMissingOk);	// open optional file
 			if (fd) {
+#if TARGET_OS_OSX
+				ResourceSealIdentity ident;		// as of before we hash it
+				if (cachedResourceSeal(fd, rseal, ident))
+					return;		// same file we've validated before
+#endif
 				__block bool good = true;
 				CodeDirectory::multipleHashFileData(fd, 0, hashAlgorithms(), ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
 					if (!hasher->verify(rseal.hash(type)))
@@ -1613,6 +1789,10 @@ void SecStaticCode::validateResource(CFDictionaryRef files, string path, bool is
 					} else {
 						ctx.reportProblem(errSecCSBadResource, kSecCFErrorResourceAltered, fullpath); // altered
 					}
+				} else {
+#if TARGET_OS_OSX
+					recordResourceSeal(fd, rseal, ident);
+#endif
 				}
 			} else {
 				if (!seal.optional())
@@ -1654,6 +1834,57 @@ void SecStaticCode::validatePlainMemoryResource(string path, CFDataRef fileData,
 	MacOSError::throwMe(errSecCSBadResource);
 }
 	
+
+#if TARGET_OS_OSX
+//
+// Consult the resource seal cache (if enabled) about an open resource file.
+// Returns true only if every digest we would check is on record for this exact file.
+// Either way, ident is set to the file's identity (if it can be cached at all) for
+// a later recordResourceSeal.
+//
+bool SecStaticCode::cachedResourceSeal(FileDesc fd, const ResourceSeal &seal, ResourceSealIdentity &ident)
+{
+	if (!mResourceSealCache || !mResourceSealCache->identify(fd, ident))
+		return false;
+	if (mResourceSealCacheStrict)
+		return false;
+	CodeDirectory::HashAlgorithms types = hashAlgorithms();
+	for (auto it = types.begin(); it != types.end(); ++it) {
+		if (!CodeDirectory::viableHash(*it))
+			continue;
+		const Hashing::Byte *digest = seal.hash(*it);
+		RefPointer<DynamicHash> hasher = CodeDirectory::hashFor(*it);
+		if (!digest || !mResourceSealCache->verify(ident, *it, digest, hasher->digestLength()))
+			return false;
+	}
+	return true;
+}
+
+//
+// Note in the resource seal cache (if enabled) that an open resource file has validated.
+// hashed is the identity taken (by cachedResourceSeal) before we hashed the file; we only
+// record if the file still looks exactly the same, so a change made while we were hashing
+// never gets vouched for.
+//
+void SecStaticCode::recordResourceSeal(FileDesc fd, const ResourceSeal &seal, const ResourceSealIdentity &hashed)
+{
+	if (!mResourceSealCache || hashed.ino == 0)	// not identified before hashing
+		return;
+	ResourceSealIdentity ident;
+	if (!mResourceSealCache->identify(fd, ident) || ident != hashed)
+		return;
+	CodeDirectory::HashAlgorithms types = hashAlgorithms();
+	for (auto it = types.begin(); it != types.end(); ++it) {
+		if (!CodeDirectory::viableHash(*it))
+			continue;
+		if (const Hashing::Byte *digest = seal.hash(*it)) {
+			RefPointer<DynamicHash> hasher = CodeDirectory::hashFor(*it);
+			mResourceSealCache->record(ident, *it, digest, hasher->digestLength());
+		}
+	}
+}
+#endif // TARGET_OS_OSX
+
 void SecStaticCode::validateSymlinkResource(std::string fullpath, std::string seal, ValidationContext &ctx, SecCSFlags flags)
 {
 	static const char* const allowedDestinations[] = {
@@ -2190,6 +2421,7 @@ void SecStaticCode::staticValidate(SecCSFlags flags, const SecRequirement *req)
 					return;	// irrelevant to Gatekeeper
 			}
 			subcode->detachedSignature(this->mDetachedSig);	// carry over explicit (but not implicit) detached signature
+			subcode->mExecutableThreads = this->mExecutableThreads;
 			subcode->staticValidateCore(flags, req);
 		});
 	reportProgress();
@@ -42,6 +42,8 @@ namespace CodeSigning {
 
 
 class SecCode;
+class ResourceSealCache;
+struct ResourceSealIdentity;
 
 
 //
@@ -148,6 +150,10 @@ public:
 	CFURLRef resourceBase();
 	void validateResource(CFDictionaryRef files, std::string path, bool isSymlink, ValidationContext &ctx, SecCSFlags flags, uint32_t version);
 	void validateSymlinkResource(std::string fullpath, std::string seal, ValidationContext &ctx, SecCSFlags flags);
+#if TARGET_OS_OSX
+	bool cachedResourceSeal(UnixPlusPlus::FileDesc fd, const ResourceSeal &seal, ResourceSealIdentity &ident);
+	void recordResourceSeal(UnixPlusPlus::FileDesc fd, const ResourceSeal &seal, const ResourceSealIdentity &hashed);
+#endif
 
 	bool flag(uint32_t tested);
 
@@ -178,6 +184,8 @@ public:
 	unsigned estimateResourceWorkload();
 	void validateResources(SecCSFlags flags);
 	void validateExecutable();
+	void validateExecutablePages(UnixPlusPlus::FileDesc fd, off_t base, unsigned workers);
+	unsigned executableWorkers() const;
 	void validateNestedCode(CFURLRef path, const ResourceSeal &seal, SecCSFlags flags, bool isFramework);
 	
 	void validatePlainMemoryResource(string path, CFDataRef fileData, SecCSFlags flags);
@@ -238,9 +246,14 @@ private:
 	mutable CFRef<CFDataRef> mBaseDir;	// the primary CodeDirectory blob (whether it's chosen or not)
 	CFRef<CFDataRef> mDetachedSig;		// currently applied explicit detached signature
 	
-	// private validation modifiers (only used by Gatekeeper checkfixes)
+	// private validation modifiers (Gatekeeper checkfixes and performance tuning)
 	MacOSErrorSet mTolerateErrors;		// soft error conditions to ignore
 	CFRef<CFArrayRef> mAllowOmissions;	// additionally allowed resource omissions
+	int mExecutableThreads;				// parallel executable scan workers (0 => serial, <0 => one per CPU)
+#if TARGET_OS_OSX
+	RefPointer<ResourceSealCache> mResourceSealCache; // digests of resources already validated (opt-in)
+#endif
+	bool mResourceSealCacheStrict;		// rehash everything regardless of mResourceSealCache (but refresh it)
 	
 	// master validation state
 	bool mValidated;					// core validation was attempted
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+#include "authoritycache.h"
+#include "Requirements.h"
+#include "reqreader.h"
+#include "StaticCode.h"
+#include "codedirectory.h"
+#include <security_utilities/debugging.h>
+#include <Security/SecRequirementPriv.h>
+#include <algorithm>
+
+namespace Security {
+namespace CodeSigning {
+
+
+//
+// Walk a requirement program along its top-level "and" chain and note the
+// conditions every match must satisfy. Anything below an "or" or "not" is
+// skipped over without interpretation.
+//
+class RuleScanner : public Requirement::Reader {
+public:
+	RuleScanner(const Requirement *req) : Requirement::Reader(req) { }
+
+	void scan(AuthorityCache::Rule &rule) { conjunct(rule, stackLimit); }
+
+private:
+	static const int stackLimit = 1000;		// same as the interpreter's
+
+	void conjunct(AuthorityCache::Rule &rule, int depth);
+	void skipExpr(int depth);
+	void skipOperands(uint32_t op, int depth);
+	void skipMatch();
+};
+
+void RuleScanner::conjunct(AuthorityCache::Rule &rule, int depth)
+{
+	if (--depth <= 0)
+		MacOSError::throwMe(errSecCSReqInvalid);
+
+	uint32_t op = get<uint32_t>();
+	switch (op & ~opFlagMask) {
+	case opAnd:
+		conjunct(rule, depth);
+		conjunct(rule, depth);
+		break;
+	case opIdent:
+		rule.identifier = getString();
+		break;
+	case opCDHash:
+		{
+			const void *hash; size_t length;
+			getData(hash, length);
+			rule.cdhash.assign((const char *)hash, length);
+		}
+		break;
+	case opAppleGenericAnchor:
+	case opAnchorHash:
+	case opCertField:
+	case opCertGeneric:
+	case opCertPolicy:
+	case opTrustedCert:
+		rule.needsCertificates = true;
+		skipOperands(op, depth);
+		break;
+	default:
+		skipOperands(op, depth);
+		break;
+	}
+}
+
+void RuleScanner::skipExpr(int depth)
+{
+	if (--depth <= 0)
+		MacOSError::throwMe(errSecCSReqInvalid);
+	skipOperands(get<uint32_t>(), depth);
+}
+
+void RuleScanner::skipOperands(uint32_t op, int depth)
+{
+	switch (op & ~opFlagMask) {
+	case opFalse:
+	case opTrue:
+	case opAppleAnchor:
+	case opAppleGenericAnchor:
+	case opTrustedCerts:
+	case opNotarized:
+		break;
+	case opIdent:
+	case opCDHash:
+	case opNamedAnchor:
+	case opNamedCode:
+		getString();
+		break;
+	case opAnchorHash:
+		get<int32_t>();
+		getString();
+		break;
+	case opInfoKeyValue:
+		getString();
+		getString();
+		break;
+	case opAnd:
+	case opOr:
+		skipExpr(depth);
+		skipExpr(depth);
+		break;
+	case opNot:
+		skipExpr(depth);
+		break;
+	case opInfoKeyField:
+	case opEntitlementField:
+		getString();
+		skipMatch();
+		break;
+	case opCertField:
+	case opCertGeneric:
+	case opCertPolicy:
+		get<int32_t>();
+		getString();
+		skipMatch();
+		break;
+	case opTrustedCert:
+	case opPlatform:
+		get<int32_t>();
+		break;
+	default:
+		if (op & (opGenericFalse | opGenericSkip))
+			skip(get<uint32_t>());
+		else
+			MacOSError::throwMe(errSecCSUnimplemented);
+		break;
+	}
+}
+
+void RuleScanner::skipMatch()
+{
+	if (get<MatchOperation>() != matchExists)
+		getString();
+}
+
+
+//
+// Compile all scan_authority rules of one type.
+// The query and its ordering are exactly what evaluateCodeItem used to run.
+//
+AuthorityCache::Snapshot::Snapshot(SQLite::Database &db, AuthorityType type, uint64_t gen)
+	: generation(gen)
+{
+	SQLite::Statement query(db,
+		"SELECT allow, requirement, id, label, expires, flags, disabled FROM scan_authority"
+		" WHERE type = :type"
+		" ORDER BY priority DESC;");
+	query.bind(":type").integer(type);
+
+	while (query.nextRow()) {
+		mRules.push_back(Rule());
+		Rule &rule = mRules.back();
+		rule.allow = int(query[0]);
+		const char *reqString = query[1];
+		rule.reqString = reqString ? reqString : "";
+		rule.id = query[2];
+		const char *label = query[3];
+		rule.hasLabel = label != NULL;
+		rule.label = label ? label : "";
+		rule.expires = query[4];
+		rule.flags = query[5];
+		SQLite::int64 disabled = query[6];
+		rule.disabled = disabled != 0;
+		rule.needsCertificates = false;
+		rule.compileError = SecRequirementCreateWithString(CFTempString(rule.reqString),
+			kSecCSDefaultFlags, &rule.requirement.aref());
+
+		size_t index = mRules.size() - 1;
+		if (rule.compileError == errSecSuccess) {
+			try {
+				RuleScanner(SecRequirement::required(rule.requirement)->requirement()).scan(rule);
+			} catch (...) {
+				// can't tell what it wants; always evaluate it
+				rule.cdhash.clear();
+				rule.identifier.clear();
+				rule.needsCertificates = false;
+			}
+		}
+		if (!rule.cdhash.empty())
+			mByCDHash[rule.cdhash].push_back(index);
+		else if (!rule.identifier.empty())
+			mByIdentifier[rule.identifier].push_back(index);
+		else
+			mGeneric.push_back(index);
+	}
+	secdebug("gk", "compiled %zu type %d rules (%zu unbucketed) at generation %llu",
+		mRules.size(), int(type), mGeneric.size(), (unsigned long long)generation);
+}
+
+
+//
+// Collect, in priority order, the rules that may match this code.
+// If we can't get at the code's signature we don't filter at all.
+//
+void AuthorityCache::Snapshot::candidates(SecStaticCodeRef code, std::vector<const Rule *> &rules) const
+{
+	std::vector<size_t> indices;
+	bool adhoc = false;
+	try {
+		SecStaticCode *sc = SecStaticCode::requiredStatic(code);
+		const CodeDirectory *cd = sc->codeDirectory();
+		adhoc = cd->flags & kSecCodeSignatureAdhoc;
+
+		CFDataRef cdhash = sc->cdHash();
+		std::map<std::string, std::vector<size_t> >::const_iterator it;
+		if (cdhash) {
+			it = mByCDHash.find(std::string((const char *)CFDataGetBytePtr(cdhash), CFDataGetLength(cdhash)));
+			if (it != mByCDHash.end())
+				indices.insert(indices.end(), it->second.begin(), it->second.end());
+		}
+		it = mByIdentifier.find(cd->identifier());
+		if (it != mByIdentifier.end())
+			indices.insert(indices.end(), it->second.begin(), it->second.end());
+		indices.insert(indices.end(), mGeneric.begin(), mGeneric.end());
+		std::sort(indices.begin(), indices.end());
+	} catch (...) {
+		indices.clear();
+		adhoc = false;
+		for (size_t n = 0; n < mRules.size(); n++)
+			indices.push_back(n);
+	}
+
+	double now = CFAbsoluteTimeGetCurrent() / 86400.0 + julianBase;
+	rules.clear();
+	for (std::vector<size_t>::const_iterator it = indices.begin(); it != indices.end(); ++it) {
+		const Rule &rule = mRules[*it];
+		if (adhoc && rule.needsCertificates)
+			continue;
+		if (!(now < rule.expires))		// expired since we compiled it
+			continue;
+		rules.push_back(&rule);
+	}
+}
+
+
+//
+// The cache proper.
+// We notice our own writes to the authority table through the update hook,
+// and anyone else's through PRAGMA data_version. Both only ever count up,
+// so their sum serves as the generation.
+//
+AuthorityCache::AuthorityCache(SQLite::Database &db)
+	: mDb(db), mLocalChanges(0)
+{
+	sqlite3_update_hook(mDb.sql(), authorityChanged, this);
+}
+
+AuthorityCache::~AuthorityCache()
+{
+	sqlite3_update_hook(mDb.sql(), NULL, NULL);
+}
+
+void AuthorityCache::authorityChanged(void *context, int op, const char *database, const char *table, sqlite3_int64 row)
+{
+	if (!strcmp(table, "authority"))
+		static_cast<AuthorityCache *>(context)->mLocalChanges++;
+}
+
+uint64_t AuthorityCache::generation()
+{
+	return mDb.value<SQLite::int64>("PRAGMA data_version;", 0) + mLocalChanges;
+}
+
+RefPointer<AuthorityCache::Snapshot> AuthorityCache::snapshot(AuthorityType type)
+{
+	StLock<Mutex> _(mLock);
+	uint64_t gen = generation();
+	RefPointer<Snapshot> &snap = mSnapshots[type];
+	if (!snap || snap->generation != gen)
+		snap = new Snapshot(mDb, type, gen);
+	return snap;
+}
+
+
+} // end namespace CodeSigning
+} // end namespace Security
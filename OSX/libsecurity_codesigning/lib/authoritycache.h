@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+#ifndef _H_AUTHORITYCACHE
+#define _H_AUTHORITYCACHE
+
+#include "policydb.h"
+#include <security_utilities/refcount.h>
+#include <security_utilities/threading.h>
+#include <security_utilities/cfutilities.h>
+#include <security_utilities/sqlite++.h>
+#include <Security/CodeSigning.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Security {
+namespace CodeSigning {
+
+
+//
+// A compiled image of the scan_authority rules of one type, in priority order.
+// Each rule's requirement is parsed once, and rules are bucketed by what their
+// requirement demands of the code (a cdhash, an identifier, a certificate chain)
+// so that an assessment only runs the rules that can possibly match.
+//
+class AuthorityCache {
+public:
+	struct Rule {
+		SQLite::int64 id;
+		bool allow;
+		std::string label;
+		bool hasLabel;
+		double expires;
+		sqlite3_int64 flags;
+		bool disabled;
+		std::string reqString;
+		CFRef<SecRequirementRef> requirement;
+		OSStatus compileError;			// reported when the rule is reached, as before
+
+		// discriminators pulled from the requirement's top-level "and" chain
+		std::string cdhash;				// requires exactly this cdhash
+		std::string identifier;			// requires exactly this identifier
+		bool needsCertificates;			// can't match ad-hoc signed code
+	};
+
+	class Snapshot : public RefCount {
+	public:
+		Snapshot(SQLite::Database &db, AuthorityType type, uint64_t generation);
+
+		void candidates(SecStaticCodeRef code, std::vector<const Rule *> &rules) const;
+		size_t size() const { return mRules.size(); }
+
+		const uint64_t generation;
+
+	private:
+		std::vector<Rule> mRules;
+		std::map<std::string, std::vector<size_t> > mByCDHash;
+		std::map<std::string, std::vector<size_t> > mByIdentifier;
+		std::vector<size_t> mGeneric;
+	};
+
+public:
+	AuthorityCache(SQLite::Database &db);
+	~AuthorityCache();
+
+	RefPointer<Snapshot> snapshot(AuthorityType type);
+
+private:
+	uint64_t generation();
+	static void authorityChanged(void *context, int op, const char *database, const char *table, sqlite3_int64 row);
+
+private:
+	SQLite::Database &mDb;
+	Mutex mLock;
+	std::atomic<uint64_t> mLocalChanges;	// authority writes through our own connection
+	std::map<AuthorityType, RefPointer<Snapshot> > mSnapshots;
+};
+
+
+} // end namespace CodeSigning
+} // end namespace Security
+
+#endif //_H_AUTHORITYCACHE
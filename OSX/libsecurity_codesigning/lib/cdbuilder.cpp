@@ -27,6 +27,8 @@
 #include "cdbuilder.h"
 #include <security_utilities/memutils.h>
 #include <cmath>
+#include <algorithm>
+#include <dispatch/dispatch.h>
 
 using namespace UnixPlusPlus;
 using LowLevelMemoryUtilities::alignUp;
@@ -36,6 +38,10 @@ namespace Security {
 namespace CodeSigning {
 
 
+// don't split the code slots into parallel runs shorter than this
+static const size_t minSlotsPerWorker = 16;
+
+
 //
 // Create an (empty) builder
 //
@@ -52,6 +58,7 @@ CodeDirectory::Builder::Builder(HashAlgorithm digestAlgorithm)
 	  mExecSegFlags(0),
 	  mGeneratePreEncryptHashes(false),
 	  mRuntimeVersion(0),
+	  mHashWorkers(1),
 	  mDir(NULL)
 {
 	mDigestLength = (uint32_t)MakeHash<Builder>(this)->digestLength();
@@ -187,6 +194,56 @@ size_t CodeDirectory::Builder::size(const uint32_t version)
 // alignment. Make sure to keep the code here in sync with the size-calculating code above.
 //
 CodeDirectory *CodeDirectory::Builder::build()
+{
+	layout();
+	std::vector<Builder *> self(1, this);
+	hashCodeSlots(self);
+	return complete();
+}
+
+
+//
+// Build the CodeDirectories of several Builders describing the same code
+// (one per digest algorithm) with a single read of the code pages, hashing
+// each page with all the algorithms at once. Builders that don't agree on
+// the code range are built one at a time, as build() would.
+//
+std::vector<CodeDirectory *> CodeDirectory::Builder::build(const std::vector<Builder *> &builders)
+{
+	std::vector<CodeDirectory *> result;
+	bool shared = builders.size() > 1;
+	for (auto it = builders.begin(); shared && it != builders.end(); ++it)
+		shared = (*it)->mExecOffset == builders.front()->mExecOffset
+			&& (*it)->mExecLength == builders.front()->mExecLength
+			&& (*it)->mPageSize == builders.front()->mPageSize;
+	try {
+		if (shared) {
+			for (auto it = builders.begin(); it != builders.end(); ++it)
+				(*it)->layout();
+			hashCodeSlots(builders);
+			for (auto it = builders.begin(); it != builders.end(); ++it)
+				result.push_back((*it)->complete());
+		} else {
+			for (auto it = builders.begin(); it != builders.end(); ++it)
+				result.push_back((*it)->build());
+		}
+	} catch (...) {
+		for (auto it = result.begin(); it != result.end(); ++it)
+			::free(*it);
+		if (shared)
+			for (auto it = builders.begin(); it != builders.end(); ++it)
+				if ((*it)->mDir && std::find(result.begin(), result.end(), (*it)->mDir) == result.end())
+					::free((*it)->mDir);
+		throw;
+	}
+	return result;
+}
+
+
+//
+// Allocate the CodeDirectory and fill in everything but the code slots.
+//
+void CodeDirectory::Builder::layout()
 {
 	assert(mExec);			// must have (successfully) called executable()
 	uint32_t version;
@@ -283,24 +340,131 @@ CodeDirectory *CodeDirectory::Builder::build()
 	memset(mDir->getSlotMutable((int)-mSpecialSlots, false), 0, mDigestLength * mSpecialSlots);
 	for (size_t slot = 1; slot <= mSpecialSlots; ++slot)
 		memcpy(mDir->getSlotMutable((int)-slot, false), specialSlot((SpecialSlot)slot), mDigestLength);
-	
-	// fill code slots
-	mExec.seek(mExecOffset);
-	size_t remaining = mExecLength;
-	for (unsigned int slot = 0; slot < mCodeSlots; ++slot) {
+}
+
+
+//
+// Hash the code pages into the code slots of all the (laid out) builders given.
+// They all describe the same code range, so we read each page once (from the
+// first builder's file) and hash it with every builder's algorithm.
+//
+void CodeDirectory::Builder::hashCodeSlots(const std::vector<Builder *> &builders)
+{
+	Builder *lead = builders.front();
+	if (lead->mHashWorkers > 1 && lead->mPageSize && lead->mCodeSlots >= 2 * minSlotsPerWorker) {
+		hashCodeSlotsParallel(builders, lead->mHashWorkers);
+		return;
+	}
+
+	HashAlgorithms types;
+	std::map<HashAlgorithm, Builder *> byType;
+	for (auto it = builders.begin(); it != builders.end(); ++it) {
+		types.insert((*it)->mHashType);
+		byType[(*it)->mHashType] = *it;
+	}
+	const std::map<HashAlgorithm, Builder *> *targets = &byType;	// (blocks capture C++ objects by copy)
+
+	MultipleHasher hashers(types);
+	lead->mExec.seek(lead->mExecOffset);
+	size_t remaining = lead->mExecLength;
+	for (unsigned int slot = 0; slot < lead->mCodeSlots; ++slot) {
 		size_t thisPage = remaining;
-		if (mPageSize)
-			thisPage = min(thisPage, mPageSize);
-		MakeHash<Builder> hasher(this);
-		generateHash(hasher, mExec, mDir->getSlotMutable(slot, false), thisPage);
-		if (mGeneratePreEncryptHashes && mPreservedPreEncryptHashMap.empty()) {
-			memcpy(mDir->getSlotMutable(slot, true), mDir->getSlot(slot, false),
-				   mDir->hashSize);
-		}
+		if (lead->mPageSize)
+			thisPage = min(thisPage, lead->mPageSize);
+		hashers.hashFileData(lead->mExec, thisPage, ^(HashAlgorithm type, DynamicHash *hasher) {
+			Builder *builder = targets->find(type)->second;
+			hasher->finish(builder->mDir->getSlotMutable(slot, false));
+			if (builder->mGeneratePreEncryptHashes && builder->mPreservedPreEncryptHashMap.empty()) {
+				memcpy(builder->mDir->getSlotMutable(slot, true), builder->mDir->getSlot(slot, false),
+					   builder->mDir->hashSize);
+			}
+		});
 		remaining -= thisPage;
 	}
 	assert(remaining == 0);
+}
+
 
+//
+// Parallel form of hashCodeSlots.
+// The code slot range is cut into contiguous runs, one per worker. Each worker reads
+// its pages with positional reads (so the workers never share a file offset) into
+// its own buffer, hashes them with its own hashers, and stores the digests straight
+// into its own slots. The result is the same as the serial scan's.
+//
+void CodeDirectory::Builder::hashCodeSlotsParallel(const std::vector<Builder *> &builders, unsigned workers)
+{
+	Builder *lead = builders.front();
+	const size_t pageSize = lead->mPageSize;
+	const size_t base = lead->mExecOffset;
+	const size_t length = lead->mExecLength;
+	const size_t nSlots = lead->mCodeSlots;
+	HashAlgorithms types;
+	std::map<HashAlgorithm, Builder *> byType;
+	for (auto it = builders.begin(); it != builders.end(); ++it) {
+		types.insert((*it)->mHashType);
+		byType[(*it)->mHashType] = *it;
+	}
+
+	workers = (unsigned)min(size_t(workers), nSlots / minSlotsPerWorker);
+	const size_t slotsPerWorker = (nSlots + workers - 1) / workers;
+	std::vector<OSStatus> failures(workers, errSecSuccess);
+
+	// (blocks capture C++ objects by copy, so hand them plain pointers)
+	const std::map<HashAlgorithm, Builder *> *targets = &byType;
+	const HashAlgorithms *typeSet = &types;
+	OSStatus *statuses = failures.data();
+	FileDesc fd = lead->mExec;
+
+	dispatch_apply(workers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+		size_t start = worker * slotsPerWorker;
+		size_t end = min(nSlots, start + slotsPerWorker);
+		if (start >= end)
+			return;
+		FileDesc file = fd;		// (captured copy is const)
+		unsigned char *buffer = NULL;
+		try {
+			MultipleHasher hashers(*typeSet);
+			if (!(buffer = (unsigned char *)valloc(pageSize)))
+				UnixError::throwMe(ENOMEM);
+			for (size_t slot = start; slot < end; ++slot) {
+				size_t offset = slot * pageSize;
+				size_t thisPage = min(pageSize, length - offset);
+				size_t got = 0;
+				while (got < thisPage) {
+					size_t n = file.read(buffer + got, thisPage - got, base + offset + got);
+					if (n == 0)
+						break;		// end of file; hash what we have, as the serial scan does
+					got += n;
+				}
+				hashers.hashData(buffer, got, ^(HashAlgorithm type, DynamicHash *hasher) {
+					Builder *builder = targets->find(type)->second;
+					hasher->finish(builder->mDir->getSlotMutable((int)slot, false));
+					if (builder->mGeneratePreEncryptHashes && builder->mPreservedPreEncryptHashMap.empty()) {
+						memcpy(builder->mDir->getSlotMutable((int)slot, true), builder->mDir->getSlot((int)slot, false),
+							   builder->mDir->hashSize);
+					}
+				});
+			}
+		} catch (const CommonError &err) {
+			statuses[worker] = err.osStatus();
+		} catch (...) {
+			statuses[worker] = errSecCSInternalError;
+		}
+		::free(buffer);
+	});
+
+	for (unsigned worker = 0; worker < workers; worker++)
+		if (failures[worker] != errSecSuccess)
+			MacOSError::throwMe(failures[worker]);
+}
+
+
+//
+// Fill in what goes after the code slots, and pass the CodeDirectory to the caller.
+//
+CodeDirectory *CodeDirectory::Builder::complete()
+{
 	PreEncryptHashMap::iterator preEncrypt =
 		mPreservedPreEncryptHashMap.find(mHashType);
 	if (preEncrypt != mPreservedPreEncryptHashMap.end()) {
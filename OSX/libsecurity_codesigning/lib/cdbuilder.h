@@ -76,8 +76,11 @@ public:
 		mRuntimeVersion = runtime;
 	}
 
+	void hashWorkers(unsigned workers) { mHashWorkers = max(1u, workers); }
+
 	size_t size(const uint32_t version);		// calculate size
 	CodeDirectory *build();						// build CodeDirectory and return it
+	static std::vector<CodeDirectory *> build(const std::vector<Builder *> &builders); // build several, hashing the code once
     size_t fixedSize(const uint32_t version);	// calculate fixed size of the CodeDirectory
 	
 	uint32_t hashType() const { return mHashType; }
@@ -89,6 +92,11 @@ private:
 		{ assert(slot > 0 && slot <= cdSlotMax); return mSpecial + (slot - 1) * mDigestLength; }
 	Hashing::Byte *specialSlot(SpecialSlot slot) const
 		{ assert(slot > 0 && slot <= cdSlotMax); return mSpecial + (slot - 1) * mDigestLength; }
+
+	void layout();								// allocate mDir and fill all but the code slots
+	static void hashCodeSlots(const std::vector<Builder *> &builders);
+	static void hashCodeSlotsParallel(const std::vector<Builder *> &builders, unsigned workers);
+	CodeDirectory *complete();					// finish mDir and return it
 	
 private:
 	Hashing::Byte *mSpecial;					// array of special slot hashes
@@ -119,6 +127,8 @@ private:
 
 	uint32_t mRuntimeVersion;					// Hardened Runtime Version
 
+	unsigned mHashWorkers;						// parallel workers for code slot hashing (1 => serial)
+
 	CodeDirectory *mDir;						// what we're building
 };
 
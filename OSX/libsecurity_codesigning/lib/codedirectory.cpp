@@ -300,24 +300,82 @@ CodeDirectory::HashAlgorithm CodeDirectory::bestHashOf(const HashAlgorithms &typ
 // digests to a per-algorithm block.
 //
 void CodeDirectory::multipleHashFileData(FileDesc fd, size_t limit, CodeDirectory::HashAlgorithms types, void (^action)(HashAlgorithm type, DynamicHash* hasher))
+{
+	MultipleHasher hasher(types);
+	hasher.hashFileData(fd, limit, action);
+}
+
+
+//
+// MultipleHasher
+//
+const size_t CodeDirectory::MultipleHasher::stripeSize;
+
+CodeDirectory::MultipleHasher::MultipleHasher(const HashAlgorithms &types)
+	: mBuffer(NULL), mBufferSize(0)
 {
 	assert(!types.empty());
-	map<HashAlgorithm, RefPointer<DynamicHash> > hashes;
-	for (auto it = types.begin(); it != types.end(); ++it) {
+	for (auto it = types.begin(); it != types.end(); ++it)
 		if (CodeDirectory::viableHash(*it))
-			hashes[*it] = CodeDirectory::hashFor(*it);
+			mHashers.push_back(make_pair(*it, RefPointer<DynamicHash>(CodeDirectory::hashFor(*it))));
+}
+
+CodeDirectory::MultipleHasher::~MultipleHasher()
+{
+	::free(mBuffer);
+}
+
+size_t CodeDirectory::MultipleHasher::hashFileData(FileDesc fd, size_t limit, void (^action)(HashAlgorithm type, DynamicHash *hasher))
+{
+	if (!mBuffer) {
+		mBufferSize = scanBufferSize(fd);
+		if (!(mBuffer = (unsigned char *)valloc(mBufferSize)))
+			UnixError::throwMe(ENOMEM);
 	}
-	scanFileData(fd, limit, ^(const void *buffer, size_t size) {
-		for (auto it = hashes.begin(); it != hashes.end(); ++it) {
-            it->second->update(buffer, size);
-		}
-	});
-	CFRef<CFMutableDictionaryRef> result = makeCFMutableDictionary();
-	for (auto it = hashes.begin(); it != hashes.end(); ++it) {
-		action(it->first, it->second);
+	size_t total;
+	try {
+		total = scanFileData(fd, limit, mBuffer, mBufferSize, ^(const void *buffer, size_t size) {
+			this->update(buffer, size);
+		});
+	} catch (...) {
+		// leave the hashers ready for the next caller
+		for (auto it = mHashers.begin(); it != mHashers.end(); ++it)
+			it->second->reset();
+		throw;
 	}
+	finish(action);
+	return total;
 }
-    
+
+void CodeDirectory::MultipleHasher::hashData(const void *data, size_t length, void (^action)(HashAlgorithm type, DynamicHash *hasher))
+{
+	update(data, length);
+	finish(action);
+}
+
+void CodeDirectory::MultipleHasher::update(const void *data, size_t length)
+{
+	if (mHashers.size() == 1) {
+		mHashers.front().second->update(data, length);
+		return;
+	}
+	const unsigned char *p = (const unsigned char *)data;
+	while (length > 0) {
+		size_t stripe = min(length, stripeSize);
+		for (auto it = mHashers.begin(); it != mHashers.end(); ++it)
+			it->second->update(p, stripe);
+		p += stripe;
+		length -= stripe;
+	}
+}
+
+void CodeDirectory::MultipleHasher::finish(void (^action)(HashAlgorithm type, DynamicHash *hasher))
+{
+	for (auto it = mHashers.begin(); it != mHashers.end(); ++it) {
+		action(it->first, it->second);
+		it->second->reset();
+	}
+}    
     
     //
     // Hash data in memory using our hashAlgorithm()
@@ -48,6 +48,7 @@
 #include <security_utilities/hashing.h>
 #include <Security/CSCommonPriv.h>
 #include <set>
+#include <vector>
 
 
 namespace Security {
@@ -292,6 +293,7 @@ public:
 	bool slotIsPresent(Slot slot) const;
 	
 	class Builder;
+	class MultipleHasher;
 
 public:
 	static DynamicHash *hashFor(HashAlgorithm hashType);		// create a DynamicHash subclass for (hashType) digests
@@ -328,6 +330,40 @@ public:
 };
 
 
+//
+// A set of hashers, one per digest algorithm, that computes all of its digests
+// in a single pass over the data. Each read buffer is fed to the hashers one
+// cache-sized stripe at a time, so the second and later algorithms find their
+// input still in cache. The hashers and the read buffer are kept from one call
+// to the next; use one of these across all the pages of a file rather than
+// making a new one per page.
+//
+class CodeDirectory::MultipleHasher {
+	NOCOPY(MultipleHasher)
+public:
+	MultipleHasher(const HashAlgorithms &types);
+	~MultipleHasher();
+
+	// hash (limit bytes of) fd from its current position, then call action for each digest type
+	size_t hashFileData(UnixPlusPlus::FileDesc fd, size_t limit, void (^action)(HashAlgorithm type, DynamicHash *hasher));
+	// the same for data already in memory
+	void hashData(const void *data, size_t length, void (^action)(HashAlgorithm type, DynamicHash *hasher));
+
+	size_t count() const { return mHashers.size(); }
+
+	static const size_t stripeSize = 16 * 1024;	// bytes fed to each hasher in turn
+
+private:
+	void update(const void *data, size_t length);
+	void finish(void (^action)(HashAlgorithm type, DynamicHash *hasher));
+
+private:
+	std::vector<std::pair<HashAlgorithm, RefPointer<DynamicHash> > > mHashers;
+	unsigned char *mBuffer;						// read buffer (allocated on first use)
+	size_t mBufferSize;
+};
+
+
 }	// CodeSigning
 }	// Security
 
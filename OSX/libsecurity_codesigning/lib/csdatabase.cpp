@@ -176,5 +176,160 @@ void SignatureDatabaseWriter::insertCode(int64 globid, int arch, const EmbeddedS
 
 
 
+//
+// The resource seal cache.
+//
+const char ResourceSealCache::defaultPath[] = "/var/db/CodeSigningResourceCache";
+
+static const char sealCacheSchema[] = "\
+	create table if not exists seals ( \n\
+		fsid integer not null, \n\
+		dev integer not null, \n\
+		ino integer not null, \n\
+		algorithm integer not null, \n\
+		size integer not null, \n\
+		mtime integer not null, \n\
+		ctime integer not null, \n\
+		digest blob not null, \n\
+		primary key (fsid, dev, ino, algorithm) on conflict replace \n\
+	); \n\
+";
+
+static SQLite::int64 volumeId(const fsid_t &fsid)
+{
+	return (SQLite::int64(uint32_t(fsid.val[0])) << 32) | uint32_t(fsid.val[1]);
+}
+
+ResourceSealIdentity::ResourceSealIdentity(const struct stat &st, const struct statfs &fs)
+	: fsid(volumeId(fs.f_fsid)), dev(st.st_dev), ino(st.st_ino), size(st.st_size),
+	  mtime(st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec),
+	  ctime(st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec)
+{
+}
+
+ResourceSealCache::ResourceSealCache(const char *path)
+	: SQLite::Database(path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, true),	// lenient open
+	  mReady(false), mLookup(NULL)
+{
+	if (this->isOpen())
+		try {
+			this->execute(sealCacheSchema);
+			mReady = true;
+		} catch (...) {
+			secinfo("sealcache", "%s: cannot initialize resource seal cache", path);
+		}
+
+	// the system volume and (where there is one) its data volume
+	static const char * const bootVolumes[] = { "/", "/System/Volumes/Data", NULL };
+	for (const char * const *vol = bootVolumes; *vol; vol++) {
+		struct statfs fs;
+		if (::statfs(*vol, &fs) == 0 && (fs.f_flags & MNT_LOCAL))
+			mTrustedVolumes.push_back(fs.f_fsid);
+	}
+}
+
+bool ResourceSealCache::identify(UnixPlusPlus::FileDesc fd, Identity &ident)
+{
+	if (!mReady)
+		return false;
+	struct stat st;
+	struct statfs fs;
+	if (::fstat(fd, &st) || ::fstatfs(fd, &fs) || !S_ISREG(st.st_mode) || !(fs.f_flags & MNT_LOCAL))
+		return false;
+	for (auto it = mTrustedVolumes.begin(); it != mTrustedVolumes.end(); ++it)
+		if (it->val[0] == fs.f_fsid.val[0] && it->val[1] == fs.f_fsid.val[1]) {
+			ident = Identity(st, fs);
+			return true;
+		}
+	return false;
+}
+
+ResourceSealCache::~ResourceSealCache()
+{
+	flush();
+	if (mLookup)
+		::sqlite3_finalize(mLookup);	// before the connection closes
+}
+
+bool ResourceSealCache::verify(const Identity &ident, CodeDirectory::HashAlgorithm type, const Hashing::Byte *digest, size_t length)
+{
+	if (!mReady)
+		return false;
+	// A Statement holds the connection's lock for as long as it lives, so the
+	// reusable lookup is kept as a bare sqlite3 statement instead.
+	StLock<Mutex> _(mDatabaseLock);
+	if (!mLookup && ::sqlite3_prepare_v2(this->sql(),
+			"select digest from seals where fsid = ?1 and dev = ?2 and ino = ?3 and algorithm = ?4 \
+			 and size = ?5 and mtime = ?6 and ctime = ?7;", -1, &mLookup, NULL) != SQLITE_OK) {
+		secinfo("sealcache", "cannot prepare resource seal cache lookup (ignored)");
+		mLookup = NULL;
+		return false;
+	}
+	bool match = false;
+	if (::sqlite3_bind_int64(mLookup, 1, ident.fsid) == SQLITE_OK
+		&& ::sqlite3_bind_int64(mLookup, 2, ident.dev) == SQLITE_OK
+		&& ::sqlite3_bind_int64(mLookup, 3, ident.ino) == SQLITE_OK
+		&& ::sqlite3_bind_int(mLookup, 4, int(type)) == SQLITE_OK
+		&& ::sqlite3_bind_int64(mLookup, 5, ident.size) == SQLITE_OK
+		&& ::sqlite3_bind_int64(mLookup, 6, ident.mtime) == SQLITE_OK
+		&& ::sqlite3_bind_int64(mLookup, 7, ident.ctime) == SQLITE_OK) {
+		switch (::sqlite3_step(mLookup)) {
+		case SQLITE_ROW:
+			match = size_t(::sqlite3_column_bytes(mLookup, 0)) == length
+				&& memcmp(::sqlite3_column_blob(mLookup, 0), digest, length) == 0;
+			break;
+		case SQLITE_DONE:
+			break;
+		default:
+			secinfo("sealcache", "resource seal cache lookup failed (ignored)");
+			break;
+		}
+	}
+	::sqlite3_reset(mLookup);
+	return match;
+}
+
+void ResourceSealCache::record(const Identity &ident, CodeDirectory::HashAlgorithm type, const Hashing::Byte *digest, size_t length)
+{
+	if (!mReady)
+		return;
+	StLock<Mutex> _(mPendingLock);
+	mPending.push_back(Entry(ident, type, digest, length));
+}
+
+void ResourceSealCache::flush()
+{
+	std::vector<Entry> pending;
+	{
+		StLock<Mutex> _(mPendingLock);
+		pending.swap(mPending);
+	}
+	if (pending.empty())
+		return;
+	StLock<Mutex> _(mDatabaseLock);
+	try {
+		Transaction xa(*this, Transaction::immediate);
+		Statement insert(*this,
+			"insert into seals (fsid, dev, ino, algorithm, size, mtime, ctime, digest) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8);");
+		for (auto it = pending.begin(); it != pending.end(); ++it) {
+			insert.bind(1) = it->ident.fsid;
+			insert.bind(2) = it->ident.dev;
+			insert.bind(3) = it->ident.ino;
+			insert.bind(4) = int(it->type);
+			insert.bind(5) = it->ident.size;
+			insert.bind(6) = it->ident.mtime;
+			insert.bind(7) = it->ident.ctime;
+			insert.bind(8).blob(it->digest.data(), it->digest.size());
+			insert.execute();
+			insert.reset();
+		}
+		insert.close();
+		xa.commit();
+	} catch (...) {
+		secinfo("sealcache", "cannot write resource seal cache (ignored)");
+	}
+}
+
+
 } // end namespace CodeSigning
 } // end namespace Security
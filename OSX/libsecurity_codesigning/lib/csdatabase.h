@@ -33,6 +33,11 @@
 #include <security_utilities/globalizer.h>
 #include <security_utilities/sqlite++.h>
 #include <security_utilities/cfutilities.h>
+#include <security_utilities/refcount.h>
+#include <security_utilities/unix++.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <vector>
 
 
 namespace Security {
@@ -68,6 +73,73 @@ private:
 };
 
 
+//
+// What we know about a resource file for the ResourceSealCache.
+//
+struct ResourceSealIdentity {
+	ResourceSealIdentity() : fsid(0), dev(0), ino(0), size(0), mtime(0), ctime(0) { }
+	ResourceSealIdentity(const struct stat &st, const struct statfs &fs);
+	SQLite::int64 fsid, dev, ino, size;
+	SQLite::int64 mtime, ctime;		// nanoseconds since the epoch
+
+	bool operator == (const ResourceSealIdentity &other) const
+	{
+		return fsid == other.fsid && dev == other.dev && ino == other.ino
+			&& size == other.size && mtime == other.mtime && ctime == other.ctime;
+	}
+	bool operator != (const ResourceSealIdentity &other) const { return !(*this == other); }
+};
+
+
+//
+// An opt-in, persistent cache of resource digests that have already passed validation.
+// Entries are keyed by file identity (volume, device, inode) and hash type, and are only
+// honored while the file's size, modification time and inode change time are exactly as
+// recorded. The change time can't be set through the file system API of a local volume,
+// so there any write, rename-over, or chmod of the file invalidates its entry. Whoever
+// controls the storage of a disk image, network or user space file system can make up
+// all of these, so we only cache files on the boot volumes.
+// The cache is shared by parallel resource validation and nested code, so all of its
+// methods may be called concurrently. Cache failures are never fatal; at worst we rehash.
+//
+class ResourceSealCache : public SQLite::Database, public RefCount {
+public:
+	ResourceSealCache(const char *path = defaultPath);
+	virtual ~ResourceSealCache();
+
+	typedef ResourceSealIdentity Identity;
+
+	// identity of an open file; false if its volume isn't one we trust to report it
+	bool identify(UnixPlusPlus::FileDesc fd, Identity &ident);
+
+	// true if (ident, type) was recorded with exactly this digest
+	bool verify(const Identity &ident, CodeDirectory::HashAlgorithm type, const Hashing::Byte *digest, size_t length);
+
+	// queue a validated digest for recording; flush() writes everything queued so far
+	void record(const Identity &ident, CodeDirectory::HashAlgorithm type, const Hashing::Byte *digest, size_t length);
+	void flush();
+
+public:
+	static const char defaultPath[];
+
+private:
+	struct Entry {
+		Entry(const Identity &id, CodeDirectory::HashAlgorithm t, const Hashing::Byte *d, size_t l)
+			: ident(id), type(t), digest((const char *)d, l) { }
+		Identity ident;
+		CodeDirectory::HashAlgorithm type;
+		std::string digest;
+	};
+
+	bool mReady;					// open, with schema in place
+	std::vector<fsid_t> mTrustedVolumes; // the boot volumes
+	Mutex mDatabaseLock;			// serializes use of our (one) connection
+	sqlite3_stmt *mLookup;			// verify()'s query, prepared once (under mDatabaseLock)
+	Mutex mPendingLock;				// protects mPending
+	std::vector<Entry> mPending;	// recorded but not yet written
+};
+
+
 } // end namespace CodeSigning
 } // end namespace Security
 
@@ -33,6 +33,7 @@
 #include <security_utilities/debugging.h>
 #include <security_utilities/errors.h>
 #include <sys/utsname.h>
+#include <Block.h>
 
 namespace Security {
 namespace CodeSigning {
@@ -230,11 +231,13 @@ LimitedAsync::LimitedAsync(bool async)
 		async_workers = ncpu - 1; // one less because this thread also validates
 
 	mResourceSemaphore = new Dispatch::Semaphore(async_workers);
+	mAsync = async_workers > 0;
 }
 
 LimitedAsync::LimitedAsync(LimitedAsync &limitedAsync)
 {
 	mResourceSemaphore = new Dispatch::Semaphore(*limitedAsync.mResourceSemaphore);
+	mAsync = limitedAsync.mAsync;
 }
 
 LimitedAsync::~LimitedAsync()
@@ -243,6 +246,13 @@ LimitedAsync::~LimitedAsync()
 }
 
 bool LimitedAsync::perform(Dispatch::Group &groupRef, void (^block)()) {
+	if (performAsync(groupRef, block))
+		return true;
+	block();
+	return false;
+}
+
+bool LimitedAsync::performAsync(Dispatch::Group &groupRef, void (^block)()) {
 	__block Dispatch::SemaphoreWait wait(*mResourceSemaphore, DISPATCH_TIME_NOW);
 
 	if (wait.acquired()) {
@@ -255,10 +265,80 @@ bool LimitedAsync::perform(Dispatch::Group &groupRef, void (^block)()) {
 		});
 		return true;
 	} else {
-		block();
 		return false;
 	}
 }
 
+
+ResourceWorkQueue::ResourceWorkQueue(LimitedAsync &limitedAsync, Dispatch::Group &groupRef, size_t backlog)
+	: mLimitedAsync(limitedAsync), mGroup(groupRef), mBacklog(backlog), mSequence(0)
+{
+}
+
+ResourceWorkQueue::~ResourceWorkQueue()
+{
+	// if we're unwinding from an exception, workers may still be referencing us
+	dispatch_group_wait(mGroup, DISPATCH_TIME_FOREVER);
+	while (!mPending.empty()) {
+		Block_release(mPending.top().block);
+		mPending.pop();
+	}
+}
+
+void ResourceWorkQueue::submit(off_t cost, void (^block)())
+{
+	if (!mLimitedAsync.async()) {
+		block();	// no workers to hand this to; keep the traditional in-order behavior
+		return;
+	}
+
+	size_t pending;
+	{
+		StLock<Mutex> _(mLock);
+		Item item = { cost, mSequence++, Block_copy(block) };
+		mPending.push(item);
+		pending = mPending.size();
+	}
+	startWorker();
+	if (pending > mBacklog)
+		runNext();	// the workers are falling behind; help out rather than queue without bound
+}
+
+void ResourceWorkQueue::finish()
+{
+	while (runNext())
+		;
+	mGroup.wait();
+}
+
+bool ResourceWorkQueue::runNext()
+{
+	void (^block)() = NULL;
+	{
+		StLock<Mutex> _(mLock);
+		if (mPending.empty())
+			return false;
+		block = mPending.top().block;
+		mPending.pop();
+	}
+	try {
+		block();
+	} catch (...) {
+		Block_release(block);
+		throw;
+	}
+	Block_release(block);
+	return true;
+}
+
+void ResourceWorkQueue::startWorker()
+{
+	// if no worker slot is free right now, the item stays queued for a running worker (or finish) to pick up
+	mLimitedAsync.performAsync(mGroup, ^{
+		while (runNext())
+			;
+	});
+}
+
 } // end namespace CodeSigning
 } // end namespace Security
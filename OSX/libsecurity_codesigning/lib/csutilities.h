@@ -34,12 +34,14 @@
 #include <security_utilities/dispatch.h>
 #include <security_utilities/hashing.h>
 #include <security_utilities/unix++.h>
+#include <security_utilities/threading.h>
 #if TARGET_OS_OSX
 #include <security_cdsa_utilities/cssmdata.h>
 #endif
 #include <copyfile.h>
 #include <asl.h>
 #include <cstdarg>
+#include <queue>
 
 namespace Security {
 namespace CodeSigning {
@@ -60,31 +62,50 @@ void hashOfCertificate(SecCertificateRef cert, SHA1::Digest digest);
 bool verifyHash(SecCertificateRef cert, const Hashing::Byte *digest);
 
 	
-inline size_t scanFileData(UnixPlusPlus::FileDesc fd, size_t limit, void (^handle)(const void *buffer, size_t size))
+//
+// Read (a section of) a file through a caller-supplied buffer, passing each
+// piece to a block. Starts at the current file position.
+//
+inline size_t scanFileData(UnixPlusPlus::FileDesc fd, size_t limit, unsigned char *buffer, size_t bufSize,
+	void (^handle)(const void *buffer, size_t size))
+{
+	size_t total = 0;
+	for (;;) {
+		size_t size = bufSize;
+		if (limit && limit < size)
+			size = limit;
+		size_t got = fd.read(buffer, size);
+		total += got;
+		if (fd.atEnd())
+			break;
+		handle(buffer, got);
+		if (limit && (limit -= got) == 0)
+			break;
+	}
+	return total;
+}
+
+//
+// Pick a read buffer size suitable for this file.
+//
+inline size_t scanBufferSize(UnixPlusPlus::FileDesc fd)
 {
 	UnixPlusPlus::FileDesc::UnixStat st;
+	fd.fstat(st);
+	return MAX(64 * 1024, st.st_blksize);
+}
+
+inline size_t scanFileData(UnixPlusPlus::FileDesc fd, size_t limit, void (^handle)(const void *buffer, size_t size))
+{
 	size_t total = 0;
 	unsigned char *buffer = NULL;
 
 	try {
-		fd.fstat(st);
-		size_t bufSize = MAX(64 * 1024, st.st_blksize);
+		size_t bufSize = scanBufferSize(fd);
 		buffer = (unsigned char *)valloc(bufSize);
 		if (!buffer)
 			return 0;
-
-		for (;;) {
-			size_t size = bufSize;
-			if (limit && limit < size)
-				size = limit;
-			size_t got = fd.read(buffer, size);
-			total += got;
-			if (fd.atEnd())
-				break;
-			handle(buffer, got);
-			if (limit && (limit -= got) == 0)
-				break;
-		}
+		total = scanFileData(fd, limit, buffer, bufSize, handle);
 	}
 	catch(...) {
 		/* don't leak this on error */
@@ -219,9 +240,61 @@ public:
 	virtual ~LimitedAsync();
 
 	bool perform(Dispatch::Group &groupRef, void (^block)());
+	bool performAsync(Dispatch::Group &groupRef, void (^block)());	// never runs inline; false if no worker free
+
+	bool async() const { return mAsync; }
 
 private:
 	Dispatch::Semaphore *mResourceSemaphore;
+	bool mAsync;
+};
+
+
+// A bounded, size-ordered work pool layered on top of LimitedAsync,
+// used for validating the sealed resources of a bundle.
+
+// A producer (the resource directory scan) submits work with a cost estimate,
+// and the most expensive pending item is always started first. Unlike
+// LimitedAsync::perform, submitting never runs the work on the scanning
+// thread just because all workers are busy; it stays queued, and whichever
+// worker frees up first takes it. Once the scan is done, finish() has the
+// producer steal and run whatever is still queued, then waits for the
+// workers (rethrowing anything they threw) through the caller's Group.
+
+// Worker slots come from the LimitedAsync, so nested validations still share
+// one budget, and every queue is drained by its own producer, so we always
+// make progress no matter how deep the nesting goes. If the LimitedAsync is
+// synchronous, work runs inline in submission order, as it always has.
+
+class ResourceWorkQueue {
+	NOCOPY(ResourceWorkQueue)
+public:
+	ResourceWorkQueue(LimitedAsync &limitedAsync, Dispatch::Group &groupRef, size_t backlog = 1024);
+	virtual ~ResourceWorkQueue();
+
+	void submit(off_t cost, void (^block)());
+	void finish();
+
+private:
+	struct Item {
+		off_t cost;				// larger goes first
+		uint64_t sequence;		// then first come, first served
+		void (^block)();
+
+		bool operator < (const Item &other) const
+		{ return cost < other.cost || (cost == other.cost && sequence > other.sequence); }
+	};
+
+	bool runNext();				// run the most expensive pending item; false if there is none
+	void startWorker();
+
+	LimitedAsync &mLimitedAsync;
+	Dispatch::Group &mGroup;
+	size_t mBacklog;			// pending items beyond which the producer pitches in
+
+	Mutex mLock;				// protects the following
+	std::priority_queue<Item> mPending;
+	uint64_t mSequence;
 };
 
 
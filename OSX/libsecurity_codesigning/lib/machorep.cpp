@@ -51,14 +51,14 @@ MachORep::MachORep(const char *path, const Context *ctx)
 {
 	if (ctx)
 		if (ctx->offset)
-			mExecutable = new Universal(fd(), (size_t)ctx->offset, ctx->size);
+			mExecutable = openExecutable((size_t)ctx->offset, ctx->size);
 		else if (ctx->arch) {
-			auto_ptr<Universal> full(new Universal(fd()));
-			mExecutable = new Universal(fd(), full->archOffset(ctx->arch), full->archLength(ctx->arch));
+			auto_ptr<Universal> full(openExecutable());
+			mExecutable = openExecutable(full->archOffset(ctx->arch), full->archLength(ctx->arch));
 		} else
-			mExecutable = new Universal(fd());
+			mExecutable = openExecutable();
 	else
-		mExecutable = new Universal(fd());
+		mExecutable = openExecutable();
 
 	assert(mExecutable);
 	CODESIGN_DISKREP_CREATE_MACHO(this, (char*)path, (void*)ctx);
@@ -71,6 +71,28 @@ MachORep::~MachORep()
 }
 
 
+//
+// Make a Universal for (part of) the main executable.
+// We parse headers and load commands in place in a read-only mapping of the file,
+// shared by all of them. If the file can't be mapped (or might change while mapped),
+// we quietly fall back to reading the pieces we need.
+//
+Universal *MachORep::openExecutable(size_t offset /* = 0 */, size_t length /* = 0 */)
+{
+	if (!mMapping) {
+		try {
+			mMapping = new MachOMapping(fd());
+		} catch (...) {
+			secinfo("machorep", "cannot map %s; reading it instead", mainExecutablePath().c_str());
+		}
+	}
+	if (mMapping)
+		return new Universal(fd(), mMapping, offset, length);
+	else
+		return new Universal(fd(), offset, length);
+}
+
+
 //
 // Sniffer function for "plausible Mach-O binary"
 //
@@ -282,7 +304,9 @@ CFDataRef MachORep::embeddedComponent(CodeDirectory::SpecialSlot slot)
 			if (const linkedit_data_command *cs = macho->findCodeSignature()) {
 				size_t offset = macho->flip(cs->dataoff);
 				size_t length = macho->flip(cs->datasize);
-				if ((mSigningData = EmbeddedSignatureBlob::readBlob(macho->fd(), macho->offset() + offset, length))) {
+				// always copy: the signature must not change between validation and use
+				mSigningData = EmbeddedSignatureBlob::readBlob(macho->fd(), macho->offset() + offset, length);
+				if (mSigningData) {
 					secinfo("machorep", "%zd signing bytes in %d blob(s) from %s(%s)",
 						mSigningData->length(), mSigningData->count(),
 						mainExecutablePath().c_str(), macho->architecture().name());
@@ -362,8 +386,9 @@ void MachORep::flush()
 	mExecutable = NULL;
 	::free(mSigningData);
 	mSigningData = NULL;
+	mMapping = NULL;
 	SingleDiskRep::flush();
-	mExecutable = new Universal(fd(), offset, length);
+	mExecutable = openExecutable(offset, length);
 }
 
 CFDictionaryRef MachORep::diskRepInformation()
@@ -86,9 +86,11 @@ protected:
 
 private:
 	static bool needsExecSeg(const MachO& macho);
+	Universal *openExecutable(size_t offset = 0, size_t length = 0);
 
+	RefPointer<MachOMapping> mMapping; // read-only mapping of mainExecutablePath() (NULL if unmappable)
 	Universal *mExecutable;	// cached Mach-O/Universal reference to mainExecutablePath()
-	EmbeddedSignatureBlob *mSigningData; // cached signing data from current architecture
+	EmbeddedSignatureBlob *mSigningData; // cached signing data from current architecture (malloc'ed)
 };
 
 
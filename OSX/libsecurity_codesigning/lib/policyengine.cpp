@@ -72,7 +72,7 @@ static CFTypeRef installerPolicy() CF_RETURNS_RETAINED;
 // Core structure
 //
 PolicyEngine::PolicyEngine()
-	: PolicyDatabase(NULL, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
+	: PolicyDatabase(NULL, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE), mAuthorityCache(*this)
 {
 	try {
 		mOpaqueWhitelist = new OpaqueWhitelist();
@@ -163,31 +163,38 @@ static std::string createWhitelistScreen(SecStaticCodeRef code)
 void PolicyEngine::evaluateCodeItem(SecStaticCodeRef code, CFURLRef path, AuthorityType type, SecAssessmentFlags flags, bool nested, CFMutableDictionaryRef result)
 {
 	
-	SQLite::Statement query(*this,
-		"SELECT allow, requirement, id, label, expires, flags, disabled, filter_unsigned, remarks FROM scan_authority"
-		" WHERE type = :type"
-		" ORDER BY priority DESC;");
-	query.bind(":type").integer(type);
+	// only the rules whose cdhash, identifier and anchoring this code can satisfy, in priority order
+	RefPointer<AuthorityCache::Snapshot> authority = mAuthorityCache.snapshot(type);
+	std::vector<const AuthorityCache::Rule *> rules;
+	authority->candidates(code, rules);
 	
 	SQLite3::int64 latentID = 0;		// first (highest priority) disabled matching ID
 	std::string latentLabel;			// ... and associated label, if any
 
     secdebug("gk", "evaluateCodeItem type=%d flags=0x%x nested=%d path=%s", type, int(flags), nested, cfString(path).c_str());
-	while (query.nextRow()) {
-		bool allow = int(query[0]);
-		const char *reqString = query[1];
-		SQLite3::int64 id = query[2];
-		const char *label = query[3];
-		double expires = query[4];
-		sqlite3_int64 ruleFlags = query[5];
-		SQLite3::int64 disabled = query[6];
-//		const char *filter = query[7];
-//		const char *remarks = query[8];
-
-		secdebug("gk", "considering rule %d(%s) requirement %s", int(id), label ? label : "UNLABELED", reqString);
-		CFRef<SecRequirementRef> requirement;
-		MacOSError::check(SecRequirementCreateWithString(CFTempString(reqString), kSecCSDefaultFlags, &requirement.aref()));
-		switch (OSStatus rc = SecStaticCodeCheckValidity(code, kSecCSBasicValidateOnly | kSecCSCheckGatekeeperArchitectures, requirement)) {
+	if (rules.size() < authority->size()) {
+		// we skipped rules; make sure the code itself fails the same way the first of them would have
+		switch (OSStatus rc = SecStaticCodeCheckValidity(code, kSecCSBasicValidateOnly | kSecCSCheckGatekeeperArchitectures, NULL)) {
+		case errSecSuccess:
+			break;
+		case errSecCSVetoed:
+			return;						// nested code has failed to pass
+		default:
+			MacOSError::throwMe(rc);	// general error; pass to caller
+		}
+	}
+	for (std::vector<const AuthorityCache::Rule *>::const_iterator it = rules.begin(); it != rules.end(); ++it) {
+		const AuthorityCache::Rule &rule = **it;
+		bool allow = rule.allow;
+		SQLite3::int64 id = rule.id;
+		const char *label = rule.hasLabel ? rule.label.c_str() : NULL;
+		double expires = rule.expires;
+		sqlite3_int64 ruleFlags = rule.flags;
+		bool disabled = rule.disabled;
+
+		secdebug("gk", "considering rule %d(%s) requirement %s", int(id), label ? label : "UNLABELED", rule.reqString.c_str());
+		MacOSError::check(rule.compileError);
+		switch (OSStatus rc = SecStaticCodeCheckValidity(code, kSecCSBasicValidateOnly | kSecCSCheckGatekeeperArchitectures, rule.requirement)) {
 		case errSecSuccess:
 			break;						// rule match; process below
 		case errSecCSReqFailed:
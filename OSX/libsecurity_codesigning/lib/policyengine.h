@@ -27,6 +27,7 @@
 #include "opaquewhitelist.h"
 #include "evaluationmanager.h"
 #include "policydb.h"
+#include "authoritycache.h"
 #include <security_utilities/globalizer.h>
 #include <security_utilities/cfutilities.h>
 #include <security_utilities/hashing.h>
@@ -88,6 +89,7 @@ private:
 	void recordOutcome(SecStaticCodeRef code, bool allow, AuthorityType type, double expires, SQLite::int64 authority);
 
 private:
+	AuthorityCache mAuthorityCache;
 	OpaqueWhitelist* mOpaqueWhitelist;
 	CFDictionaryRef opaqueWhitelistValidationConditionsFor(SecStaticCodeRef code);
 	bool opaqueWhiteListContains(SecStaticCodeRef code, SecAssessmentFeedback feedback, OSStatus reason);
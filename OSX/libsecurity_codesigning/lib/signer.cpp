@@ -284,6 +284,15 @@ void SecCodeSigner::Signer::prepare(SecCSFlags flags)
 	}
 	
 	pagesize = state.mPageSize ? cfNumber<size_t>(state.mPageSize) : rep->pageSize(*this);
+
+	if (state.mHashThreads > 0) {
+		hashWorkers = state.mHashThreads;
+	} else if (state.mHashThreads < 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		hashWorkers = (ncpu > 0) ? unsigned(ncpu) : 1;
+	} else {
+		hashWorkers = 1;
+	}
 	
 	// Allow the DiskRep to modify the signing parameters. This sees explicit and inherited values but not defaults.
 	rep->prepareForSigning(*this);
@@ -519,6 +528,61 @@ CFMutableDictionaryRef SecCodeSigner::Signer::signNested(const std::string &path
 }
 
 
+//
+// Finish the CodeDirectories of each architecture into the matching CodeDirectorySet.
+// With more than one hash worker, architectures are built concurrently and share the
+// workers among them, each hashing its own pages in parallel with its share.
+// The CodeDirectories come out the same either way.
+//
+void SecCodeSigner::Signer::buildCodeDirectories(const std::vector<ArchEditor::Arch *> &archs,
+												 std::vector<CodeDirectorySet> &cdSets)
+{
+	const size_t count = archs.size();
+	const size_t concurrent = min(size_t(hashWorkers), count);
+	const unsigned perArch = max(1u, unsigned(hashWorkers / max(size_t(1), concurrent)));
+	for (size_t n = 0; n < count; n++)
+		archs[n]->eachDigest(^(CodeDirectory::Builder &builder) {
+			builder.hashWorkers(perArch);
+		});
+
+	// (blocks capture C++ objects by copy, so hand them plain pointers)
+	ArchEditor::Arch * const *archList = archs.data();
+	CodeDirectorySet *sets = cdSets.data();
+	void (^build)(size_t) = ^(size_t n) {
+		__block std::vector<CodeDirectory::Builder *> builders;
+		archList[n]->eachDigest(^(CodeDirectory::Builder &builder) {
+			builders.push_back(&builder);
+		});
+		std::vector<CodeDirectory *> cds = CodeDirectory::Builder::build(builders);
+		for (auto cd = cds.begin(); cd != cds.end(); ++cd)
+			sets[n].add(*cd);
+	};
+
+	if (concurrent <= 1) {
+		for (size_t n = 0; n < count; n++)
+			build(n);
+		return;
+	}
+
+	std::vector<OSStatus> failures(count, errSecSuccess);
+	OSStatus *statuses = failures.data();
+	dispatch_apply(concurrent, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+		for (size_t n = worker; n < count; n += concurrent) {
+			try {
+				build(n);
+			} catch (const CommonError &err) {
+				statuses[n] = err.osStatus();
+			} catch (...) {
+				statuses[n] = errSecCSInternalError;
+			}
+		}
+	});
+	for (size_t n = 0; n < count; n++)
+		if (failures[n] != errSecSuccess)
+			MacOSError::throwMe(failures[n]);
+}
+
+
 //
 // Sign a Mach-O binary, using liberal dollops of that special Mach-O magic sauce.
 // Note that this will deal just fine with non-fat Mach-O binaries, but it will
@@ -596,16 +660,19 @@ void SecCodeSigner::Signer::signMachO(Universal *fat, const Requirement::Context
 	editor->allocate();
 	
 	// pass 2: Finish and generate signatures, and write them
+	// Finish the CodeDirectories of all architectures (off new binary) first. That only
+	// reads the code pages of each architecture, which the writes below don't touch.
+	std::vector<MachOEditor::Arch *> archs;
 	for (MachOEditor::Iterator it = editor->begin(); it != editor->end(); ++it) {
-		MachOEditor::Arch &arch = *it->second;
-		editor->reset(arch);
+		editor->reset(*it->second);
+		archs.push_back(it->second);
+	}
+	std::vector<CodeDirectorySet> cdSets(archs.size());
+	buildCodeDirectories(archs, cdSets);
 
-		// finish CodeDirectories (off new binary) and sign it
-		__block CodeDirectorySet cdSet;
-		arch.eachDigest(^(CodeDirectory::Builder &builder) {
-			CodeDirectory *cd = builder.build();
-			cdSet.add(cd);
-		});
+	for (size_t n = 0; n < archs.size(); n++) {
+		MachOEditor::Arch &arch = *archs[n];
+		CodeDirectorySet &cdSet = cdSets[n];
 
 		CFRef<CFDictionaryRef> hashDict = cdSet.hashDict();
 		CFRef<CFArrayRef> hashList = cdSet.hashList();
@@ -654,6 +721,7 @@ void SecCodeSigner::Signer::signArchitectureAgnostic(const Requirement::Context
 				 unsigned(digestAlgorithms().size()-1),
 				 preEncryptHashMaps[preEncryptMainArch], // Only one map, the default.
 				 (cdFlags & kSecCodeSignatureRuntime) ? state.mRuntimeVersionOverride : 0);
+		builder.hashWorkers(hashWorkers);
 		
 		CodeDirectory *cd = builder.build();
 		if (!state.mDryRun)
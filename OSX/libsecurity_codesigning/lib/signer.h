@@ -90,6 +90,8 @@ protected:
 				  uint32_t runtimeVersion);	// per-architecture
 	CFDataRef signCodeDirectory(const CodeDirectory *cd,
 								CFDictionaryRef hashDict, CFArrayRef hashList);
+	void buildCodeDirectories(const std::vector<ArchEditor::Arch *> &archs,
+							  std::vector<CodeDirectorySet> &cdSets);	// pass 2 of signMachO
 
 	uint32_t cdTextFlags(std::string text);		// convert text CodeDirectory flags
 	std::string uniqueName() const;				// derive unique string from rep
@@ -132,6 +134,7 @@ private:
 	uint32_t cdFlags;				// CodeDirectory flags
 	const Requirements *requirements; // internal requirements ready-to-use
 	size_t pagesize;				// size of main executable pages
+	unsigned hashWorkers;			// parallel workers for hashing code pages (1 => serial)
 	CFAbsoluteTime signingTime;		// signing time for CMS signature (0 => now)
 	bool emitSigningTime;			// emit signing time as a signed CMS attribute
 	bool strict;					// strict validation
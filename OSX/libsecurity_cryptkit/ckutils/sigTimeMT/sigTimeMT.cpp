@@ -0,0 +1,207 @@
+/*
+ * sigTimeMT.cpp - measure aggregate digital signature sign/verify throughput
+ * with 1, 2, 4 and N concurrent threads, to show how the per-thread giant
+ * stacks scale across cores.
+ */
+
+#include "ckconfig.h"
+#include "ckutilsPlatform.h"
+#include "CryptKitSA.h"
+#include "curveParams.h"
+#include "falloc.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LOOPS_DEF		    200	    /* sign+verify pairs per thread */
+#define PRIV_KEY_SIZE_BYTES	    32
+#define DIGEST_SIZE_BYTES	    20	    /* e.g., SHA1 */
+#define MAX_THREADS		    64
+
+static void usage(char **argv)
+{
+	printf("Usage: %s [option...]\n", argv[0]);
+	printf("Options:\n");
+	printf("  l=loops          -- sign/verify pairs per thread, default %d\n",
+		LOOPS_DEF);
+	printf("  D=depth          -- default %d\n", FEE_DEPTH_DEFAULT);
+	printf("  t=maxThreads     -- default is # of CPUs\n");
+	exit(1);
+}
+
+typedef struct {
+	unsigned	loops;
+	unsigned	depth;
+	unsigned	seed;
+	int		errors;
+} ThreadParams;
+
+/* common random callback */
+static feeReturn randCallback(
+    void *ref,
+    unsigned char *bytes,
+    unsigned numBytes)
+{
+    feeRand frand = (feeRand)ref;
+    feeRandBytes(frand, bytes, numBytes);
+    return FR_Success;
+}
+
+/*
+ * One thread's work: its own key and random generator, then loops
+ * sign and verify pairs.
+ */
+static void *sigThread(void *arg)
+{
+	ThreadParams *tp = (ThreadParams *)arg;
+	feeRand rand = feeRandAllocWithSeed(tp->seed);
+	unsigned char privData[PRIV_KEY_SIZE_BYTES];
+	unsigned char digest[DIGEST_SIZE_BYTES];
+	unsigned i;
+	feeReturn frtn;
+
+	feeRandBytes(rand, privData, sizeof(privData));
+	feePubKey key = feePubKeyAlloc();
+	frtn = feePubKeyInitFromPrivDataDepth(key, privData, sizeof(privData),
+		tp->depth, 0);
+	if(frtn) {
+		printf("***Error %d on feePubKeyInitFromPrivDataDepth\n", (int)frtn);
+		tp->errors++;
+		goto done;
+	}
+
+	for(i=0; i<tp->loops; i++) {
+		unsigned char *sigData;
+		unsigned sigLen;
+		feeSig fs;
+
+		feeRandBytes(rand, digest, sizeof(digest));
+		fs = feeSigNewWithKey(key, randCallback, rand);
+		frtn = feeSigSign(fs, digest, sizeof(digest), key);
+		if(frtn == FR_Success) {
+			frtn = feeSigData(fs, &sigData, &sigLen);
+		}
+		feeSigFree(fs);
+		if(frtn) {
+			printf("***Error %d on feeSigSign\n", (int)frtn);
+			tp->errors++;
+			break;
+		}
+
+		frtn = feeSigParse(sigData, sigLen, &fs);
+		if(frtn == FR_Success) {
+			frtn = feeSigVerify(fs, digest, sizeof(digest), key);
+			feeSigFree(fs);
+		}
+		ffree(sigData);
+		if(frtn) {
+			printf("***Error %d on feeSigVerify\n", (int)frtn);
+			tp->errors++;
+			break;
+		}
+	}
+done:
+	feePubKeyFree(key);
+	feeRandFree(rand);
+	return NULL;
+}
+
+/* returns sign/verify pairs per second over all threads */
+static double runThreads(
+	unsigned numThreads,
+	unsigned loops,
+	unsigned depth,
+	unsigned seed,
+	int *errors)
+{
+	pthread_t	threads[MAX_THREADS];
+	ThreadParams	params[MAX_THREADS];
+	PLAT_TIME	startTime;
+	PLAT_TIME	endTime;
+	unsigned	i;
+
+	PLAT_GET_TIME(startTime);
+	for(i=0; i<numThreads; i++) {
+		params[i].loops = loops;
+		params[i].depth = depth;
+		params[i].seed = seed + i;
+		params[i].errors = 0;
+		if(pthread_create(&threads[i], NULL, sigThread, &params[i])) {
+			printf("***pthread_create failed\n");
+			exit(1);
+		}
+	}
+	for(i=0; i<numThreads; i++) {
+		pthread_join(threads[i], NULL);
+		*errors += params[i].errors;
+	}
+	PLAT_GET_TIME(endTime);
+	double elapsed = PLAT_GET_US(startTime, endTime);
+	return (double)(numThreads * loops) * 1000000.0 / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	int 		arg;
+	char 		*argp;
+	unsigned 	loops = LOOPS_DEF;
+	unsigned	depth = FEE_DEPTH_DEFAULT;
+	unsigned	maxThreads = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned 	seed;
+	int		errors = 0;
+
+	for(arg=1; arg<argc; arg++) {
+		argp = argv[arg];
+		switch(argp[0]) {
+		    case 'l':
+		    	loops = atoi(&argp[2]);
+			break;
+		    case 'D':
+		    	depth = atoi(&argp[2]);
+			break;
+		    case 't':
+		    	maxThreads = atoi(&argp[2]);
+			break;
+		    default:
+		    	usage(argv);
+			break;
+		}
+	}
+	if(maxThreads < 1) {
+		maxThreads = 1;
+	}
+	if(maxThreads > MAX_THREADS) {
+		maxThreads = MAX_THREADS;
+	}
+
+	initCryptKit();
+	time((time_t *)&seed);
+
+	printf("depth=%u; %u sign/verify pairs per thread\n", depth, loops);
+	double base = 0.0;
+	for(unsigned numThreads=1; numThreads<=maxThreads; ) {
+		double rate = runThreads(numThreads, loops, depth, seed, &errors);
+		if(numThreads == 1) {
+			base = rate;
+		}
+		printf("   %2u thread%s: %10.1f pairs/s   %5.2fx\n", numThreads,
+			(numThreads == 1) ? " " : "s", rate, rate / base);
+		if(numThreads == maxThreads) {
+			break;
+		}
+		/* 1, 2, 4, ..., then maxThreads */
+		numThreads *= 2;
+		if(numThreads > maxThreads) {
+			numThreads = maxThreads;
+		}
+	}
+
+	terminateCryptKit();
+	if(errors) {
+		printf("***%d errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
@@ -68,6 +68,10 @@
 #include <string.h>
 #include "platform.h"
 #include "giantIntegers.h"
+#if	GIANTS_VIA_STACK
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 #include "feeDebug.h"
 #include "ckconfig.h"
 #include "ellipticMeasure.h"
@@ -183,6 +187,15 @@ static void absg(giant g);  /* g := |g|. */
  * to malloc() for borrowGiant(). On a 90 Mhz Pentium, enabling the
  * giant stack package shows about a 1.35 speedup factor over an identical
  * CryptKit without the giant stacks enabled.
+ *
+ * Each thread gets its own set of stacks, created on that thread's first
+ * borrowGiant() or returnGiant() and freed when the thread exits, so
+ * concurrent operations never share a stack and need no locking. Only
+ * the stack geometry (numGstacks and each stack's giant size) is global;
+ * it is set once by initGiantStacks().
+ *
+ * Giants may have held key material, so they are cleared before they go
+ * into a stack, and each stack holds at most MAX_NUM_GIANTS of them.
  */
 
 #if	GIANTS_VIA_STACK
@@ -200,30 +213,118 @@ typedef struct {
 	giant 		*stack;
 } gstack;
 
-static gstack *gstacks = NULL;		// array of stacks
-static unsigned numGstacks = 0;		// # of elements in gstacks
-static int gstackInitd = 0;		// this module has been init'd
+/* one per thread */
+typedef struct {
+	unsigned	numGstacks;	// # of elements in gstacks
+	gstack		gstacks[1];	// array of stacks, actually numGstacks
+} gstackSet;
+
+static unsigned numGstacks = 0;		// # of stacks per thread
+static _Atomic int gstackInitd = 0;	// this module has been init'd
+static pthread_mutex_t gstackLock = PTHREAD_MUTEX_INITIALIZER;	// for init/free
+static pthread_key_t gstackKey;		// this thread's gstackSet
+static pthread_once_t gstackKeyOnce = PTHREAD_ONCE_INIT;
 
 #define INIT_NUM_GIANTS		16	/* initial # of giants / stack */
+#define MAX_NUM_GIANTS		64	/* max # of giants / stack */
 #define MIN_GIANT_SIZE		4	/* numDigits for gstack[0]  */
 #define GIANT_SIZE_INCR		2	/* in << bits */
 
 /*
- * Initialize giant stacks, with up to specified max giant size.
+ * Free one thread's stacks. Also the pthread key destructor.
  */
-void initGiantStacks(unsigned maxDigits)
+static void freeGstackSet(void *arg)
+{
+	gstackSet *set = (gstackSet *)arg;
+	unsigned i;
+	unsigned j;
+	gstack *gs;
+
+	if(set == NULL) {
+		return;
+	}
+	for(i=0; i<set->numGstacks; i++) {
+		gs = &set->gstacks[i];
+		for(j=0; j<gs->numFree; j++) {
+			freeGiant(gs->stack[j]);
+			gs->stack[j] = NULL;
+		}
+		/* and the stack itself - may be null if this was never used */
+		if(gs->stack != NULL) {
+			ffree(gs->stack);
+			gs->stack = NULL;
+		}
+	}
+	ffree(set);
+}
+
+static void gstackKeyInit(void)
 {
+	pthread_key_create(&gstackKey, freeGstackSet);
+}
+
+/*
+ * Obtain the calling thread's stacks, creating them if necessary.
+ * Returns NULL if the package hasn't been init'd.
+ */
+static gstackSet *threadGstacks(void)
+{
+	gstackSet *set;
 	unsigned curSize = MIN_GIANT_SIZE;
+	unsigned count;
 	unsigned sz;
 	unsigned i;
 
+	if(!atomic_load(&gstackInitd)) {
+		return NULL;
+	}
+	pthread_once(&gstackKeyOnce, gstackKeyInit);
+	set = (gstackSet *)pthread_getspecific(gstackKey);
+	if(set != NULL) {
+		return set;
+	}
+
+	/* first use on this thread; get the geometry */
+	pthread_mutex_lock(&gstackLock);
+	count = atomic_load(&gstackInitd) ? numGstacks : 0;
+	pthread_mutex_unlock(&gstackLock);
+	if(count == 0) {
+		return NULL;
+	}
+	sz = sizeof(gstackSet) + (sizeof(gstack) * (count - 1));
+	set = (gstackSet *)fmalloc(sz);
+	if(set == NULL) {
+		return NULL;
+	}
+	bzero(set, sz);
+	set->numGstacks = count;
+	for(i=0; i<count; i++) {
+		set->gstacks[i].numDigits = curSize;
+		curSize <<= GIANT_SIZE_INCR;
+	}
+	if(pthread_setspecific(gstackKey, set)) {
+		ffree(set);
+		return NULL;
+	}
+	gstackDbg(("new gstackSet for thread %p\n", (void *)pthread_self()));
+	return set;
+}
+
+/*
+ * Initialize giant stacks, with up to specified max giant size.
+ * Safe to call from multiple threads; only the first call has any effect.
+ */
+void initGiantStacks(unsigned maxDigits)
+{
+	unsigned curSize = MIN_GIANT_SIZE;
+	unsigned count;
+
 	dblog0("initGiantStacks\n");
-	
-	if(gstackInitd) {
-		/*
-		 * Shouldn't be called more than once...
-		 */
-		printf("multiple initGiantStacks calls\n");
+
+	pthread_once(&gstackKeyOnce, gstackKeyInit);
+	pthread_mutex_lock(&gstackLock);
+	if(atomic_load(&gstackInitd)) {
+		pthread_mutex_unlock(&gstackLock);
 		return;
 	}
 	gstackDbg(("initGiantStacks(%d)\n", maxDigits));
@@ -231,50 +332,31 @@ void initGiantStacks(unsigned maxDigits)
 	/*
 	 * How many stacks?
 	 */
-	numGstacks = 1;
+	count = 1;
 	while(curSize<=maxDigits) {
 		curSize <<= GIANT_SIZE_INCR;
-		numGstacks++;
+		count++;
 	}
-
-	sz = sizeof(gstack) * numGstacks;
-	gstacks = (gstack*) fmalloc(sz);
-	bzero(gstacks, sz);
-
-	curSize = MIN_GIANT_SIZE;
-	for(i=0; i<numGstacks; i++) {
-		gstacks[i].numDigits = curSize;
-		curSize <<= GIANT_SIZE_INCR;
-	}
-
-	gstackInitd = 1;
+	numGstacks = count;
+	atomic_store(&gstackInitd, 1);
+	pthread_mutex_unlock(&gstackLock);
 }
 
-/* called at shut down - free resources */ 
+/*
+ * called at shut down - free resources. Other threads' stacks are freed
+ * when those threads exit.
+ */
 void freeGiantStacks(void)
 {
-	int i;
-	int j;
-	gstack *gs;
-	
-	if(!gstackInitd) {
+	pthread_mutex_lock(&gstackLock);
+	if(!atomic_load(&gstackInitd)) {
+		pthread_mutex_unlock(&gstackLock);
 		return;
 	}
-	for(i=0; i<numGstacks; i++) {
-		gs = &gstacks[i];
-		for(j=0; j<gs->numFree; j++) {
-			freeGiant(gs->stack[j]);
-			gs->stack[j] = NULL;
-		}
-		/* and the stack itself - may be null if this was never used */
-		if(gs->stack != NULL) {
-			ffree(gs->stack);
-			gs->stack = NULL;
-		}
-	}
-	ffree(gstacks);
-	gstacks = NULL;
-	gstackInitd = 0;
+	freeGstackSet(pthread_getspecific(gstackKey));
+	pthread_setspecific(gstackKey, NULL);
+	atomic_store(&gstackInitd, 0);
+	pthread_mutex_unlock(&gstackLock);
 }
 
 #endif	// GIANTS_VIA_STACK
@@ -286,12 +368,18 @@ giant borrowGiant(unsigned numDigits)
 	#if	GIANTS_VIA_STACK
 
 	unsigned 	stackNum;
-	gstack 		*gs = gstacks;
+	gstackSet	*set = threadGstacks();
+	gstack 		*gs;
+
+	if(set == NULL) {
+		/* not init'd, or out of memory; no caching */
+		return newGiant(numDigits);
+	}
 
 	#if 	WARN_ZERO_GIANT_SIZE
 	if(numDigits == 0) {
 		printf("borrowGiant(0)\n");
-		numDigits = gstacks[numGstacks-1].numDigits;
+		numDigits = set->gstacks[set->numGstacks-1].numDigits;
 	}
 	#endif	// WARN_ZERO_GIANT_SIZE
 
@@ -309,9 +397,9 @@ giant borrowGiant(unsigned numDigits)
 	else if (numDigits <= (MIN_GIANT_SIZE << (4 * GIANT_SIZE_INCR)))
 	        stackNum = 4;
 	else
-		stackNum = numGstacks;
+		stackNum = set->numGstacks;
 
-	if(stackNum >= numGstacks) {
+	if(stackNum >= set->numGstacks) {
 		/*
 		 * out of bounds; just malloc
 		 */
@@ -321,7 +409,7 @@ giant borrowGiant(unsigned numDigits)
 		#endif	// LOG_GIANT_STACK_OVERFLOW
 		return newGiant(numDigits);
 	}
- 	gs = &gstacks[stackNum];
+ 	gs = &set->gstacks[stackNum];
 
 	#if	GIANT_MAC_DEBUG
 	if((gs->numFree != 0) && (gs->stack == NULL)) {
@@ -355,12 +443,13 @@ void returnGiant(giant g)
 	#if	GIANTS_VIA_STACK
 
 	unsigned 	stackNum;
+	gstackSet	*set;
 	gstack 		*gs;
 	unsigned 	cap = g->capacity;
 
 
 	#if	FEE_DEBUG
-	if(!gstackInitd) {
+	if(!atomic_load(&gstackInitd)) {
 		CKRaise("returnGiant before stacks initialized!");
 	}
 	#endif	// FEE_DEBUG
@@ -371,6 +460,16 @@ void returnGiant(giant g)
 	}
 	#endif
 
+	/*
+	 * Giants may be returned on a different thread than the one
+	 * which borrowed them; they just join this thread's stacks.
+	 */
+	set = threadGstacks();
+	if(set == NULL) {
+		freeGiant(g);
+		return;
+	}
+
 	/*
 	 * Find appropriate stack. Note we expect exact match of
 	 * capacity and stack's giant size.
@@ -397,11 +496,11 @@ void returnGiant(giant g)
 	        stackNum = 4;
 		break;
 	    default:
-	        stackNum = numGstacks;
+	        stackNum = set->numGstacks;
 		break;
 	}
 
-	if(stackNum >= numGstacks) {
+	if(stackNum >= set->numGstacks) {
 		/*
 		 * out of bounds; just free
 		 */
@@ -411,21 +510,37 @@ void returnGiant(giant g)
 		freeGiant(g);
 		return;
 	}
-	gs = &gstacks[stackNum];
+	gs = &set->gstacks[stackNum];
     	if(gs->numFree == gs->totalGiants) {
+		unsigned newTotal;
+		giant *newStack;
+		if(gs->totalGiants >= MAX_NUM_GIANTS) {
+			/* this stack is full */
+			freeGiant(g);
+			return;
+		}
 	    	if(gs->totalGiants == 0) {
 			gstackDbg(("Initial alloc of gstack(%d)\n",
 				gs->numDigits));
-	    		gs->totalGiants = INIT_NUM_GIANTS;
+	    		newTotal = INIT_NUM_GIANTS;
 	    	}
 	    	else {
-			gs->totalGiants *= 2;
+			newTotal = gs->totalGiants * 2;
+			if(newTotal > MAX_NUM_GIANTS) {
+				newTotal = MAX_NUM_GIANTS;
+			}
 			gstackDbg(("Bumping gstack(%d) to %d\n",
-				gs->numDigits, gs->totalGiants));
+				gs->numDigits, newTotal));
+		}
+	    	newStack = (giantstruct**) frealloc(gs->stack, newTotal*sizeof(giant));
+		if(newStack == NULL) {
+			freeGiant(g);
+			return;
 		}
-	    	gs->stack = (giantstruct**) frealloc(gs->stack, gs->totalGiants*sizeof(giant));
+		gs->stack = newStack;
+		gs->totalGiants = newTotal;
     	}
-   	g->sign = 0;		// not sure this is important...
+	clearGiant(g);		// may have held key material
     	gs->stack[gs->numFree++] = g;
 
 	#if	GIANT_MAC_DEBUG
@@ -453,12 +568,8 @@ giant newGiant(unsigned numDigits) {
     #if 	WARN_ZERO_GIANT_SIZE
     if(numDigits == 0) {
         printf("newGiant(0)\n");
-		#if	GIANTS_VIA_STACK
-        numDigits = gstacks[numGstacks-1].totalGiants;
-		#else
 		/* HACK */
 		numDigits = 20;
-		#endif
     }
     #endif	// WARN_ZERO_GIANT_SIZE
 
@@ -119,16 +119,30 @@ Table::readIndexSection()
 Cursor *
 Table::createCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersion) const
 {
-	// if an index matches the query, return a cursor which uses the index
+	// if an index can be used for the query, return a cursor which uses the
+	// index that selects the fewest entries
 
 	ConstIndexMap::const_iterator it;
-	DbQueryKey *queryKey;
+	auto_ptr<DbQueryKey> bestKey;
+	const DbConstIndex *bestIndex = NULL;
+	uint32 bestEntries = 0;
 
-	for (it = mIndexMap.begin(); it != mIndexMap.end(); it++)
-		if (it->second->matchesQuery(*inQuery, queryKey)) {
-			IndexCursor *cursor = new IndexCursor(queryKey, inDbVersion, *this, it->second);
-			return cursor;
+	for (it = mIndexMap.begin(); it != mIndexMap.end(); it++) {
+		DbQueryKey *queryKey;
+		uint32 numEntries;
+		if (it->second->planQuery(*inQuery, queryKey, numEntries)) {
+			if (bestIndex == NULL || numEntries < bestEntries) {
+				bestKey.reset(queryKey);
+				bestIndex = it->second;
+				bestEntries = numEntries;
+			}
+			else
+				delete queryKey;
 		}
+	}
+	
+	if (bestIndex != NULL)
+		return new IndexCursor(bestKey.release(), inQuery, inDbVersion, *this, bestIndex);
 
 	// otherwise, return a cursor that iterates over all table records
 
@@ -1291,16 +1305,33 @@ LinearCursor::next(Table::Id &outTableId,
 // IndexCursor
 //
 
-IndexCursor::IndexCursor(DbQueryKey *queryKey, const DbVersion &inDbVersion,
-	const Table &table, const DbConstIndex *index) :
-	Cursor(inDbVersion), mQueryKey(queryKey), mTable(table), mIndex(index)
+IndexCursor::IndexCursor(DbQueryKey *queryKey, const CSSM_QUERY *inQuery,
+	const DbVersion &inDbVersion, const Table &table, const DbConstIndex *index) :
+	Cursor(inDbVersion), mQueryKey(queryKey), mTable(table), mIndex(index),
+	mQueryFlags(inQuery->QueryFlags)
 {
 	index->performQuery(*queryKey, mBegin, mEnd);
+
+	// the predicates the index does not answer are evaluated on each record
+	
+	try
+	{
+		for (uint32 anIndex = 0; anIndex < inQuery->NumSelectionPredicates; anIndex++)
+			if (!queryKey->coversPredicate(anIndex))
+				mPredicates.push_back(new SelectionPredicate(table.getMetaRecord(),
+					inQuery->SelectionPredicate[anIndex]));
+	}
+	catch(...)
+	{
+		for_each_delete(mPredicates.begin(), mPredicates.end());
+		throw;
+	}
 }
 
 IndexCursor::~IndexCursor()
 {
 	// the query key will be deleted automatically, since it's an auto_ptr
+	for_each_delete(mPredicates.begin(), mPredicates.end());
 }
 
 bool
@@ -1309,17 +1340,41 @@ IndexCursor::next(Table::Id &outTableId,
 	CssmData *outData,
 	Allocator &inAllocator, RecordId &recordId)
 {
-	if (mBegin == mEnd)
-		return false;
+	while (mBegin != mEnd)
+	{
+		// a record with a multi-valued attribute has an index entry for each
+		// value, so it can appear more than once in the range
+		
+		DbIndexIterator anIt = mBegin++;
+		if (!mRecordsReturned.insert(mIndex->getRecordNumber(anIt)).second)
+			continue;
+
+		ReadSection rs = mIndex->getRecordSection(anIt);
+		
+		bool aMatch = true;
+		for (PredicateVector::const_iterator aPredicate = mPredicates.begin();
+			aPredicate != mPredicates.end(); aPredicate++)
+		{
+			if (!(*aPredicate)->evaluate(rs))
+			{
+				aMatch = false;
+				break;
+			}
+		}
+		
+		if (!aMatch)
+			continue;
+		
+		const MetaRecord &metaRecord = mTable.getMetaRecord();
 
-	ReadSection rs = mIndex->getRecordSection(mBegin++);
-	const MetaRecord &metaRecord = mTable.getMetaRecord();
+		outTableId = metaRecord.dataRecordType();
+		metaRecord.unpackRecord(rs, inAllocator, outAttributes, outData, mQueryFlags);
 
-	outTableId = metaRecord.dataRecordType();
-	metaRecord.unpackRecord(rs, inAllocator, outAttributes, outData, 0);
+		recordId = MetaRecord::unpackRecordId(rs);
+		return true;
+	}
 
-	recordId = MetaRecord::unpackRecordId(rs);
-	return true;
+	return false;
 }
 
 //
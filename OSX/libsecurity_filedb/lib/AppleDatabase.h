@@ -343,15 +343,16 @@ private:
 };
 
 //
-// A cursor that uses an index.
+// A cursor that uses an index, evaluating any query predicates the index
+// does not answer on the records it selects.
 //
 
 class IndexCursor : public Cursor
 {
 	NOCOPY(IndexCursor)
 public:
-	IndexCursor(DbQueryKey *queryKey, const DbVersion &inDbVersion,
-		const Table &table, const DbConstIndex *index);
+	IndexCursor(DbQueryKey *queryKey, const CSSM_QUERY *inQuery,
+		const DbVersion &inDbVersion, const Table &table, const DbConstIndex *index);
 	virtual ~IndexCursor();
 
     virtual bool next(Table::Id &outTableId,
@@ -364,8 +365,13 @@ private:
 	auto_ptr<DbQueryKey> mQueryKey;
 	const Table &mTable;
 	const DbConstIndex *mIndex;
+	CSSM_QUERY_FLAGS mQueryFlags;
+	
+	typedef vector<SelectionPredicate *> PredicateVector;
+	PredicateVector mPredicates;
 	
 	DbIndexIterator mBegin, mEnd;
+	set<uint32> mRecordsReturned;
 };
 
 //
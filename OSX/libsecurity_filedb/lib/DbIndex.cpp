@@ -30,6 +30,12 @@ DbQueryKey::DbQueryKey(const DbConstIndex &index)
 {
 }
 
+bool
+DbQueryKey::coversPredicate(uint32 predicate) const
+{
+	return find(mPredicates.begin(), mPredicates.end(), predicate) != mPredicates.end();
+}
+
 // Perform a less-than comparison between two keys. An offset of
 // kUseQueryKeyOffset means to use the key provided as part of the
 // query; otherwise, the key comes from the database.
@@ -62,7 +68,7 @@ DbKeyComparator::operator () (uint32 offset1, uint32 offset2) const
 	
 	uint32 valueOffset1 = sizeof(uint32), valueOffset2 = sizeof(uint32);
 	
-	for (uint32 i = 0; i < mKey.mNumKeyValues; i++) {
+	for (uint32 i = 0; i < mNumKeyValues; i++) {
 		const MetaAttribute &metaAttribute = *mKey.mIndex.mAttributes[i];
 		auto_ptr<DbValue> value1(metaAttribute.createValue(*key1, valueOffset1));
 		auto_ptr<DbValue> value2(metaAttribute.createValue(*key2, valueOffset2));
@@ -158,108 +164,127 @@ DbConstIndex::DbConstIndex(const Table &table, const ReadSection &indexSection)
 		reinterpret_cast<const Atom *>(indexSection.range(Range(offset, numRecords * AtomSize))));
 }
 
-// Check to see if this index can be used to perform a given query, based on
-// the attributes used in the query and their order. They must be a prefix
-// of the index key attributes. If there is more than one attribute, all of the
-// operators must be EQUAL and the conjunctive must be AND; this is needed to
-// ensure that the results are a contiguous segment of the index. On success,
-// the appropriate index key is generated from the query.
+// Check to see if this index can be used to perform a given query. The planner
+// walks the index attributes in key order, using an EQUAL predicate on each one
+// for as long as the query has one, and may end the key with a LESS_THAN or
+// GREATER_THAN predicate on the next attribute; the entries selected then form
+// a contiguous segment of the index. If there is more than one predicate, the
+// conjunctive must be AND, and any predicates not used for the key are left
+// for the cursor to evaluate. On success, the appropriate index key is generated
+// from the query and the size of the segment it selects is returned, so that
+// the caller can pick the most selective index. A query that uses one of the
+// index attributes in more than one predicate is invalid.
+//
+// Note that the index and SelectionPredicate disagree about which side of a
+// relational operator the query value is on. A lone relational predicate keeps
+// the meaning the index has always given it; a relational predicate in a
+// compound query only bounds the scan, and the cursor evaluates it as the
+// linear scan would, so using an index never changes the results of a query.
 
 bool
-DbConstIndex::matchesQuery(const CSSM_QUERY &query, DbQueryKey *&queryKey) const
+DbConstIndex::planQuery(const CSSM_QUERY &query, DbQueryKey *&queryKey,
+	uint32 &numEntries) const
 {
 	uint32 numPredicates = query.NumSelectionPredicates;
 
-	if (numPredicates == 0 || numPredicates > mAttributes.size())
+	if (numPredicates == 0)
 		return false;
 	
-	// determine which index attributes are used in the query
+	// determine which attribute each query predicate uses
 	
-	auto_array<uint32> attributeUsed(mAttributes.size());
-	for (uint32 i = 0; i < mAttributes.size(); attributeUsed[i++] = ~(uint32)0);
-	
-	for (uint32 i = 0, j; i < numPredicates; i++) {
-		const MetaAttribute &tableAttribute =
-			mMetaRecord.metaAttribute(query.SelectionPredicate[i].Attribute.Info);
+	auto_array<uint32> predicateAttribute(numPredicates);
+	for (uint32 i = 0; i < numPredicates; i++) {
+		predicateAttribute[i] =
+			mMetaRecord.metaAttribute(query.SelectionPredicate[i].Attribute.Info).attributeId();
 		
-		for (j = 0; j < mAttributes.size(); j++) {
-			if (tableAttribute.attributeId() == mAttributes[j]->attributeId()) {
-				if (attributeUsed[j] != ~(uint32)0)
-					// invalid query: attribute appears twice
+		for (uint32 k = 0; k < i; k++) {
+			if (predicateAttribute[k] != predicateAttribute[i])
+				continue;
+			for (uint32 j = 0; j < mAttributes.size(); j++)
+				if (mAttributes[j]->attributeId() == predicateAttribute[i])
+					// invalid query: index attribute appears twice
 					CssmError::throwMe(CSSMERR_DL_INVALID_QUERY);
-				else {
-					// the jth index component is the ith predicate in the query
-					attributeUsed[j] = i;
-					break;
-				}
-			}
-		}
-		
-		if (j == mAttributes.size()) {
-			// the predicate attribute is not in the index, so return failure
-			return false;
 		}
 	}
 	
-	// check that the query predicates form a prefix of the index key, which means that
-	// the first N index components are the N query predicates in some order
-	
-	long lastIndex;
-	for (lastIndex = mAttributes.size() - 1; (lastIndex >= 0) && (attributeUsed[lastIndex] == ~(uint32)0);
-		lastIndex--);
-		
-	if (lastIndex != numPredicates - 1)
+	if (numPredicates > 1 && query.Conjunctive != CSSM_DB_AND)
 		return false;
-
-	// if there is more than one predicate, the conjunctive must be AND and all the
-	// operators must be EQUAL for the compound index to be useful
 	
-	CSSM_DB_OPERATOR op;
+	// pick the predicates that form the key, in index order
 	
-	if (numPredicates > 1) {
-		if (query.Conjunctive != CSSM_DB_AND)
-			return false;
-			
-		for (uint32 i = 0; i < numPredicates; i++)
-			if (query.SelectionPredicate[i].DbOperator != CSSM_DB_EQUAL)
-				return false;
+	vector<uint32> keyPredicates;
+	CSSM_DB_OPERATOR op = CSSM_DB_EQUAL;
+	
+	for (uint32 j = 0; j < mAttributes.size() && op == CSSM_DB_EQUAL; j++) {
+		uint32 equalPredicate = ~(uint32)0, rangePredicate = ~(uint32)0;
+		
+		for (uint32 i = 0; i < numPredicates; i++) {
+			const CSSM_SELECTION_PREDICATE &predicate = query.SelectionPredicate[i];
+			if (predicateAttribute[i] != mAttributes[j]->attributeId() ||
+				predicate.Attribute.NumberOfValues != 1 || predicate.Attribute.Value == NULL)
+				continue;
 				
-		op = CSSM_DB_EQUAL;
-	}
+			if (predicate.DbOperator == CSSM_DB_EQUAL) {
+				equalPredicate = i;
+				break;
+			}
+			else if ((predicate.DbOperator == CSSM_DB_LESS_THAN ||
+				predicate.DbOperator == CSSM_DB_GREATER_THAN) && rangePredicate == ~(uint32)0)
+				rangePredicate = i;
+		}
 		
-	// for a single predicate, check the operator
-	
-	else {
-		op = query.SelectionPredicate[0].DbOperator;
-		if (op != CSSM_DB_EQUAL && op != CSSM_DB_LESS_THAN && op != CSSM_DB_GREATER_THAN)
-			return false;
+		if (equalPredicate != ~(uint32)0)
+			keyPredicates.push_back(equalPredicate);
+		else if (rangePredicate != ~(uint32)0) {
+			keyPredicates.push_back(rangePredicate);
+			op = query.SelectionPredicate[rangePredicate].DbOperator;
+		}
+		else
+			break;
 	}
+	
+	if (keyPredicates.empty())
+		return false;
 
 	// ok, after all that, we can use this index, so generate an object used as a key
 	// for this query on this index
 	
 	queryKey = new DbQueryKey(*this);
-	queryKey->mNumKeyValues = numPredicates;
+	queryKey->mNumKeyValues = (uint32) keyPredicates.size();
 	queryKey->mOp = op;
+	queryKey->mPredicates = keyPredicates;
+
+	if (op != CSSM_DB_EQUAL && numPredicates > 1) {
+		// scan the side of the key that the linear scan would match, and leave
+		// the predicate itself to the cursor
+		queryKey->mOp = (op == CSSM_DB_LESS_THAN) ? CSSM_DB_GREATER_THAN : CSSM_DB_LESS_THAN;
+		queryKey->mPredicates.pop_back();
+	}
 	
 	uint32 keyLength = sizeof(uint32);
-	for (uint32 i = 0; i < numPredicates; i++)
+	for (uint32 i = 0; i < keyPredicates.size(); i++)
 		mAttributes[i]->packValue(queryKey->mKeyData, keyLength,
-			*(query.SelectionPredicate[attributeUsed[i]].Attribute.Value));
+			*(query.SelectionPredicate[keyPredicates[i]].Attribute.Value));
 	queryKey->mKeyData.put(0, keyLength - sizeof(uint32));
 	queryKey->mKeyData.size(keyLength);
 	
+	DbIndexIterator begin, end;
+	performQuery(*queryKey, begin, end);
+	numEntries = (uint32) (end - begin);
+	
 	return true;
 }
 
 // Perform a query on an index, returning the iterators that bound the
-// returned results.
+// returned results. For LESS_THAN and GREATER_THAN, all but the last key value
+// select the segment of the index to scan, and the last bounds it.
 
 void
 DbConstIndex::performQuery(const DbQueryKey &queryKey,
 	DbIndexIterator &begin, DbIndexIterator &end) const
 {
 	DbKeyComparator cmp(queryKey);
+	DbKeyComparator prefixCmp(queryKey, queryKey.mNumKeyValues - 1);
 	
 	switch (queryKey.mOp) {
 	
@@ -274,15 +299,17 @@ DbConstIndex::performQuery(const DbQueryKey &queryKey,
 		break;
 		
 	case CSSM_DB_LESS_THAN:
-		begin = mKeyOffsetVector.begin();
+		begin = lower_bound(mKeyOffsetVector.begin(), mKeyOffsetVector.end(),
+				DbKeyComparator::kUseQueryKeyOffset, prefixCmp);
 		end = lower_bound(begin, mKeyOffsetVector.end(),
 				DbKeyComparator::kUseQueryKeyOffset, cmp);
 		break;
 		
 	case CSSM_DB_GREATER_THAN:
-		end = mKeyOffsetVector.end();
-		begin = lower_bound(mKeyOffsetVector.begin(), end,
+		begin = lower_bound(mKeyOffsetVector.begin(), mKeyOffsetVector.end(),
 				DbKeyComparator::kUseQueryKeyOffset, cmp);
+		end = upper_bound(begin, mKeyOffsetVector.end(),
+				DbKeyComparator::kUseQueryKeyOffset, prefixCmp);
 		break;
 		
 	default:
@@ -295,8 +322,13 @@ DbConstIndex::performQuery(const DbQueryKey &queryKey,
 ReadSection
 DbConstIndex::getRecordSection(DbIndexIterator iter) const
 {
-	uint32 recordNumber = mRecordNumberVector[iter - mKeyOffsetVector.begin()];
-	return mTable.getRecordSection(recordNumber);
+	return mTable.getRecordSection(getRecordNumber(iter));
+}
+
+uint32
+DbConstIndex::getRecordNumber(DbIndexIterator iter) const
+{
+	return mRecordNumberVector[iter - mKeyOffsetVector.begin()];
 }
 
 // Construct a mutable index from a read-only index.
@@ -47,13 +47,23 @@ class DbQueryKey
 	
 public:
 	DbQueryKey(const DbConstIndex &index);
-	
+
+	// true if the index answers the query predicate with this position
+	// exactly, so a cursor need not evaluate it again
+	bool coversPredicate(uint32 predicate) const;
+
 private:
 	WriteSection mKeyData;
 	uint32 mNumKeyValues;
 	const DbConstIndex &mIndex;
 	const ReadSection &mTableSection;
+	
+	// operator applied to the last key value; the values before it are
+	// always compared for equality
 	CSSM_DB_OPERATOR mOp;
+	
+	// positions of the query predicates the key was generated from
+	vector<uint32> mPredicates;
 };
 
 //
@@ -64,7 +74,11 @@ private:
 class DbKeyComparator
 {
 public:
-	DbKeyComparator(const DbQueryKey &key) : mKey(key) {}
+	DbKeyComparator(const DbQueryKey &key) : mKey(key), mNumKeyValues(key.mNumKeyValues) {}
+	
+	// compare only the first numKeyValues values of each key
+	DbKeyComparator(const DbQueryKey &key, uint32 numKeyValues)
+		: mKey(key), mNumKeyValues(numKeyValues) {}
 
 	bool operator () (uint32 keyOffset1, uint32 keyOffset2) const;
 
@@ -74,6 +88,7 @@ public:
 
 private:
 	const DbQueryKey &mKey;
+	uint32 mNumKeyValues;
 };
 
 //
@@ -140,8 +155,10 @@ public:
 	const Table &table() const { return mTable; }
 
 	// check if this index can be used for a given query, and if so, generate
-	// the appropriate index key from the query
-	bool matchesQuery(const CSSM_QUERY &query, DbQueryKey *&queryKey) const;
+	// the appropriate index key from the query and return the number of
+	// index entries the key selects
+	bool planQuery(const CSSM_QUERY &query, DbQueryKey *&queryKey,
+		uint32 &numEntries) const;
 
 	// perform a query on the index
 	void performQuery(const DbQueryKey &queryKey,
@@ -150,6 +167,9 @@ public:
 	// given an iterator as returned by performQuery(), return the read section for the record
 	ReadSection getRecordSection(DbIndexIterator iter) const;
 
+	// given an iterator as returned by performQuery(), return the record number
+	uint32 getRecordNumber(DbIndexIterator iter) const;
+
 private:
 	// sorted vector of offsets to index key data
 	DbOffsetVector mKeyOffsetVector;
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Searches which the AppleDatabase query planner answers from the generic
+// password table's indexes, checked against the records we know are there.
+//
+
+#include <Security/SecKeychain.h>
+#include <Security/SecKeychainItem.h>
+#include <Security/SecKeychainSearch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keychain_regressions.h"
+#include "kc-helpers.h"
+
+#define kItems 24
+#define kServices 4
+
+// Returns the number of generic passwords matching service (and account, if given), or -1 on error
+static int countMatches(SecKeychainRef kc, const char *service, const char *account)
+{
+    SecKeychainAttribute attrs[] = {
+        { kSecServiceItemAttr, (UInt32) strlen(service), (void *) service },
+        { kSecAccountItemAttr, account ? (UInt32) strlen(account) : 0, (void *) account },
+    };
+    SecKeychainAttributeList attrList = { account ? 2 : 1, attrs };
+    SecKeychainSearchRef search = NULL;
+    if (SecKeychainSearchCreateFromAttributes(kc, kSecGenericPasswordItemClass, &attrList, &search))
+        return -1;
+
+    int count = 0;
+    SecKeychainItemRef item = NULL;
+    OSStatus status;
+    while ((status = SecKeychainSearchCopyNext(search, &item)) == errSecSuccess) {
+        count++;
+        CFRelease(item);
+        item = NULL;
+    }
+    CFRelease(search);
+    return (status == errSecItemNotFound) ? count : -1;
+}
+
+static void tests(void)
+{
+    SecKeychainRef kc = getEmptyTestKeychain();
+
+    OSStatus status = errSecSuccess;
+    for (int i = 0; i < kItems && status == errSecSuccess; i++) {
+        char service[32], account[32];
+        snprintf(service, sizeof(service), "service-%d", i % kServices);
+        snprintf(account, sizeof(account), "account-%d", i);
+        status = SecKeychainAddGenericPassword(kc, (UInt32) strlen(service), service,
+            (UInt32) strlen(account), account, 8, "password", NULL);
+    }
+    ok_status(status, "%s: add %d generic passwords", testName, kItems);
+
+    is(countMatches(kc, "service-1", "account-5"), 1, "%s: service and account select one item", testName);
+    is(countMatches(kc, "service-2", "account-5"), 0, "%s: account under another service selects nothing", testName);
+    is(countMatches(kc, "service-1", NULL), kItems / kServices, "%s: service alone selects its items", testName);
+    is(countMatches(kc, "service-9", NULL), 0, "%s: unknown service selects nothing", testName);
+
+    // naming an indexed attribute twice is an invalid query, not a deduplicated one
+    const char *service = "service-1";
+    SecKeychainAttribute dupAttrs[] = {
+        { kSecServiceItemAttr, (UInt32) strlen(service), (void *) service },
+        { kSecServiceItemAttr, (UInt32) strlen(service), (void *) service },
+    };
+    SecKeychainAttributeList dupList = { 2, dupAttrs };
+    SecKeychainSearchRef search = NULL;
+    ok_status(SecKeychainSearchCreateFromAttributes(kc, kSecGenericPasswordItemClass, &dupList, &search),
+        "%s: create search naming the service twice", testName);
+    SecKeychainItemRef item = NULL;
+    is_status(SecKeychainSearchCopyNext(search, &item), CSSMERR_DL_INVALID_QUERY,
+        "%s: duplicate attribute is rejected", testName);
+    if (item) CFRelease(item);
+    if (search) CFRelease(search);
+
+    ok_status(SecKeychainDelete(kc), "%s: SecKeychainDelete", testName);
+    CFRelease(kc);
+}
+
+int kc_45_find_indexed(int argc, char *const *argv)
+{
+    plan_tests(getEmptyTestKeychainTests + 8);
+    initializeKeychainTests(__FUNCTION__);
+
+    tests();
+
+    deleteTestFiles();
+    return 0;
+}
@@ -44,6 +44,7 @@ ONE_TEST(kc_41_sececkey)
 ONE_TEST(kc_42_trust_revocation)
 ONE_TEST(kc_43_seckey_interop)
 ONE_TEST(kc_44_secrecoverypassword)
+ONE_TEST(kc_45_find_indexed)
 ONE_TEST(si_20_sectrust_provisioning)
 ONE_TEST(si_33_keychain_backup)
 ONE_TEST(si_34_one_true_keychain)
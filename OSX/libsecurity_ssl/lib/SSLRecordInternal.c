@@ -91,10 +91,14 @@ int sslIoWrite(SSLBuffer                       buf,
 
 /* Entry points to Record Layer */
 
-static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
+/*
+ * Read and decrypt one record.  The plaintext goes into dest when that is big
+ * enough for any plaintext the record could hold, and into the record layer's
+ * own plaintextBuffer otherwise; either way rec->contents is only valid until
+ * the next read and SSLRecordFreeInternal has nothing to free.
+ */
+static int SSLRecordReadInternalTo(struct SSLRecordInternalContext *ctx, SSLRecord *rec, SSLBuffer dest)
 {
-    struct SSLRecordInternalContext *ctx = ref;
-
     int     err;
     size_t  len, contentLen;
     SSLBuffer readData;
@@ -178,7 +182,10 @@ static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
 
     if(content_type==tls_record_type_SSL2) {
         /* Just copy the SSL2 record, dont decrypt since this is only for SSL2 Client Hello */
-        return SSLCopyBuffer(&record, &rec->contents);
+        memcpy(ctx->plaintextBuffer.data, record.data, record.length);
+        rec->contents.data = ctx->plaintextBuffer.data;
+        rec->contents.length = record.length;
+        return 0;
     } else {
         size_t sz = tls_record_decrypted_size(ctx->filter, record.length);
 
@@ -194,16 +201,31 @@ static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
             }
         }
 
-        /* Allocate a buffer for the plaintext */
-        if ((err = SSLAllocBuffer(&rec->contents, sz)))
+        if (dest.data != NULL && dest.length >= sz)
         {
-            return err;
+            rec->contents.data = dest.data;
+        }
+        else
+        {
+            rec->contents.data = ctx->plaintextBuffer.data;
         }
+        rec->contents.length = sz;
 
         return tls_record_decrypt(ctx->filter, record, &rec->contents, NULL);
     }
 }
 
+static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
+{
+    SSLBuffer none = { .length = 0, .data = NULL };
+    return SSLRecordReadInternalTo(ref, rec, none);
+}
+
+int SSLRecordReadInternalInto(SSLRecordContextRef ref, SSLRecord *rec, SSLBuffer dest)
+{
+    return SSLRecordReadInternalTo(ref, rec, dest);
+}
+
 static int SSLRecordWriteInternal(SSLRecordContextRef ref, SSLRecord rec)
 {
     int err;
@@ -288,7 +310,8 @@ SSLSetInternalRecordLayerProtocolVersion(SSLRecordContextRef ref, SSLProtocolVer
 static int
 SSLRecordFreeInternal(SSLRecordContextRef ref, SSLRecord rec)
 {
-    return SSLFreeBuffer(&rec.contents);
+    /* Record contents always live in plaintextBuffer or the caller's buffer */
+    return 0;
 }
 
 static int
@@ -347,6 +370,9 @@ SSLCreateInternalRecordLayer(SSLContextRef sslCtx)
     require((ctx->filter=tls_record_create(sslCtx->isDTLS, CCRNGSTATE)), fail);
     require_noerr(SSLAllocBuffer(&ctx->partialReadBuffer,
                                  DEFAULT_BUFFER_SIZE), fail);
+    /* No plaintext is longer than its record */
+    require_noerr(SSLAllocBuffer(&ctx->plaintextBuffer,
+                                 DEFAULT_BUFFER_SIZE), fail);
 
     ctx->sslCtx = sslCtx;
     return ctx;
@@ -354,6 +380,8 @@ SSLCreateInternalRecordLayer(SSLContextRef sslCtx)
 fail:
     if(ctx->filter)
         tls_record_destroy(ctx->filter);
+    SSLFreeBuffer(&ctx->partialReadBuffer);
+    SSLFreeBuffer(&ctx->plaintextBuffer);
     sslFree(ctx);
     return NULL;
 }
@@ -366,6 +394,7 @@ SSLDestroyInternalRecordLayer(SSLRecordContextRef ref)
 
     /* RecordContext cleanup : */
     SSLFreeBuffer(&ctx->partialReadBuffer);
+    SSLFreeBuffer(&ctx->plaintextBuffer);
     waitRecord = ctx->recordWriteQueue;
     while (waitRecord)
     {   next = waitRecord->next;
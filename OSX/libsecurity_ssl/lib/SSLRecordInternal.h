@@ -39,6 +39,10 @@ SSLCreateInternalRecordLayer(SSLContextRef ctx);
 void
 SSLDestroyInternalRecordLayer(SSLRecordContextRef ctx);
 
+/* Like SSLRecordLayerInternal.read, but decrypts straight into dest when it
+   is big enough for the record; rec->contents then points into dest. */
+int
+SSLRecordReadInternalInto(SSLRecordContextRef ctx, SSLRecord *rec, SSLBuffer dest);
 
 extern struct SSLRecordFuncs SSLRecordLayerInternal;
 
@@ -176,8 +176,9 @@ struct SSLContext
 
 
 	/* Transport layer fields */
-    SSLBuffer			receivedDataBuffer;
+    SSLBuffer			receivedDataBuffer;     /* unread plaintext, in receivedDataStorage */
     size_t              receivedDataPos;
+    SSLBuffer           receivedDataStorage;    /* kept across reads */
 
 	Boolean				allowAnyRoot;		// don't require known roots
 	Boolean				sentFatalAlert;		// this session terminated by fatal alert
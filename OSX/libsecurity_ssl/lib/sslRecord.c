@@ -117,6 +117,18 @@ SSLReadRecord(SSLRecord *rec, SSLContext *ctx)
     return errorTranslate(ctx->recFuncs->read(ctx->recCtx, rec));
 }
 
+/* SSLReadRecordInto
+ *  As SSLReadRecord, but lets the internal record layer decrypt directly
+ *  into dest.  Record content should still be freed using SSLFreeRecord.
+ */
+OSStatus
+SSLReadRecordInto(SSLRecord *rec, SSLBuffer dest, SSLContext *ctx)
+{
+    if (ctx->recFuncs == &SSLRecordLayerInternal)
+        return errorTranslate(SSLRecordReadInternalInto(ctx->recCtx, rec, dest));
+    return errorTranslate(ctx->recFuncs->read(ctx->recCtx, rec));
+}
+
 OSStatus SSLServiceWriteQueue(SSLContext *ctx)
 {
     return errorTranslate(ctx->recFuncs->serviceWriteQueue(ctx->recCtx));
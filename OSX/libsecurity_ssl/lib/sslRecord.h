@@ -52,6 +52,11 @@ OSStatus SSLReadRecord(
 	SSLRecord 	*rec,
 	SSLContext 	*ctx);
 
+OSStatus SSLReadRecordInto(
+	SSLRecord 	*rec,
+	SSLBuffer 	dest,
+	SSLContext 	*ctx);
+
 OSStatus SSLServiceWriteQueue(
     SSLContext  *ctx);
 
@@ -227,8 +227,9 @@ readRetry:
     if (ctx->receivedDataBuffer.data != 0 &&
         ctx->receivedDataPos >= ctx->receivedDataBuffer.length)
     {
-        SSLFreeBuffer(&ctx->receivedDataBuffer);
+        /* receivedDataStorage is reused for the next partial read */
         ctx->receivedDataBuffer.data = 0;
+        ctx->receivedDataBuffer.length = 0;
         ctx->receivedDataPos = 0;
     }
 
@@ -238,7 +239,9 @@ readRetry:
     if (remaining > 0 && ctx->state != SSL_HdskStateGracefulClose)
     {
         assert(ctx->receivedDataBuffer.data == 0);
-        if ((err = SSLReadRecord(&rec, ctx)) != 0) {
+        /* When the user's buffer is big enough, the record is decrypted right into it */
+        SSLBuffer dest = { .length = remaining, .data = charPtr };
+        if ((err = SSLReadRecordInto(&rec, dest, ctx)) != 0) {
             goto exit;
         }
         if (rec.contentType == SSL_RecordTypeAppData ||
@@ -246,20 +249,30 @@ readRetry:
         {
             if (rec.contents.length <= remaining)
             {   /* Copy all we got in the user's buffer */
-                memcpy(charPtr, rec.contents.data, rec.contents.length);
+                if (rec.contents.data != charPtr)
+                    memcpy(charPtr, rec.contents.data, rec.contents.length);
                 *processed += rec.contents.length;
-                {
-                    if ((err = SSLFreeRecord(rec, ctx))) {
-                    	goto exit;
-                    }
-                }
             }
             else
             {   /* Copy what we can in the user's buffer, keep the rest for next SSLRead. */
+                size_t leftover = rec.contents.length - remaining;
+                if (ctx->receivedDataStorage.length < leftover) {
+                    SSLFreeBuffer(&ctx->receivedDataStorage);
+                    if ((err = SSLAllocBuffer(&ctx->receivedDataStorage,
+                                              leftover > MAX_RECORD_LENGTH ? leftover : MAX_RECORD_LENGTH))) {
+                        SSLFreeRecord(rec, ctx);
+                        goto exit;
+                    }
+                }
                 memcpy(charPtr, rec.contents.data, remaining);
+                memcpy(ctx->receivedDataStorage.data, rec.contents.data + remaining, leftover);
                 *processed += remaining;
-                ctx->receivedDataBuffer = rec.contents;
-                ctx->receivedDataPos = remaining;
+                ctx->receivedDataBuffer.data = ctx->receivedDataStorage.data;
+                ctx->receivedDataBuffer.length = leftover;
+                ctx->receivedDataPos = 0;
+            }
+            if ((err = SSLFreeRecord(rec, ctx))) {
+                goto exit;
             }
         }
         else {
@@ -68,6 +68,9 @@ struct SSLRecordInternalContext
     SSLBuffer    		partialReadBuffer;
     size_t              amountRead;
 
+    /* plaintext of the last record read, unless it went to the caller's buffer */
+    SSLBuffer           plaintextBuffer;
+
     WaitingRecord       *recordWriteQueue;
 };
 
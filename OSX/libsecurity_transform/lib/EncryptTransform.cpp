@@ -827,13 +827,17 @@ void EncryptDecryptBase::AttributeChanged(SecTransformAttributeRef ah, CFTypeRef
 
 		if (intermediateDataStruct.Length > 0)
 		{
-			if (NULL == m_processedData)
+			// The CSP malloc'd the output for us, so hand the buffer on rather than copying it
+			CFDataRef output = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, intermediateDataStruct.Data, bytesProcessed, kCFAllocatorMalloc);
+			if (NULL == output)
 			{
-				m_processedData = CFDataCreateMutable(kCFAllocatorDefault, 0);
+				free(intermediateDataStruct.Data);
+				SendCSSMError(CSSMERR_CSSM_MEMORY_ERROR);
+				return;
 			}
 
-			CFDataAppendBytes(m_processedData, intermediateDataStruct.Data, bytesProcessed);
-			free(intermediateDataStruct.Data);
+			SendAttribute(kSecTransformOutputAttributeName, output);
+			CFReleaseNull(output);
 		}
 	}
 	else
@@ -18,7 +18,7 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 		}
 		
 		// define the storage for our block
-		__block CFIndex blockSize = 4096;  // make a default block size
+		__block CFIndex blockSize = 0;  // 0 => adaptive, see CreateStreamChunk
 		
 		// it's not necessary to set the input stream size
 		SecTransformCustomSetAttribute(ref, kStreamMaxSize, kSecTransformMetaAttributeRequired, kCFBooleanFalse);
@@ -76,28 +76,19 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 				break;
 			}		
 			
-			// allocate the read buffer on the heap
-			u_int8_t* buffer = (u_int8_t*) malloc(blockSize);
-			
+			// an explicit MAX_READSIZE fixes the chunk size; otherwise let it grow
+			CFIndex maximumSize = (blockSize > 0) ? blockSize : kStreamChunkMaximum;
+			CFIndex chunkSize = (blockSize > 0) ? blockSize : kStreamChunkMinimum;
 			CFIndex bytesRead;
 			
-			bytesRead = CFReadStreamRead(input, buffer, blockSize);
-			while (bytesRead > 0)
+			// each chunk owns the buffer it was read into, so it goes down the chain without a copy
+			CFDataRef value;
+			while ((value = CreateStreamChunk(input, &chunkSize, maximumSize, &bytesRead)) != NULL)
 			{
-				// make data from what was read
-				CFDataRef value = CFDataCreate(NULL, buffer, bytesRead);
-				
-				// send it down the chain
 				SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
-				
-				// cleanup
 				CFReleaseNull(value);
-				
-				bytesRead = CFReadStreamRead(input, buffer, blockSize);
 			}
 			
-			free(buffer);
-			
 			SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, (CFTypeRef) NULL);
 			
 			return (CFTypeRef) NULL;
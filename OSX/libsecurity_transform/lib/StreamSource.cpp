@@ -1,14 +1,13 @@
 #include "StreamSource.h"
 #include <string>
 #include "misc.h"
+#include "Utilities.h"
 #include "SecCFRelease.h"
 
 using namespace std;
 
 CFStringRef gStreamSourceName = CFSTR("StreamSource");
 
-const CFIndex kMaximumSize = 2048;
-
 StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFStringRef name)
 	: Source(gStreamSourceName, transform, name),
 	mReadStream(input),
@@ -21,20 +20,15 @@ StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFString
 void StreamSource::BackgroundActivate()
 {
 	CFIndex result = 0;
+	CFIndex chunkSize = kStreamChunkMinimum;
 	
 	do
 	{
-		// make a buffer big enough to handle the object
-		// NOTE: allocating this on the stack and letting CFDataCreate copy it is _faster_ then malloc and CFDataCreateWithBytes(..., kCFAllactorMalloc) by a fair margin.   At least for 2K chunks.   Retest if changing the size.
-		UInt8 buffer[kMaximumSize];
-		
-		result = CFReadStreamRead(mReadStream, buffer, kMaximumSize);
+		// the data owns the buffer it was read into, and is passed down the chain as is
+		CFDataRef data = CreateStreamChunk(mReadStream, &chunkSize, kStreamChunkMaximum, &result);
 		
-		if (result > 0) // was data returned?
+		if (data != NULL) // was data returned?
 		{
-			// make the data and send it to the transform
-			CFDataRef data = CFDataCreate(NULL, buffer, result);
-
 			CFErrorRef error = mDestination->SetAttribute(mDestinationName, data);
 			
 			CFReleaseNull(data);
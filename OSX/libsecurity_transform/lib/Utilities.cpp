@@ -25,6 +25,7 @@
 #include "SecTransform.h"
 #include <sys/sysctl.h>
 #include <syslog.h>
+#include <stdlib.h>
 #include <dispatch/dispatch.h>
 
 void MyDispatchAsync(dispatch_queue_t queue, void(^block)(void))
@@ -44,6 +45,51 @@ dispatch_queue_t MyDispatchQueueCreate(const char* name, dispatch_queue_attr_t a
 
 
 
+CFDataRef CreateStreamChunk(CFReadStreamRef stream, CFIndex *chunkSize, CFIndex maximumSize, CFIndex *bytesRead)
+{
+	CFIndex size = *chunkSize;
+	UInt8 *buffer = (UInt8 *)malloc(size);
+	if (buffer == NULL)
+	{
+		*bytesRead = -1;
+		return NULL;
+	}
+	
+	CFIndex result = CFReadStreamRead(stream, buffer, size);
+	*bytesRead = result;
+	if (result <= 0)
+	{
+		free(buffer);
+		return NULL;
+	}
+	
+	if (result == size)
+	{
+		*chunkSize = (size < maximumSize / 2) ? size * 2 : maximumSize;
+	}
+	else if (result < size / 2)
+	{
+		// a slow stream; back off, and don't leave a mostly empty buffer queued up downstream
+		*chunkSize = (size / 2 > kStreamChunkMinimum) ? size / 2 : (kStreamChunkMinimum < maximumSize ? kStreamChunkMinimum : maximumSize);
+		UInt8 *trimmed = (UInt8 *)realloc(buffer, result);
+		if (trimmed != NULL)
+		{
+			buffer = trimmed;
+		}
+	}
+	
+	CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, buffer, result, kCFAllocatorMalloc);
+	if (data == NULL)
+	{
+		free(buffer);
+		*bytesRead = -1;
+	}
+	
+	return data;
+}
+
+
+
 static CFErrorRef CreateErrorRefCore(CFStringRef domain, int errorCode, const char* format, va_list ap)
 {
 	CFStringRef fmt = CFStringCreateWithCString(NULL, format, kCFStringEncodingUTF8);
@@ -16,6 +16,17 @@ CFErrorRef CreateGenericErrorRef(CFStringRef domain, int errorCode, const char*
 CFErrorRef CreateSecTransformErrorRef(int errorCode, const char* format, ...);
 CFErrorRef CreateSecTransformErrorRefWithCFType(int errorCode, CFTypeRef errorMsg);
 
+// Streams are read in chunks that start at kStreamChunkMinimum and double
+// (up to the caller's maximum) for as long as the stream keeps filling them,
+// so a fast source ends up paying the per-chunk hops between transforms
+// rarely.  Each chunk is read straight into the buffer its CFData owns.
+enum {
+	kStreamChunkMinimum = 16 * 1024,
+	kStreamChunkMaximum = 1024 * 1024
+};
+
+CFDataRef CreateStreamChunk(CFReadStreamRef stream, CFIndex *chunkSize, CFIndex maximumSize, CFIndex *bytesRead);
+
 CFTypeRef DebugRetain(const void* owner, CFTypeRef type);
 void DebugRelease(const void* owner, CFTypeRef type);
 
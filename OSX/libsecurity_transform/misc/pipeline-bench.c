@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * pipeline-bench - push a large file through read->digest and
+ * read->encrypt->digest transform groups and report throughput.
+ *
+ * usage: pipeline-bench [file [megabytes]]
+ *
+ * Without a file, a scratch file of the given size (default 1024 MB) is
+ * written to /tmp first and removed afterwards.
+ */
+
+#include <Security/Security.h>
+#include <Security/SecTransform.h>
+#include <Security/SecDigestTransform.h>
+#include <Security/SecEncryptTransform.h>
+#include <Security/SecTransformReadTransform.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <mach/mach_time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+static void
+check(CFErrorRef error, const char *what)
+{
+	if (error == NULL)
+		return;
+	CFStringRef desc = CFErrorCopyDescription(error);
+	char buf[256] = "unknown error";
+	if (desc)
+		CFStringGetCString(desc, buf, sizeof(buf), kCFStringEncodingUTF8);
+	errx(1, "%s: %s", what, buf);
+}
+
+static void
+makeFile(const char *path, off_t megabytes)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		err(1, "%s", path);
+	size_t chunk = 1024 * 1024;
+	char *buffer = malloc(chunk);
+	arc4random_buf(buffer, chunk);
+	for (off_t n = 0; n < megabytes; n++)
+		if (write(fd, buffer, chunk) != (ssize_t)chunk)
+			err(1, "%s", path);
+	free(buffer);
+	close(fd);
+}
+
+static SecKeyRef
+makeKey(void)
+{
+	int bits = 128;
+	CFNumberRef size = CFNumberCreate(NULL, kCFNumberIntType, &bits);
+	const void *keys[] = { kSecAttrKeyType, kSecAttrKeySizeInBits };
+	const void *values[] = { kSecAttrKeyTypeAES, size };
+	CFDictionaryRef params = CFDictionaryCreate(NULL, keys, values, 2,
+		&kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+	CFErrorRef error = NULL;
+	SecKeyRef key = SecKeyGenerateSymmetric(params, &error);
+	check(error, "SecKeyGenerateSymmetric");
+
+	CFRelease(params);
+	CFRelease(size);
+	return key;
+}
+
+// read [-> encrypt] -> SHA-256, returning seconds taken
+static double
+run(const char *path, SecKeyRef key)
+{
+	CFErrorRef error = NULL;
+	CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, strlen(path), false);
+	CFReadStreamRef stream = CFReadStreamCreateWithFile(NULL, url);
+	SecTransformRef group = SecTransformCreateGroupTransform();
+	SecTransformRef read = SecTransformCreateReadTransformWithReadStream(stream);
+	SecTransformRef digest = SecDigestTransformCreate(kSecDigestSHA2, 256, &error);
+	check(error, "SecDigestTransformCreate");
+	SecTransformRef encrypt = NULL;
+
+	if (key) {
+		encrypt = SecEncryptTransformCreate(key, &error);
+		check(error, "SecEncryptTransformCreate");
+		SecTransformConnectTransforms(read, kSecTransformOutputAttributeName,
+			encrypt, kSecTransformInputAttributeName, group, &error);
+		check(error, "connect read->encrypt");
+		SecTransformConnectTransforms(encrypt, kSecTransformOutputAttributeName,
+			digest, kSecTransformInputAttributeName, group, &error);
+		check(error, "connect encrypt->digest");
+	} else {
+		SecTransformConnectTransforms(read, kSecTransformOutputAttributeName,
+			digest, kSecTransformInputAttributeName, group, &error);
+		check(error, "connect read->digest");
+	}
+
+	mach_timebase_info_data_t tb;
+	mach_timebase_info(&tb);
+	uint64_t start = mach_absolute_time();
+	CFTypeRef result = SecTransformExecute(group, &error);
+	double seconds = (double)(mach_absolute_time() - start) * tb.numer / tb.denom / 1e9;
+	check(error, "SecTransformExecute");
+	if (result == NULL || CFGetTypeID(result) != CFDataGetTypeID() || CFDataGetLength(result) != 32)
+		errx(1, "unexpected digest result");
+
+	CFRelease(result);
+	if (encrypt)
+		CFRelease(encrypt);
+	CFRelease(digest);
+	CFRelease(read);
+	CFRelease(group);
+	CFRelease(stream);
+	CFRelease(url);
+	return seconds;
+}
+
+int main(int argc, const char *argv[])
+{
+	char scratch[] = "/tmp/pipeline-bench.XXXXXX";
+	const char *path = (argc > 1) ? argv[1] : NULL;
+	off_t megabytes = (argc > 2) ? atoll(argv[2]) : 1024;
+
+	if (path == NULL) {
+		int fd = mkstemp(scratch);
+		if (fd < 0)
+			err(1, "mkstemp");
+		close(fd);
+		makeFile(scratch, megabytes);
+		path = scratch;
+	}
+
+	struct stat st;
+	if (stat(path, &st))
+		err(1, "%s", path);
+	double gigabytes = (double)st.st_size / (1024.0 * 1024.0 * 1024.0);
+
+	SecKeyRef key = makeKey();
+
+	double seconds = run(path, NULL);
+	printf("read->digest:          %.2f GB in %.2f s, %.2f GB/s\n", gigabytes, seconds, gigabytes / seconds);
+	seconds = run(path, key);
+	printf("read->encrypt->digest: %.2f GB in %.2f s, %.2f GB/s\n", gigabytes, seconds, gigabytes / seconds);
+
+	CFRelease(key);
+	if (path == scratch)
+		unlink(scratch);
+	return 0;
+}
@@ -103,6 +103,7 @@ public:
 	template<typename _Dataoid>
 	void update(const _Dataoid &doid) { this->update(doid.data(), doid.length()); }
 	virtual void finish(Byte *digest) = 0;
+	virtual void reset() = 0;					// start over, as if newly made
 	
 	void operator () (const void *data, size_t length)
 		{ return this->update(data, length); }
@@ -126,6 +127,8 @@ public:
 	void update(const void *data, size_t length)
 		{ CCDigestUpdate(mDigest, data, length); }
 	void finish(unsigned char *digest);
+	void reset()
+		{ CCDigestReset(mDigest); }
 	
 private:
 	CCDigestRef mDigest;
@@ -29,6 +29,7 @@
 #include <security_utilities/memutils.h>
 #include <security_utilities/endian.h>
 #include <mach-o/dyld.h>
+#include <sys/mount.h>
 #include <list>
 #include <algorithm>
 #include <iterator>
@@ -166,6 +167,42 @@ size_t MachOBase::commandSize() const
 }
 
 
+//
+// Read-only mappings of whole files
+//
+// We only map files nobody but root can change underneath us: a mapping reflects
+// later writes to the file, and touching a page past a truncated end raises SIGBUS.
+// Everything else throws EPERM here, and callers fall back to reading.
+//
+MachOMapping::MachOMapping(UnixPlusPlus::FileDesc fd)
+{
+	FileDesc::UnixStat st;
+	fd.fstat(st);
+	struct statfs sfs;
+	if (::fstatfs(fd, &sfs))
+		UnixError::throwMe();
+	if (!S_ISREG(st.st_mode) || st.st_uid != 0 || (st.st_mode & (S_IWGRP | S_IWOTH))
+		|| !(sfs.f_flags & MNT_LOCAL))
+		UnixError::throwMe(EPERM);
+	mLength = st.st_size;
+	if (mLength == 0)		// can't map that (and there's nothing to parse anyway)
+		UnixError::throwMe(ENOEXEC);
+	mBase = fd.mmap(PROT_READ, mLength);
+}
+
+MachOMapping::~MachOMapping()
+{
+	::munmap(mBase, mLength);
+}
+
+const void *MachOMapping::at(size_t offset, size_t size) const
+{
+	if (!contains(offset, size))
+		UnixError::throwMe(ENOEXEC);
+	return LowLevelMemoryUtilities::increment(mBase, offset);
+}
+
+
 //
 // Create a MachO object from an open file and a starting offset.
 // We load (only) the header and load commands into memory at that time.
@@ -173,7 +210,7 @@ size_t MachOBase::commandSize() const
 // (not relative to some intermediate container).
 //
 MachO::MachO(FileDesc fd, size_t offset, size_t length)
-	: FileDesc(fd), mOffset(offset), mLength(length), mSuspicious(false)
+	: FileDesc(fd), mOffset(offset), mLength(length), mCommandBuffer(NULL), mSuspicious(false)
 {
 	if (mOffset == 0)
 		mLength = fd.fileSize();
@@ -193,6 +230,22 @@ MachO::MachO(FileDesc fd, size_t offset, size_t length)
 		this->validateStructure();
 }
 
+//
+// The same, but parsing the header and load commands in place in a mapping of the file.
+// The bounds are those of the file, exactly as for the read-in form.
+//
+MachO::MachO(FileDesc fd, MachOMapping *mapping, size_t offset, size_t length)
+	: FileDesc(fd), mOffset(offset), mLength(length), mCommandBuffer(NULL), mMapping(mapping), mSuspicious(false)
+{
+	if (mOffset == 0)
+		mLength = mapping->length();
+	this->initHeader(mapping->at<mach_header>(mOffset));
+	this->initCommands(static_cast<const load_command *>(
+		mapping->at(mOffset + this->headerSize(), this->commandSize())));
+	if (mLength != 0)
+		this->validateStructure();
+}
+
 void MachO::validateStructure()
 {
 	bool isValid = false;
@@ -531,6 +584,8 @@ void MachO::seek(size_t offset)
 
 CFDataRef MachO::dataAt(size_t offset, size_t size)
 {
+	if (mMapping)
+		return makeCFData(mMapping->at(mOffset + offset, size), size);
 	CFMallocData buffer(size);
 	if (this->read(buffer, size, mOffset + offset) != size)
 		UnixError::throwMe();
@@ -541,16 +596,35 @@ CFDataRef MachO::dataAt(size_t offset, size_t size)
 // Fat (aka universal) file wrappers.
 // The offset is relative to the start of the containing file.
 //
+union UniversalHeader {
+	fat_header header;		// if this is a fat file
+	mach_header mheader;	// if this is a thin file
+};
+
 Universal::Universal(FileDesc fd, size_t offset /* = 0 */, size_t length /* = 0 */)
-	: FileDesc(fd), mBase(offset), mLength(length), mMachType(0), mSuspicious(false)
+	: FileDesc(fd), mArchList(NULL), mArchBuffer(NULL), mArchCount(0),
+	  mBase(offset), mLength(length), mMachType(0), mSuspicious(false)
 {
-	union {
-		fat_header header;		// if this is a fat file
-		mach_header mheader;	// if this is a thin file
-	} unionHeader;
-
+	UniversalHeader unionHeader;
 	if (fd.read(&unionHeader, sizeof(unionHeader), offset) != sizeof(unionHeader))
 		UnixError::throwMe(ENOEXEC);
+	init(&unionHeader);
+}
+
+//
+// The same, parsing the fat header and fat_arch table in place in a mapping of the file.
+// MachO objects we make from it share the mapping.
+//
+Universal::Universal(FileDesc fd, MachOMapping *mapping, size_t offset /* = 0 */, size_t length /* = 0 */)
+	: FileDesc(fd), mMapping(mapping), mArchList(NULL), mArchBuffer(NULL), mArchCount(0),
+	  mBase(offset), mLength(length), mMachType(0), mSuspicious(false)
+{
+	init(mapping->at(offset, sizeof(UniversalHeader)));
+}
+
+void Universal::init(const void *header)
+{
+	const UniversalHeader &unionHeader = *static_cast<const UniversalHeader *>(header);
 	switch (unionHeader.header.magic) {
 	case FAT_MAGIC:
 	case FAT_CIGAM:
@@ -568,22 +642,19 @@ Universal::Universal(FileDesc fd, size_t offset /* = 0 */, size_t length /* = 0
 				UnixError::throwMe(ENOEXEC);
 
 			size_t archSize = sizeof(fat_arch) * (mArchCount + 1);
-			mArchList = (fat_arch *)malloc(archSize);
-			if (!mArchList)
-				UnixError::throwMe();
-			if (fd.read(mArchList, archSize, mBase + sizeof(unionHeader.header)) != archSize) {
-				::free(mArchList);
-				UnixError::throwMe(ENOEXEC);
-			}
-			for (fat_arch *arch = mArchList; arch <= mArchList + mArchCount; arch++) {
-				n2hi(arch->cputype);
-				n2hi(arch->cpusubtype);
-				n2hi(arch->offset);
-				n2hi(arch->size);
-				n2hi(arch->align);
+			if (mMapping) {
+				mArchList = static_cast<const fat_arch *>(mMapping->at(mBase + sizeof(fat_header), archSize));
+			} else {
+				mArchBuffer = (fat_arch *)malloc(archSize);
+				if (!mArchBuffer)
+					UnixError::throwMe();
+				if (this->read(mArchBuffer, archSize, mBase + sizeof(fat_header)) != archSize) {
+					::free(mArchBuffer);
+					UnixError::throwMe(ENOEXEC);
+				}
+				mArchList = mArchBuffer;
 			}
-			const fat_arch *last_arch = mArchList + mArchCount;
-			if (last_arch->cputype == (CPU_ARCH_ABI64 | CPU_TYPE_ARM)) {
+			if (arch(mArchCount).cputype == (CPU_ARCH_ABI64 | CPU_TYPE_ARM)) {
 				mArchCount++;
 			}
 			secinfo("macho", "%p is a fat file with %d architectures",
@@ -592,80 +663,56 @@ Universal::Universal(FileDesc fd, size_t offset /* = 0 */, size_t length /* = 0
 			/* A Mach-O universal file has padding of no more than "page size"
 			 * between the header and slices. This padding must be zeroed out or the file
 			   is not valid */
-			std::list<struct fat_arch *> sortedList;
+			std::list<fat_arch> sortedList;
 			for (unsigned i = 0; i < mArchCount; i++)
-				sortedList.push_back(mArchList + i);
+				sortedList.push_back(arch(i));
 
-			sortedList.sort(^ bool (const struct fat_arch *arch1, const struct fat_arch *arch2) { return arch1->offset < arch2->offset; });
+			sortedList.sort(^ bool (const fat_arch &arch1, const fat_arch &arch2) { return arch1.offset < arch2.offset; });
 
-			const size_t universalHeaderEnd = mBase + sizeof(unionHeader.header) + (sizeof(fat_arch) * mArchCount);
+			const size_t universalHeaderEnd = mBase + sizeof(fat_header) + (sizeof(fat_arch) * mArchCount);
 			size_t prevHeaderEnd = universalHeaderEnd;
 			size_t prevArchSize = 0, prevArchStart = 0;
 
 			for (auto iterator = sortedList.begin(); iterator != sortedList.end(); ++iterator) {
-				auto ret = mSizes.insert(std::pair<size_t, size_t>((*iterator)->offset, (*iterator)->size));
+				auto ret = mSizes.insert(std::pair<size_t, size_t>(iterator->offset, iterator->size));
 				if (ret.second == false) {
-					::free(mArchList);
+					::free(mArchBuffer);
 					MacOSError::throwMe(errSecInternalError); // Something is wrong if the same size was encountered twice
 				}
 
-				size_t gapSize = (*iterator)->offset - prevHeaderEnd;
+				size_t gapSize = iterator->offset - prevHeaderEnd;
 
 				/* The size of the padding after the universal cannot be calculated to a fixed size */
 				if (prevHeaderEnd != universalHeaderEnd) {
-					if (((*iterator)->align > MAX_ALIGN) || gapSize >= (1 << (*iterator)->align)) {
+					if ((iterator->align > MAX_ALIGN) || gapSize >= (1 << iterator->align)) {
 						mSuspicious = true;
 						break;
 					}
 				}
 
-				// validate gap bytes in tasty page-sized chunks
-				CssmAutoPtr<uint8_t> gapBytes(Allocator::standard().malloc<uint8_t>(PAGE_SIZE));
-				size_t off = 0;
-				while (off < gapSize) {
-					size_t want = min(gapSize - off, (size_t)PAGE_SIZE);
-					size_t got = fd.read(gapBytes, want, prevHeaderEnd + off);
-					if (got == 0) {
-						mSuspicious = true;
-						break;
-					}
-					off += got;
-					for (size_t x = 0; x < got; x++) {
-						if (gapBytes[x] != 0) {
-							mSuspicious = true;
-							break;
-						}
-					}
-					if (mSuspicious)
-						break;
-				}
-				if (off != gapSize)
+				if (!zeroFilled(prevHeaderEnd, gapSize)) {
 					mSuspicious = true;
-				if (mSuspicious)
 					break;
+				}
 
-				prevHeaderEnd = (*iterator)->offset + (*iterator)->size;
-				prevArchSize = (*iterator)->size;
-				prevArchStart = (*iterator)->offset;
+				prevHeaderEnd = iterator->offset + iterator->size;
+				prevArchSize = iterator->size;
+				prevArchStart = iterator->offset;
 			}
 
 			/* If there is anything extra at the end of the file, reject this */
-			if (!mSuspicious && (prevArchStart + prevArchSize != fd.fileSize()))
+			if (!mSuspicious && (prevArchStart + prevArchSize != totalSize()))
 				mSuspicious = true;
 
 			break;
 		}
 	case MH_MAGIC:
 	case MH_MAGIC_64:
-		mArchList = NULL;
-		mArchCount = 0;
 		mThinArch = Architecture(unionHeader.mheader.cputype, unionHeader.mheader.cpusubtype);
 		secinfo("macho", "%p is a thin file (%s)", this, mThinArch.name());
 		break;
 	case MH_CIGAM:
 	case MH_CIGAM_64:
-		mArchList = NULL;
-		mArchCount = 0;
 		mThinArch = Architecture(flip(unionHeader.mheader.cputype), flip(unionHeader.mheader.cpusubtype));
 		secinfo("macho", "%p is a thin file (%s)", this, mThinArch.name());
 		break;
@@ -676,7 +723,74 @@ Universal::Universal(FileDesc fd, size_t offset /* = 0 */, size_t length /* = 0
 
 Universal::~Universal()
 {
-	::free(mArchList);
+	::free(mArchBuffer);
+}
+
+
+//
+// The n-th entry of the architecture list, in host byte order.
+// The list itself stays as it is in the file (and may not be aligned if mapped).
+//
+fat_arch Universal::arch(unsigned n) const
+{
+	fat_arch arch;
+	memcpy(&arch, mArchList + n, sizeof(arch));
+	n2hi(arch.cputype);
+	n2hi(arch.cpusubtype);
+	n2hi(arch.offset);
+	n2hi(arch.size);
+	n2hi(arch.align);
+	return arch;
+}
+
+
+//
+// Check that a range of the file consists of zero bytes only.
+// Running off the end of the file counts as failure.
+//
+bool Universal::zeroFilled(size_t offset, size_t length) const
+{
+	if (mMapping) {
+		if (!mMapping->contains(offset, length))
+			return false;
+		const uint8_t *bytes = static_cast<const uint8_t *>(mMapping->at(offset, length));
+		for (size_t x = 0; x < length; x++)
+			if (bytes[x] != 0)
+				return false;
+		return true;
+	}
+
+	// validate gap bytes in tasty page-sized chunks
+	CssmAutoPtr<uint8_t> gapBytes(Allocator::standard().malloc<uint8_t>(PAGE_SIZE));
+	size_t off = 0;
+	while (off < length) {
+		size_t want = min(length - off, (size_t)PAGE_SIZE);
+		size_t got = this->read(gapBytes, want, offset + off);
+		if (got == 0)
+			return false;
+		off += got;
+		for (size_t x = 0; x < got; x++)
+			if (gapBytes[x] != 0)
+				return false;
+	}
+	return off == length;
+}
+
+size_t Universal::totalSize() const
+{
+	return mMapping ? mMapping->length() : this->fileSize();
+}
+
+
+//
+// Make a MachO for the image at a file offset, sharing our mapping if we have one.
+//
+MachO *Universal::image(size_t offset, size_t length /* = 0 */) const
+{
+	if (mMapping)
+		return new MachO(*this, mMapping, offset, length);
+	else
+		return new MachO(*this, offset, length);
 }
 
 size_t Universal::lengthOfSlice(size_t offset) const
@@ -696,13 +810,13 @@ MachO *Universal::architecture() const
 	if (isUniversal())
 		return findImage(bestNativeArch());
 	else
-		return new MachO(*this, mBase, mLength);
+		return image(mBase, mLength);
 }
 
 size_t Universal::archOffset() const
 {
 	if (isUniversal())
-		return mBase + findArch(bestNativeArch())->offset;
+		return mBase + findArch(bestNativeArch()).offset;
 	else
 		return mBase;
 }
@@ -717,7 +831,7 @@ MachO *Universal::architecture(const Architecture &arch) const
 	if (isUniversal())
 		return findImage(arch);
 	else if (mThinArch.matches(arch))
-		return new MachO(*this, mBase);
+		return image(mBase);
 	else
 		UnixError::throwMe(ENOEXEC);
 }
@@ -725,7 +839,7 @@ MachO *Universal::architecture(const Architecture &arch) const
 size_t Universal::archOffset(const Architecture &arch) const
 {
 	if (isUniversal())
-		return mBase + findArch(arch)->offset;
+		return mBase + findArch(arch).offset;
 	else if (mThinArch.matches(arch))
 		return 0;
 	else
@@ -735,7 +849,7 @@ size_t Universal::archOffset(const Architecture &arch) const
 size_t Universal::archLength(const Architecture &arch) const
 {
 	if (isUniversal())
-		return mBase + findArch(arch)->size;
+		return mBase + findArch(arch).size;
 	else if (mThinArch.matches(arch))
 		return this->fileSize();
 	else
@@ -749,9 +863,9 @@ size_t Universal::archLength(const Architecture &arch) const
 MachO *Universal::architecture(size_t offset) const
 {
 	if (isUniversal())
-		return make(new MachO(*this, offset));
+		return make(image(offset));
 	else if (offset == mBase)
-		return new MachO(*this);
+		return image(0);
 	else
 		UnixError::throwMe(ENOEXEC);
 }
@@ -761,31 +875,36 @@ MachO *Universal::architecture(size_t offset) const
 // Locate an architecture from the fat file's list.
 // Throws ENOEXEC if not found.
 //
-const fat_arch *Universal::findArch(const Architecture &target) const
+fat_arch Universal::findArch(const Architecture &target) const
 {
 	assert(isUniversal());
-	const fat_arch *end = mArchList + mArchCount;
 	// exact match
-	for (const fat_arch *arch = mArchList; arch < end; ++arch)
-		if (arch->cputype == target.cpuType()
-			&& arch->cpusubtype == target.cpuSubtype())
-			return arch;
+	for (unsigned n = 0; n < mArchCount; n++) {
+		fat_arch candidate = arch(n);
+		if (candidate.cputype == target.cpuType()
+			&& candidate.cpusubtype == target.cpuSubtype())
+			return candidate;
+	}
 	// match for generic model of main architecture
-	for (const fat_arch *arch = mArchList; arch < end; ++arch)
-		if (arch->cputype == target.cpuType() && arch->cpusubtype == 0)
-			return arch;
+	for (unsigned n = 0; n < mArchCount; n++) {
+		fat_arch candidate = arch(n);
+		if (candidate.cputype == target.cpuType() && candidate.cpusubtype == 0)
+			return candidate;
+	}
 	// match for any subarchitecture of the main architecture (questionable)
-	for (const fat_arch *arch = mArchList; arch < end; ++arch)
-		if (arch->cputype == target.cpuType())
-			return arch;
+	for (unsigned n = 0; n < mArchCount; n++) {
+		fat_arch candidate = arch(n);
+		if (candidate.cputype == target.cpuType())
+			return candidate;
+	}
 	// no match
 	UnixError::throwMe(ENOEXEC);	// not found	
 }
 
 MachO *Universal::findImage(const Architecture &target) const
 {
-	const fat_arch *arch = findArch(target);
-	return make(new MachO(*this, mBase + arch->offset, arch->size));
+	fat_arch arch = findArch(target);
+	return make(image(mBase + arch.offset, arch.size));
 }
 	
 MachO* Universal::make(MachO* macho) const
@@ -812,10 +931,13 @@ Architecture Universal::bestNativeArch() const
 	if (isUniversal()) {
 		// ask the NXArch API for our native architecture
 		const Architecture native = Architecture::local();
-		if (fat_arch *match = NXFindBestFatArch(native.cpuType(), native.cpuSubtype(), mArchList, mArchCount))
+		fat_arch archs[MAX_ARCH_COUNT + 1];		// (host byte order, as NXFindBestFatArch wants)
+		for (unsigned n = 0; n < mArchCount; n++)
+			archs[n] = arch(n);
+		if (fat_arch *match = NXFindBestFatArch(native.cpuType(), native.cpuSubtype(), archs, mArchCount))
 			return *match;
 		// if the system can't figure it out, pick (arbitrarily) the first one
-		return mArchList[0];
+		return archs[0];
 	} else
 		return mThinArch;
 }
@@ -827,7 +949,7 @@ void Universal::architectures(Architectures &archs) const
 {
 	if (isUniversal()) {
 		for (unsigned n = 0; n < mArchCount; n++)
-			archs.insert(mArchList[n]);
+			archs.insert(arch(n));
 	} else {
 		auto_ptr<MachO> macho(architecture());
 		archs.insert(macho->architecture());
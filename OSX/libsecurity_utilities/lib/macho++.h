@@ -34,6 +34,7 @@
 #include <security_utilities/endian.h>
 #include <security_utilities/unix++.h>
 #include <security_utilities/cfutilities.h>
+#include <security_utilities/refcount.h>
 #include <map>
 
 namespace Security {
@@ -137,13 +138,42 @@ private:
 };
 
 
+//
+// A read-only memory mapping of an entire (Mach-O or universal) file.
+// MachO and Universal objects made with one of these parse headers, load commands
+// and fat_arch tables in place instead of reading them into private buffers, and
+// share the mapping among themselves. Every access is checked against the mapped length.
+// Only files that can't be changed or truncated while mapped (see the constructor)
+// are mapped; the constructor throws for anything else.
+//
+class MachOMapping : public RefCount {
+public:
+	MachOMapping(UnixPlusPlus::FileDesc fd);
+	~MachOMapping();
+
+	size_t length() const { return mLength; }
+	bool contains(size_t offset, size_t size) const
+		{ return offset <= mLength && size <= mLength - offset; }
+
+	const void *at(size_t offset, size_t size) const;	// throws ENOEXEC if out of bounds
+	template <class T>
+	const T *at(size_t offset) const { return static_cast<const T *>(at(offset, sizeof(T))); }
+
+private:
+	void *mBase;
+	size_t mLength;
+};
+
+
 //
 // A Mach-O object image that resides on disk.
-// We only read small parts of the contents into (discontinuous) memory.
+// We only read small parts of the contents into (discontinuous) memory,
+// or, given a MachOMapping of the file, look at them where they are.
 //
 class MachO : public MachOBase, public UnixPlusPlus::FileDesc {
 public:
 	MachO(FileDesc fd, size_t offset = 0, size_t length = 0);
+	MachO(FileDesc fd, MachOMapping *mapping, size_t offset = 0, size_t length = 0);
 	~MachO();
 	
 	size_t offset() const { return mOffset; }
@@ -156,12 +186,15 @@ public:
 
 	bool isSuspicious() const { return mSuspicious; }
 
+	MachOMapping *mapping() const { return mMapping; }	// NULL if not mapped
+
 private:
 	size_t mOffset;			// starting file offset
 	size_t mLength;			// Mach-O file length
 	
 	mach_header mHeaderBuffer; // read-in Mach-O header
 	load_command *mCommandBuffer; // read-in (malloc'ed) Mach-O load commands
+	RefPointer<MachOMapping> mMapping; // mapping we parse in place (NULL => read-in)
 
 	bool mSuspicious;		// strict validation failed
 };
@@ -197,6 +230,7 @@ public:
 class Universal : public UnixPlusPlus::FileDesc {
 public:
 	Universal(FileDesc fd, size_t offset = 0, size_t length = 0);
+	Universal(FileDesc fd, MachOMapping *mapping, size_t offset = 0, size_t length = 0);
 	~Universal();
 	
 	// return a genuine MachO object for the given architecture
@@ -222,17 +256,26 @@ public:
 	size_t length() const { return mLength; }
 
 	bool isSuspicious() const;
+
+	MachOMapping *mapping() const { return mMapping; }
 	
 public:
 	static uint32_t typeOf(FileDesc fd);
 
 private:
-	const fat_arch *findArch(const Architecture &arch) const;
+	void init(const void *header);		// (header is at least a mach_header's worth)
+	fat_arch arch(unsigned n) const;	// the n-th fat_arch entry, in host byte order
+	fat_arch findArch(const Architecture &arch) const;
 	MachO *findImage(const Architecture &arch) const;
+	MachO *image(size_t offset, size_t length = 0) const;
 	MachO *make(MachO* macho) const;
+	bool zeroFilled(size_t offset, size_t length) const;
+	size_t totalSize() const;
 
 private:
-	fat_arch *mArchList;		// architectures (NULL if thin file)
+	RefPointer<MachOMapping> mMapping; // mapping we parse in place (NULL => read-in)
+	const fat_arch *mArchList;	// architectures, in file (big-endian) order (NULL if thin file)
+	fat_arch *mArchBuffer;		// read-in (malloc'ed) copy of the architectures, if not mapped
 	unsigned mArchCount;		// number of architectures (if fat)
 	Architecture mThinArch;		// single architecture (if thin)
 	size_t mBase;				// overriding offset in file (all types)
@@ -11,6 +11,8 @@ ONE_TEST(sc_31_peerinfo)
 ONE_TEST(sc_40_circle)
 ONE_TEST(sc_42_circlegencount)
 ONE_TEST(sc_45_digestvector)
+ONE_TEST(sc_46_digestvector_bench)
+ONE_TEST(sc_47_manifest_tree)
 
 ONE_TEST(sc_130_resignationticket)
 ONE_TEST(sc_150_Ring)
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "SOSCircle_regressions.h"
+
+#include <Security/SecureObjectSync/SOSDigestVector.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t kSizes[] = { 10000, 100000, 1000000 };
+#define kSizeCount (sizeof(kSizes) / sizeof(kSizes[0]))
+#define kTestCount (1 + 4 * kSizeCount)
+
+static int memcmpDigest(const void *a, const void *b)
+{
+    return memcmp(a, b, SOSDigestSize);
+}
+
+static void appendRange(struct SOSDigestVector *dv, const uint8_t *pool, size_t from, size_t to)
+{
+    for (size_t ix = from; ix < to; ++ix)
+        SOSDigestVectorAppend(dv, pool + ix * SOSDigestSize);
+}
+
+static void testDuplicates(void)
+{
+    struct SOSDigestVector dv = SOSDigestVectorInit;
+    uint8_t digest[SOSDigestSize];
+    for (int n = 0; n < 1000; n++) {
+        arc4random_buf(digest, sizeof(digest));
+        digest[0] = 0x42;       // everything in one radix bucket
+        SOSDigestVectorAppend(&dv, digest);
+        SOSDigestVectorAppend(&dv, digest);
+    }
+    SOSDigestVectorSort(&dv);
+    bool ordered = true;
+    for (size_t ix = 1; ix < dv.count; ++ix)
+        ordered &= memcmp(dv.digest[ix - 1], dv.digest[ix], SOSDigestSize) < 0;
+    ok(dv.count == 1000 && ordered, "skewed duplicates sort and unique (%zu)", dv.count);
+    SOSDigestVectorFree(&dv);
+}
+
+//
+// Two vectors of 90% of n random digests each, overlapping in 80% of n.
+// (Their union is exactly n, which stays within kMaxDVCapacity.)
+//
+static void testSize(size_t n)
+{
+    size_t tenth = n / 10;
+    uint8_t *pool = malloc(n * SOSDigestSize);
+    arc4random_buf(pool, n * SOSDigestSize);
+
+    struct SOSDigestVector dv1 = SOSDigestVectorInit;
+    struct SOSDigestVector dv2 = SOSDigestVectorInit;
+    appendRange(&dv1, pool, 0, n - tenth);
+    appendRange(&dv2, pool, tenth, n);
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    SOSDigestVectorSort(&dv1);
+    CFAbsoluteTime sortTime = CFAbsoluteTimeGetCurrent() - start;
+    SOSDigestVectorSort(&dv2);
+
+    uint8_t *reference = malloc((n - tenth) * SOSDigestSize);
+    memcpy(reference, pool, (n - tenth) * SOSDigestSize);
+    start = CFAbsoluteTimeGetCurrent();
+    qsort(reference, n - tenth, SOSDigestSize, memcmpDigest);
+    CFAbsoluteTime qsortTime = CFAbsoluteTimeGetCurrent() - start;
+    ok(dv1.count == n - tenth && memcmp(dv1.digest, reference, dv1.count * SOSDigestSize) == 0,
+       "%zu: sort matches qsort", n);
+
+    struct SOSDigestVector dvintersect = SOSDigestVectorInit;
+    start = CFAbsoluteTimeGetCurrent();
+    SOSDigestVectorIntersectSorted(&dv1, &dv2, &dvintersect);
+    CFAbsoluteTime intersectTime = CFAbsoluteTimeGetCurrent() - start;
+    is(dvintersect.count, n - 2 * tenth, "%zu: intersection", n);
+
+    struct SOSDigestVector dvunion = SOSDigestVectorInit;
+    start = CFAbsoluteTimeGetCurrent();
+    SOSDigestVectorUnionSorted(&dv1, &dv2, &dvunion);
+    CFAbsoluteTime unionTime = CFAbsoluteTimeGetCurrent() - start;
+    is(dvunion.count, n, "%zu: union", n);
+
+    struct SOSDigestVector dv1_2 = SOSDigestVectorInit;
+    struct SOSDigestVector dv2_1 = SOSDigestVectorInit;
+    start = CFAbsoluteTimeGetCurrent();
+    SOSDigestVectorDiffSorted(&dv1, &dv2, &dv1_2, &dv2_1);
+    CFAbsoluteTime diffTime = CFAbsoluteTimeGetCurrent() - start;
+    ok(dv1_2.count == tenth && dv2_1.count == tenth, "%zu: diff", n);
+
+    diag("%zu digests: sort %.2f ms (qsort %.2f ms), intersect %.2f ms, union %.2f ms, diff %.2f ms", n,
+         sortTime * 1000, qsortTime * 1000, intersectTime * 1000, unionTime * 1000, diffTime * 1000);
+
+    SOSDigestVectorFree(&dv1);
+    SOSDigestVectorFree(&dv2);
+    SOSDigestVectorFree(&dvintersect);
+    SOSDigestVectorFree(&dvunion);
+    SOSDigestVectorFree(&dv1_2);
+    SOSDigestVectorFree(&dv2_1);
+    free(reference);
+    free(pool);
+}
+
+static void tests(void)
+{
+    testDuplicates();
+    for (size_t ix = 0; ix < kSizeCount; ++ix)
+        testSize(kSizes[ix]);
+}
+
+int sc_46_digestvector_bench(int argc, char *const *argv)
+{
+    plan_tests(kTestCount);
+
+    tests();
+
+    return 0;
+}
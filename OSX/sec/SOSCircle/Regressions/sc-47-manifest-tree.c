@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "SOSCircle_regressions.h"
+
+#include <Security/SecureObjectSync/SOSManifest.h>
+#include <Security/SecureObjectSync/SOSDigestVector.h>
+
+#include <utilities/SecCFRelease.h>
+#include <utilities/SecCFWrappers.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kTestCount 7
+#define kItems 50000
+#define kIterations 100
+
+static SOSManifestRef createManifest(const uint8_t *pool, size_t from, size_t to)
+{
+    struct SOSDigestVector dv = SOSDigestVectorInit;
+    for (size_t ix = from; ix < to; ++ix)
+        SOSDigestVectorAppend(&dv, pool + ix * SOSDigestSize);
+    SOSManifestRef manifest = SOSManifestCreateWithDigestVector(&dv, NULL);
+    SOSDigestVectorFree(&dv);
+    return manifest;
+}
+
+static bool sameTrees(SOSManifestRef a, SOSManifestRef b)
+{
+    bool same = true;
+    for (size_t node = 0; same && node < kSOSManifestTreeNodes; ++node) {
+        CFDataRef ha = SOSManifestCopyTreeNodeHash(a, node, NULL);
+        CFDataRef hb = SOSManifestCopyTreeNodeHash(b, node, NULL);
+        same = ha && hb && CFEqual(ha, hb);
+        CFReleaseNull(ha);
+        CFReleaseNull(hb);
+    }
+    return same;
+}
+
+static void tests(void)
+{
+    uint8_t *pool = malloc((kItems + 100) * SOSDigestSize);
+    arc4random_buf(pool, (kItems + 100) * SOSDigestSize);
+
+    SOSManifestRef base = createManifest(pool, 0, kItems);
+    SOSManifestRef removals = createManifest(pool, 10, 13);
+    SOSManifestRef additions = createManifest(pool, kItems, kItems + 5);
+    CFDataRef baseRoot = SOSManifestCopyTreeNodeHash(base, 0, NULL);
+
+    // the patched manifest inherits base's tree and only rehashes what changed
+    SOSManifestRef patched = SOSManifestCreateWithPatch(base, removals, additions, NULL);
+    CFDataRef patchedRoot = SOSManifestCopyTreeNodeHash(patched, 0, NULL);
+    ok(baseRoot && patchedRoot && !CFEqual(baseRoot, patchedRoot), "root hash follows changes");
+    SOSManifestRef fresh = SOSManifestCreateWithData(SOSManifestGetData(patched), NULL);
+    ok(sameTrees(patched, fresh), "incrementally maintained tree matches a rebuilt one");
+
+    SOSManifestRef removed = NULL, added = NULL;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < kIterations; i++) {
+        CFReleaseNull(removed);
+        CFReleaseNull(added);
+        SOSManifestDiff(base, patched, &removed, &added, NULL);
+    }
+    CFAbsoluteTime treeTime = (CFAbsoluteTimeGetCurrent() - start) / kIterations;
+    ok(CFEqualSafe(removed, removals), "tree diff finds the removals");
+    ok(CFEqualSafe(added, additions), "tree diff finds the additions");
+
+    struct SOSDigestVector dvab = SOSDigestVectorInit, dvba = SOSDigestVectorInit;
+    start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < kIterations; i++) {
+        SOSDigestVectorFree(&dvab);
+        SOSDigestVectorFree(&dvba);
+        SOSDigestVectorDiffSorted(SOSManifestGetDigestVector(base), SOSManifestGetDigestVector(patched), &dvab, &dvba);
+    }
+    CFAbsoluteTime linearTime = (CFAbsoluteTimeGetCurrent() - start) / kIterations;
+    diag("%d items, 8 changes: tree diff %.3f ms, full diff %.3f ms", kItems, treeTime * 1000, linearTime * 1000);
+
+    // mostly different manifests still diff exactly as the full diff does
+    SOSManifestRef other = createManifest(pool, kItems / 2, kItems + 100);
+    CFReleaseNull(removed);
+    CFReleaseNull(added);
+    SOSManifestDiff(base, other, &removed, &added, NULL);
+    SOSDigestVectorFree(&dvab);
+    SOSDigestVectorFree(&dvba);
+    SOSDigestVectorDiffSorted(SOSManifestGetDigestVector(base), SOSManifestGetDigestVector(other), &dvab, &dvba);
+    ok(SOSManifestGetCount(removed) == dvab.count && SOSManifestGetCount(added) == dvba.count
+       && memcmp(SOSManifestGetBytePtr(removed), dvab.digest, dvab.count * SOSDigestSize) == 0
+       && memcmp(SOSManifestGetBytePtr(added), dvba.digest, dvba.count * SOSDigestSize) == 0,
+       "tree diff matches full diff (%zu, %zu)", dvab.count, dvba.count);
+
+    // leaves partition the manifest by digest prefix
+    size_t total = 0;
+    bool prefixes = true;
+    for (size_t leaf = 0; leaf < kSOSManifestTreeLeaves; ++leaf) {
+        SOSManifestRef bucket = SOSManifestCreateWithTreeLeaf(base, leaf, NULL);
+        const uint8_t *digests = SOSManifestGetBytePtr(bucket);
+        for (size_t ix = 0; ix < SOSManifestGetCount(bucket); ++ix)
+            prefixes &= ((digests[ix * SOSDigestSize] << 8 | digests[ix * SOSDigestSize + 1]) >> (16 - kSOSManifestTreeDepth)) == leaf;
+        total += SOSManifestGetCount(bucket);
+        CFReleaseNull(bucket);
+    }
+    is(total, (size_t)kItems, "leaves cover the manifest");
+    ok(prefixes, "leaves hold the digests with their prefix");
+
+    SOSDigestVectorFree(&dvab);
+    SOSDigestVectorFree(&dvba);
+    CFReleaseNull(removed);
+    CFReleaseNull(added);
+    CFReleaseNull(other);
+    CFReleaseNull(fresh);
+    CFReleaseNull(patchedRoot);
+    CFReleaseNull(patched);
+    CFReleaseNull(baseRoot);
+    CFReleaseNull(additions);
+    CFReleaseNull(removals);
+    CFReleaseNull(base);
+    free(pool);
+}
+
+int sc_47_manifest_tree(int argc, char *const *argv)
+{
+    plan_tests(kTestCount);
+
+    tests();
+
+    return 0;
+}
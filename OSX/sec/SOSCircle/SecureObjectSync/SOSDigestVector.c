@@ -26,6 +26,7 @@
 #include <utilities/SecCFError.h>
 #include <utilities/SecCFWrappers.h>
 #include <dispatch/dispatch.h>
+#include <libkern/OSByteOrder.h>
 #include <stdlib.h>
 
 CFStringRef kSOSDigestVectorErrorDomain = CFSTR("com.apple.security.sos.digestvector.error");
@@ -71,9 +72,20 @@ void SOSDigestVectorAppend(struct SOSDigestVector *dv, const uint8_t *digest)
 	dv->unsorted = true;
 }
 
-static int SOSDigestCompare(const void *a, const void *b)
+// Compare digests as big-endian 64, 64 and 32 bit words, which orders them
+// exactly as memcmp() would, without the byte loop.
+_Static_assert(SOSDigestSize == 20, "SOSDigestCompare assumes 20 byte digests");
+
+static inline int SOSDigestCompare(const void *a, const void *b)
 {
-	return memcmp(a, b, SOSDigestSize);
+    uint64_t a64 = OSReadBigInt64(a, 0), b64 = OSReadBigInt64(b, 0);
+    if (a64 != b64)
+        return a64 < b64 ? -1 : 1;
+    a64 = OSReadBigInt64(a, 8), b64 = OSReadBigInt64(b, 8);
+    if (a64 != b64)
+        return a64 < b64 ? -1 : 1;
+    uint32_t a32 = OSReadBigInt32(a, 16), b32 = OSReadBigInt32(b, 16);
+    return (a32 > b32) - (a32 < b32);
 }
 
 // Remove duplicates from sorted manifest using minimal memmove() calls
@@ -132,10 +144,74 @@ static void SOSDigestVectorUnique(struct SOSDigestVector *dv) {
 }
 
 
+// Below this many digests qsort() is as fast as anything else.
+#define kSOSDigestRadixMinimum  64
+// Buckets bigger than this (only if digests aren't uniform after all) are left to qsort().
+#define kSOSDigestBucketLimit   32
+
+static void SOSDigestSortRange(uint8_t (*digest)[SOSDigestSize], size_t count)
+{
+    if (count > kSOSDigestBucketLimit) {
+        qsort(digest, count, sizeof(*digest), SOSDigestCompare);
+        return;
+    }
+    for (size_t ix = 1; ix < count; ++ix) {
+        uint8_t key[SOSDigestSize];
+        size_t pos = ix;
+        memcpy(key, digest[ix], SOSDigestSize);
+        while (pos > 0 && SOSDigestCompare(digest[pos - 1], key) > 0) {
+            memcpy(digest[pos], digest[pos - 1], SOSDigestSize);
+            --pos;
+        }
+        memcpy(digest[pos], key, SOSDigestSize);
+    }
+}
+
+// Digests are SHA-1 outputs, so their leading bits are uniformly distributed.
+// One counting sort pass on the leading 8 to 16 bits (about one bucket per digest)
+// leaves buckets of a handful of digests each, which we finish off in place.
+// Returns false, leaving dv untouched, if we can't get the scratch space.
+static bool SOSDigestVectorRadixSort(struct SOSDigestVector *dv)
+{
+    unsigned bits = 8;
+    while (bits < 16 && ((size_t)1 << bits) < dv->count)
+        ++bits;
+    size_t buckets = (size_t)1 << bits;
+    unsigned shift = 16 - bits;
+
+    size_t *next = calloc(buckets + 1, sizeof(*next));
+    uint8_t (*sorted)[SOSDigestSize] = malloc(dv->capacity * sizeof(*sorted));
+    if (next == NULL || sorted == NULL) {
+        free(next);
+        free(sorted);
+        return false;
+    }
+
+    for (size_t ix = 0; ix < dv->count; ++ix)
+        next[(OSReadBigInt16(dv->digest[ix], 0) >> shift) + 1]++;
+    for (size_t bucket = 0; bucket < buckets; ++bucket)
+        next[bucket + 1] += next[bucket];
+    // Scatter; afterwards next[bucket] is the end of bucket (and the start of bucket + 1)
+    for (size_t ix = 0; ix < dv->count; ++ix)
+        memcpy(sorted[next[OSReadBigInt16(dv->digest[ix], 0) >> shift]++], dv->digest[ix], SOSDigestSize);
+
+    free(dv->digest);
+    dv->digest = sorted;
+
+    size_t start = 0;
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        SOSDigestSortRange(sorted + start, next[bucket] - start);
+        start = next[bucket];
+    }
+    free(next);
+    return true;
+}
+
 void SOSDigestVectorSort(struct SOSDigestVector *dv)
 {
     if (dv->unsorted && dv->digest) {
-        qsort(dv->digest, dv->count, sizeof(*dv->digest), SOSDigestCompare);
+        if (dv->count < kSOSDigestRadixMinimum || !SOSDigestVectorRadixSort(dv))
+            qsort(dv->digest, dv->count, sizeof(*dv->digest), SOSDigestCompare);
         dv->unsorted = false;
         SOSDigestVectorUnique(dv);
     }
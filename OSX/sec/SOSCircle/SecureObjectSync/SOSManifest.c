@@ -31,6 +31,8 @@
 #include <utilities/SecCFError.h>
 #include <utilities/SecCFWrappers.h>
 #include <utilities/SecCFCCWrappers.h>
+#include <corecrypto/ccdigest.h>
+#include <libkern/OSByteOrder.h>
 
 CFStringRef kSOSManifestErrorDomain = CFSTR("com.apple.security.sos.manifest.error");
 
@@ -40,6 +42,7 @@ struct __OpaqueSOSManifest {
     CFDataRef digest;
     CFDataRef digestVector;
     struct SOSDigestVector dv;
+    uint8_t (*tree)[SOSDigestSize];     // Merkle tree summary (lazily built, inherited through patches)
 };
 
 CFGiblisWithCompareFor(SOSManifest)
@@ -48,6 +51,7 @@ static void SOSManifestDestroy(CFTypeRef cf) {
     SOSManifestRef mf = (SOSManifestRef)cf;
     CFReleaseSafe(mf->digest);
     CFReleaseSafe(mf->digestVector);
+    free(mf->tree);
 }
 
 static Boolean SOSManifestCompare(CFTypeRef cf1, CFTypeRef cf2) {
@@ -105,6 +109,166 @@ const struct SOSDigestVector *SOSManifestGetDigestVector(SOSManifestRef manifest
     return &manifest->dv;
 }
 
+//
+// Merkle tree summary
+//
+// Leaf hashes cover the (sorted) digests of one bucket, and interior hashes their two
+// children; leaves and interior nodes are hashed with different prefixes so neither can
+// pass for the other. Building a tree hashes the whole manifest once, after which
+// SOSManifestCreateWithPatch rehashes only the buckets touched by the patch (and their
+// ancestors), so trees of long lived manifests follow changes at O(changes * depth).
+//
+
+// Diffs of manifests at least this big build trees for both sides if they don't have them
+#define kSOSManifestTreeMinimum 1024
+
+static inline size_t SOSManifestTreeLeafOf(const uint8_t *digest) {
+    return OSReadBigInt16(digest, 0) >> (16 - kSOSManifestTreeDepth);
+}
+
+// Index of the first digest in m that falls in leaf or after it
+static size_t SOSManifestTreeLeafStart(SOSManifestRef m, size_t leaf) {
+    const uint8_t *digests = SOSManifestGetBytePtr(m);
+    size_t lo = 0, hi = SOSManifestGetCount(m);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (SOSManifestTreeLeafOf(digests + mid * SOSDigestSize) < leaf)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void SOSManifestTreeHashLeaf(SOSManifestRef m, uint8_t (*tree)[SOSDigestSize], size_t leaf, size_t start, size_t end) {
+    const struct ccdigest_info *di = ccsha1_di();
+    const uint8_t prefix = 0;
+    ccdigest_di_decl(di, ctx);
+    ccdigest_init(di, ctx);
+    ccdigest_update(di, ctx, sizeof(prefix), &prefix);
+    ccdigest_update(di, ctx, (end - start) * SOSDigestSize, SOSManifestGetBytePtr(m) + start * SOSDigestSize);
+    ccdigest_final(di, ctx, tree[kSOSManifestTreeLeaves - 1 + leaf]);
+    ccdigest_di_clear(di, ctx);
+}
+
+static void SOSManifestTreeHashNode(uint8_t (*tree)[SOSDigestSize], size_t node) {
+    const struct ccdigest_info *di = ccsha1_di();
+    const uint8_t prefix = 1;
+    ccdigest_di_decl(di, ctx);
+    ccdigest_init(di, ctx);
+    ccdigest_update(di, ctx, sizeof(prefix), &prefix);
+    ccdigest_update(di, ctx, 2 * SOSDigestSize, tree[2 * node + 1]);  // both children
+    ccdigest_final(di, ctx, tree[node]);
+    ccdigest_di_clear(di, ctx);
+}
+
+static uint8_t (*SOSManifestGetTree(SOSManifestRef m))[SOSDigestSize] {
+    if (!m->tree) {
+        uint8_t (*tree)[SOSDigestSize] = malloc(kSOSManifestTreeNodes * SOSDigestSize);
+        if (!tree)
+            return NULL;
+        const uint8_t *digests = SOSManifestGetBytePtr(m);
+        size_t count = SOSManifestGetCount(m), ix = 0;
+        for (size_t leaf = 0; leaf < kSOSManifestTreeLeaves; ++leaf) {
+            size_t start = ix;
+            while (ix < count && SOSManifestTreeLeafOf(digests + ix * SOSDigestSize) == leaf)
+                ++ix;
+            SOSManifestTreeHashLeaf(m, tree, leaf, start, ix);
+        }
+        for (size_t node = kSOSManifestTreeLeaves - 1; node-- > 0;)
+            SOSManifestTreeHashNode(tree, node);
+        m->tree = tree;
+    }
+    return m->tree;
+}
+
+// Give m (which is base with removals and additions applied) a tree updated from base's
+static void SOSManifestTreeInheritWithPatch(SOSManifestRef m, SOSManifestRef base,
+                                            SOSManifestRef removals, SOSManifestRef additions) {
+    if (!base || !base->tree || m->tree)
+        return;
+    uint8_t (*tree)[SOSDigestSize] = malloc(kSOSManifestTreeNodes * SOSDigestSize);
+    if (!tree)
+        return;
+    memcpy(tree, base->tree, kSOSManifestTreeNodes * SOSDigestSize);
+
+    bool dirty[kSOSManifestTreeNodes] = {};
+    SOSManifestRef changes[] = { removals, additions };
+    for (size_t c = 0; c < sizeof(changes) / sizeof(changes[0]); ++c) {
+        const uint8_t *digests = SOSManifestGetBytePtr(changes[c]);
+        for (size_t ix = 0; ix < SOSManifestGetCount(changes[c]); ++ix)
+            dirty[kSOSManifestTreeLeaves - 1 + SOSManifestTreeLeafOf(digests + ix * SOSDigestSize)] = true;
+    }
+    for (size_t leaf = 0; leaf < kSOSManifestTreeLeaves; ++leaf)
+        if (dirty[kSOSManifestTreeLeaves - 1 + leaf])
+            SOSManifestTreeHashLeaf(m, tree, leaf, SOSManifestTreeLeafStart(m, leaf), SOSManifestTreeLeafStart(m, leaf + 1));
+    for (size_t node = kSOSManifestTreeLeaves - 1; node-- > 0;) {
+        if (dirty[2 * node + 1] || dirty[2 * node + 2]) {
+            SOSManifestTreeHashNode(tree, node);
+            dirty[node] = true;
+        }
+    }
+    m->tree = tree;
+}
+
+static void SOSManifestTreeDiffNode(SOSManifestRef a, SOSManifestRef b, size_t node,
+                                    struct SOSDigestVector *dvab, struct SOSDigestVector *dvba) {
+    if (memcmp(a->tree[node], b->tree[node], SOSDigestSize) == 0)
+        return;
+    if (node < kSOSManifestTreeLeaves - 1) {
+        SOSManifestTreeDiffNode(a, b, 2 * node + 1, dvab, dvba);
+        SOSManifestTreeDiffNode(a, b, 2 * node + 2, dvab, dvba);
+        return;
+    }
+
+    // A leaf that differs: diff just its bucket in both manifests
+    size_t leaf = node - (kSOSManifestTreeLeaves - 1);
+    size_t aStart = SOSManifestTreeLeafStart(a, leaf), bStart = SOSManifestTreeLeafStart(b, leaf);
+    struct SOSDigestVector dva = {
+        .digest = (void *)(SOSManifestGetBytePtr(a) + aStart * SOSDigestSize),
+        .count = SOSManifestTreeLeafStart(a, leaf + 1) - aStart,
+    };
+    struct SOSDigestVector dvb = {
+        .digest = (void *)(SOSManifestGetBytePtr(b) + bStart * SOSDigestSize),
+        .count = SOSManifestTreeLeafStart(b, leaf + 1) - bStart,
+    };
+    dva.capacity = dva.count;
+    dvb.capacity = dvb.count;
+    struct SOSDigestVector leafab = SOSDigestVectorInit, leafba = SOSDigestVectorInit;
+    SOSDigestVectorDiffSorted(&dva, &dvb, &leafab, &leafba);
+    // Buckets are visited in order, so appending keeps the results sorted
+    SOSDigestVectorAppendMultipleOrdered(dvab, leafab.count, (const uint8_t *)leafab.digest);
+    SOSDigestVectorAppendMultipleOrdered(dvba, leafba.count, (const uint8_t *)leafba.digest);
+    SOSDigestVectorFree(&leafab);
+    SOSDigestVectorFree(&leafba);
+}
+
+static bool SOSManifestTreeUsable(SOSManifestRef m) {
+    return m->tree || (SOSManifestGetCount(m) >= kSOSManifestTreeMinimum && SOSManifestGetTree(m));
+}
+
+CFDataRef SOSManifestCopyTreeNodeHash(SOSManifestRef m, size_t node, CFErrorRef *error) {
+    if (!m || node >= kSOSManifestTreeNodes) {
+        SecCFCreateErrorWithFormat(kSOSManifestCreateError, kSOSManifestErrorDomain, NULL, error, NULL, CFSTR("No tree node %zu"), node);
+        return NULL;
+    }
+    if (!SOSManifestGetTree(m)) {
+        SecCFCreateErrorWithFormat(kSOSManifestCreateError, kSOSManifestErrorDomain, NULL, error, NULL, CFSTR("Failed to create manifest tree"));
+        return NULL;
+    }
+    return CFDataCreate(kCFAllocatorDefault, m->tree[node], SOSDigestSize);
+}
+
+SOSManifestRef SOSManifestCreateWithTreeLeaf(SOSManifestRef m, size_t leaf, CFErrorRef *error) {
+    if (leaf >= kSOSManifestTreeLeaves) {
+        SecCFCreateErrorWithFormat(kSOSManifestCreateError, kSOSManifestErrorDomain, NULL, error, NULL, CFSTR("No tree leaf %zu"), leaf);
+        return NULL;
+    }
+    size_t start = m ? SOSManifestTreeLeafStart(m, leaf) : 0;
+    size_t end = m ? SOSManifestTreeLeafStart(m, leaf + 1) : 0;
+    return SOSManifestCreateWithBytes(m ? SOSManifestGetBytePtr(m) + start * SOSDigestSize : NULL, (end - start) * SOSDigestSize, error);
+}
+
 bool SOSManifestDiff(SOSManifestRef a, SOSManifestRef b,
                      SOSManifestRef *a_minus_b, SOSManifestRef *b_minus_a,
                      CFErrorRef *error) {
@@ -123,7 +287,10 @@ bool SOSManifestDiff(SOSManifestRef a, SOSManifestRef b,
         CFReleaseNull(empty);
     } else {
         struct SOSDigestVector dvab = SOSDigestVectorInit, dvba = SOSDigestVectorInit;
-        SOSDigestVectorDiffSorted(SOSManifestGetDigestVector(a), SOSManifestGetDigestVector(b), &dvab, &dvba);
+        if (SOSManifestTreeUsable(a) && SOSManifestTreeUsable(b))
+            SOSManifestTreeDiffNode(a, b, 0, &dvab, &dvba);
+        else
+            SOSDigestVectorDiffSorted(SOSManifestGetDigestVector(a), SOSManifestGetDigestVector(b), &dvab, &dvba);
         if (a_minus_b) {
             *a_minus_b = SOSManifestCreateWithDigestVector(&dvab, error);
             if (!*a_minus_b)
@@ -156,6 +323,8 @@ SOSManifestRef SOSManifestCreateWithPatch(SOSManifestRef base,
     if (SOSDigestVectorPatchSorted(SOSManifestGetDigestVector(base), SOSManifestGetDigestVector(removals),
                              SOSManifestGetDigestVector(additions), &dvresult, error)) {
         result = SOSManifestCreateWithDigestVector(&dvresult, error);
+        if (result)
+            SOSManifestTreeInheritWithPatch(result, base, removals, additions);
     } else {
         result = NULL;
     }
@@ -96,6 +96,20 @@ void SOSManifestForEach(SOSManifestRef m, void(^block)(CFDataRef e, bool *stop))
 
 CFDataRef SOSManifestGetDigest(SOSManifestRef m, CFErrorRef *error);
 
+/* Merkle tree summary of a manifest.
+   The leaves are kSOSManifestTreeLeaves buckets, each holding the digests that share
+   their leading kSOSManifestTreeDepth bits. Nodes are numbered heap style: the root is
+   node 0 and the children of node n are 2n+1 and 2n+2, so leaf b is node
+   kSOSManifestTreeLeaves - 1 + b. Two manifests with equal node hashes have equal
+   contents below that node, so peers can find the buckets they disagree on by
+   comparing hashes from the root down, and diff just those buckets. */
+#define kSOSManifestTreeDepth   10
+#define kSOSManifestTreeLeaves  ((size_t)1 << kSOSManifestTreeDepth)
+#define kSOSManifestTreeNodes   (2 * kSOSManifestTreeLeaves - 1)
+
+CFDataRef SOSManifestCopyTreeNodeHash(SOSManifestRef m, size_t node, CFErrorRef *error);
+SOSManifestRef SOSManifestCreateWithTreeLeaf(SOSManifestRef m, size_t leaf, CFErrorRef *error);
+
 __END_DECLS
 
 #endif /* !_SEC_SOSMANIFEST_H_ */
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ */
+
+#include <securityd/SecRevocationDb.h>
+#include <Security/SecCertificatePriv.h>
+#include <utilities/SecCFRelease.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "securityd_regressions.h"
+
+#define kTestCount 18
+
+/* A CA and two leaves it issued, so the second lookup finds the decoded filter
+   for the CA's group already cached, but misses the valid info cache. */
+static const uint8_t _ca[] = {
+    0x30, 0x82, 0x01, 0x87, 0x30, 0x82, 0x01, 0x2d, 0xa0, 0x03, 0x02, 0x01, 0x02, 0x02, 0x14, 0x51,
+    0x64, 0x39, 0x3a, 0x90, 0x2a, 0xcf, 0xb7, 0x19, 0x18, 0x8e, 0x2c, 0xa0, 0x62, 0x55, 0xae, 0xca,
+    0x75, 0xeb, 0x74, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x30,
+    0x18, 0x31, 0x16, 0x30, 0x14, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0d, 0x73, 0x64, 0x2d, 0x32,
+    0x30, 0x20, 0x54, 0x65, 0x73, 0x74, 0x20, 0x43, 0x41, 0x30, 0x20, 0x17, 0x0d, 0x32, 0x36, 0x31,
+    0x30, 0x31, 0x37, 0x30, 0x34, 0x30, 0x34, 0x33, 0x37, 0x5a, 0x18, 0x0f, 0x32, 0x31, 0x32, 0x36,
+    0x30, 0x39, 0x32, 0x33, 0x30, 0x34, 0x30, 0x34, 0x33, 0x37, 0x5a, 0x30, 0x18, 0x31, 0x16, 0x30,
+    0x14, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0d, 0x73, 0x64, 0x2d, 0x32, 0x30, 0x20, 0x54, 0x65,
+    0x73, 0x74, 0x20, 0x43, 0x41, 0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x02, 0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04,
+    0xdf, 0x4c, 0xe8, 0xa1, 0x40, 0x10, 0xa8, 0xdc, 0xea, 0x9d, 0x5b, 0xac, 0xa1, 0x48, 0xbd, 0x10,
+    0xf4, 0xd4, 0xf4, 0x9c, 0x1b, 0x39, 0xcb, 0xc1, 0x3b, 0x5b, 0x9d, 0x85, 0x48, 0x1e, 0xcc, 0x9c,
+    0x51, 0xb5, 0x57, 0x00, 0xdb, 0xd2, 0xf6, 0xb1, 0x8e, 0x95, 0x2a, 0x57, 0xd4, 0x6c, 0x71, 0x2b,
+    0x08, 0xfb, 0xfd, 0x1c, 0x37, 0xe4, 0x86, 0xa2, 0xca, 0x45, 0x61, 0xe8, 0x96, 0x91, 0x5c, 0x42,
+    0xa3, 0x53, 0x30, 0x51, 0x30, 0x1d, 0x06, 0x03, 0x55, 0x1d, 0x0e, 0x04, 0x16, 0x04, 0x14, 0xa7,
+    0x28, 0x9a, 0x48, 0x3e, 0x1b, 0xa7, 0x96, 0x1d, 0x6d, 0xab, 0x4f, 0xb9, 0xc2, 0xcb, 0xeb, 0x38,
+    0x0f, 0xe5, 0xad, 0x30, 0x1f, 0x06, 0x03, 0x55, 0x1d, 0x23, 0x04, 0x18, 0x30, 0x16, 0x80, 0x14,
+    0xa7, 0x28, 0x9a, 0x48, 0x3e, 0x1b, 0xa7, 0x96, 0x1d, 0x6d, 0xab, 0x4f, 0xb9, 0xc2, 0xcb, 0xeb,
+    0x38, 0x0f, 0xe5, 0xad, 0x30, 0x0f, 0x06, 0x03, 0x55, 0x1d, 0x13, 0x01, 0x01, 0xff, 0x04, 0x05,
+    0x30, 0x03, 0x01, 0x01, 0xff, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03,
+    0x02, 0x03, 0x48, 0x00, 0x30, 0x45, 0x02, 0x20, 0x7c, 0x24, 0xed, 0x91, 0xb8, 0x77, 0xb4, 0x54,
+    0xdd, 0x03, 0xa7, 0x66, 0x84, 0x68, 0xff, 0x28, 0x1f, 0xe0, 0x75, 0xd8, 0xf1, 0x3d, 0xc6, 0x61,
+    0x8e, 0xe4, 0x0e, 0x4a, 0xe5, 0xaa, 0x9d, 0xcc, 0x02, 0x21, 0x00, 0xfe, 0x16, 0x76, 0x30, 0x0f,
+    0x30, 0x85, 0x35, 0xcb, 0xc8, 0x65, 0xea, 0x5e, 0x03, 0x45, 0x26, 0x4b, 0xf9, 0xfc, 0x3c, 0xba,
+    0x6b, 0xd2, 0x28, 0x90, 0x1f, 0xee, 0x3d, 0xbc, 0xa1, 0x26, 0xb0,
+};
+static const uint8_t _leaf1[] = {
+    0x30, 0x82, 0x01, 0x18, 0x30, 0x81, 0xc0, 0x02, 0x02, 0x03, 0xe9, 0x30, 0x0a, 0x06, 0x08, 0x2a,
+    0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x30, 0x18, 0x31, 0x16, 0x30, 0x14, 0x06, 0x03, 0x55,
+    0x04, 0x03, 0x0c, 0x0d, 0x73, 0x64, 0x2d, 0x32, 0x30, 0x20, 0x54, 0x65, 0x73, 0x74, 0x20, 0x43,
+    0x41, 0x30, 0x20, 0x17, 0x0d, 0x32, 0x36, 0x31, 0x30, 0x31, 0x37, 0x30, 0x34, 0x30, 0x34, 0x33,
+    0x37, 0x5a, 0x18, 0x0f, 0x32, 0x31, 0x32, 0x36, 0x30, 0x39, 0x32, 0x33, 0x30, 0x34, 0x30, 0x34,
+    0x33, 0x37, 0x5a, 0x30, 0x17, 0x31, 0x15, 0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0c,
+    0x73, 0x64, 0x2d, 0x32, 0x30, 0x20, 0x4c, 0x65, 0x61, 0x66, 0x20, 0x31, 0x30, 0x59, 0x30, 0x13,
+    0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0xb8, 0xcd, 0x11, 0xfe, 0xee, 0x20, 0xc3, 0x78, 0x8a,
+    0x6d, 0xcb, 0x11, 0xdb, 0x05, 0x53, 0x20, 0x11, 0x74, 0x3b, 0xf0, 0x86, 0xe5, 0x97, 0x26, 0xdd,
+    0x4f, 0x5d, 0xdc, 0x15, 0x30, 0x0d, 0x47, 0x8d, 0xcb, 0x8d, 0xd9, 0x05, 0x34, 0xcc, 0xf4, 0x79,
+    0xf0, 0x00, 0x8f, 0x04, 0x04, 0x6c, 0xba, 0xe4, 0xec, 0x49, 0x2c, 0xa0, 0x91, 0x5d, 0x9e, 0xcd,
+    0xaf, 0x9b, 0x70, 0x8c, 0x05, 0xa2, 0x82, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x04, 0x03, 0x02, 0x03, 0x47, 0x00, 0x30, 0x44, 0x02, 0x20, 0x5a, 0x65, 0xba, 0x0a, 0xed, 0x56,
+    0xb7, 0x9c, 0xc5, 0xe1, 0x64, 0x98, 0xb6, 0x88, 0x5a, 0xa9, 0xc8, 0x0b, 0x2e, 0x86, 0x1d, 0x2f,
+    0xb9, 0x9c, 0xfa, 0x4d, 0xe0, 0xa1, 0x12, 0x27, 0x87, 0x36, 0x02, 0x20, 0x24, 0xf0, 0x90, 0xaa,
+    0x2f, 0x2a, 0x19, 0xfc, 0x3a, 0x06, 0x9c, 0x9b, 0x46, 0x62, 0x47, 0x12, 0x02, 0x58, 0xfb, 0x0a,
+    0xf9, 0x14, 0xd9, 0xbf, 0xe3, 0x27, 0x64, 0x14, 0x18, 0xf0, 0x13, 0xd0,
+};
+static const uint8_t _leaf2[] = {
+    0x30, 0x82, 0x01, 0x18, 0x30, 0x81, 0xc0, 0x02, 0x02, 0x03, 0xea, 0x30, 0x0a, 0x06, 0x08, 0x2a,
+    0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02, 0x30, 0x18, 0x31, 0x16, 0x30, 0x14, 0x06, 0x03, 0x55,
+    0x04, 0x03, 0x0c, 0x0d, 0x73, 0x64, 0x2d, 0x32, 0x30, 0x20, 0x54, 0x65, 0x73, 0x74, 0x20, 0x43,
+    0x41, 0x30, 0x20, 0x17, 0x0d, 0x32, 0x36, 0x31, 0x30, 0x31, 0x37, 0x30, 0x34, 0x30, 0x34, 0x33,
+    0x37, 0x5a, 0x18, 0x0f, 0x32, 0x31, 0x32, 0x36, 0x30, 0x39, 0x32, 0x33, 0x30, 0x34, 0x30, 0x34,
+    0x33, 0x37, 0x5a, 0x30, 0x17, 0x31, 0x15, 0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0c,
+    0x73, 0x64, 0x2d, 0x32, 0x30, 0x20, 0x4c, 0x65, 0x61, 0x66, 0x20, 0x32, 0x30, 0x59, 0x30, 0x13,
+    0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0x14, 0x29, 0xce, 0x3e, 0xfc, 0x2f, 0x12, 0xd0, 0x18,
+    0x8c, 0xcb, 0x54, 0xf5, 0xe5, 0xaa, 0xf9, 0xf0, 0x51, 0xa9, 0x0e, 0x2a, 0x73, 0x46, 0x52, 0x80,
+    0x41, 0x28, 0xbe, 0x85, 0xed, 0xa9, 0xe2, 0x88, 0xf4, 0xb3, 0x91, 0x88, 0x43, 0xe1, 0xf1, 0x38,
+    0xe1, 0x06, 0x22, 0xfa, 0xd7, 0xf9, 0x6e, 0x62, 0x7c, 0xd7, 0xec, 0x53, 0x57, 0x0f, 0x41, 0x75,
+    0xbe, 0x95, 0x6c, 0x41, 0xa9, 0xdf, 0x31, 0x30, 0x0a, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x04, 0x03, 0x02, 0x03, 0x47, 0x00, 0x30, 0x44, 0x02, 0x20, 0x78, 0x56, 0xcc, 0x25, 0xec, 0xd8,
+    0x18, 0x9f, 0xbc, 0x7e, 0x80, 0xcf, 0xdc, 0x9f, 0xa8, 0x99, 0x67, 0x9e, 0xa4, 0x6a, 0xf1, 0x30,
+    0x63, 0x54, 0xb5, 0x90, 0x72, 0x06, 0x82, 0x8c, 0x51, 0x79, 0x02, 0x20, 0x4a, 0x67, 0x78, 0x66,
+    0xf7, 0xc1, 0x2e, 0x09, 0xe9, 0xe3, 0x99, 0x00, 0x7a, 0xdf, 0xfd, 0x76, 0x32, 0x8a, 0xa0, 0x33,
+    0x6a, 0xd3, 0xf5, 0xc0, 0x19, 0x94, 0x30, 0x7e, 0xd5, 0x7d, 0x0c, 0xcd,
+};
+static const char *dbPath = "/tmp/sd-20-revocation-filter-cache.sqlite3";
+
+static void remove_db(void) {
+    const char *suffixes[] = { "", "-wal", "-shm", "-journal" };
+    for (size_t ix = 0; ix < sizeof(suffixes) / sizeof(suffixes[0]); ix++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%s", dbPath, suffixes[ix]);
+        (void) unlink(path);
+    }
+}
+
+/* An update for a single N-To-1 group whose filter bits are all 'xor'. */
+static CFDictionaryRef copy_filter_update(CFDataRef issuerHash, uint8_t xor) {
+    uint8_t bits[16];
+    memset(bits, xor, sizeof(bits));
+    CFDataRef xorData = CFDataCreate(NULL, bits, sizeof(bits));
+    int values[] = { 1, 2, 3 };
+    CFNumberRef numbers[3];
+    for (size_t ix = 0; ix < 3; ix++) {
+        numbers[ix] = CFNumberCreate(NULL, kCFNumberIntType, &values[ix]);
+    }
+    CFArrayRef params = CFArrayCreate(NULL, (const void **)numbers, 3, &kCFTypeArrayCallBacks);
+    CFArrayRef issuers = CFArrayCreate(NULL, (const void **)&issuerHash, 1, &kCFTypeArrayCallBacks);
+
+    const void *groupKeys[] = { CFSTR("issuer-hash"), CFSTR("format"), CFSTR("xor"), CFSTR("params") };
+    const void *groupValues[] = { issuers, CFSTR("nto1"), xorData, params };
+    CFDictionaryRef group = CFDictionaryCreate(NULL, groupKeys, groupValues, 4,
+                                               &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFArrayRef groups = CFArrayCreate(NULL, (const void **)&group, 1, &kCFTypeArrayCallBacks);
+    const void *updateKeys[] = { CFSTR("update") };
+    const void *updateValues[] = { groups };
+    CFDictionaryRef update = CFDictionaryCreate(NULL, updateKeys, updateValues, 1,
+                                                &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+    CFReleaseNull(groups);
+    CFReleaseNull(group);
+    CFReleaseNull(issuers);
+    CFReleaseNull(params);
+    for (size_t ix = 0; ix < 3; ix++) {
+        CFReleaseNull(numbers[ix]);
+    }
+    CFReleaseNull(xorData);
+    return update;
+}
+
+/* Valid info cache hits and misses so far; two tests. With a fresh database
+   and only two certificates, nothing is ever evicted. */
+static void is_counts(SecRevocationDbRef rdb, uint64_t hits, uint64_t misses, const char *description) {
+    uint64_t actualHits = UINT64_MAX, actualMisses = UINT64_MAX, evictions = UINT64_MAX;
+    SecRevocationDbGetCacheCountsWithDb(rdb, &actualHits, &actualMisses, &evictions);
+    ok(actualHits == hits && actualMisses == misses, "%s (hits=%llu, misses=%llu)", description,
+       (unsigned long long)actualHits, (unsigned long long)actualMisses);
+    is(evictions, (uint64_t)0, "no evictions");
+}
+
+static bool is_on_list(SecRevocationDbRef rdb, SecCertificateRef leaf, SecCertificateRef ca) {
+    SecValidInfoRef info = SecRevocationDbCopyMatchingWithDb(rdb, leaf, ca);
+    bool result = (info && info->isOnList);
+    CFReleaseNull(info);
+    return result;
+}
+
+static void tests(void)
+{
+    CFErrorRef error = NULL;
+    SecCertificateRef ca = SecCertificateCreateWithBytes(NULL, _ca, sizeof(_ca));
+    SecCertificateRef leaf1 = SecCertificateCreateWithBytes(NULL, _leaf1, sizeof(_leaf1));
+    SecCertificateRef leaf2 = SecCertificateCreateWithBytes(NULL, _leaf2, sizeof(_leaf2));
+    ok(ca && leaf1 && leaf2, "create certificates");
+    CFDataRef issuerHash = ca ? SecCertificateCopySHA256Digest(ca) : NULL;
+
+    remove_db();
+    CFStringRef path = CFStringCreateWithCString(NULL, dbPath, kCFStringEncodingUTF8);
+    SecRevocationDbRef rdb = SecRevocationDbCreateWithPath(path);
+    CFReleaseNull(path);
+    ok(rdb, "create revocation db");
+
+    /* every bit set: any serial matches */
+    CFDictionaryRef update = copy_filter_update(issuerHash, 0xFF);
+    ok(SecRevocationDbApplyUpdateWithDb(rdb, update, 1, &error), "add group: %@", error);
+    CFReleaseNull(error);
+    CFReleaseNull(update);
+    ok(is_on_list(rdb, leaf1, ca), "leaf 1 matches the all-ones filter");
+    is_counts(rdb, 0, 1, "first lookup misses the valid info cache");
+    ok(is_on_list(rdb, leaf1, ca), "leaf 1 still matches");
+    is_counts(rdb, 1, 1, "repeated lookup hits the valid info cache");
+
+    /* xor'ing the same bits again clears them: no serial matches */
+    update = copy_filter_update(issuerHash, 0xFF);
+    ok(SecRevocationDbApplyUpdateWithDb(rdb, update, 2, &error), "update group: %@", error);
+    CFReleaseNull(error);
+    CFReleaseNull(update);
+    ok(!is_on_list(rdb, leaf2, ca), "leaf 2 is checked against the updated filter, not the cached one");
+    ok(!is_on_list(rdb, leaf1, ca), "leaf 1 is no longer on the list");
+    is_counts(rdb, 1, 3, "committed update dropped the cached entries, but not the counts");
+    ok(!is_on_list(rdb, leaf1, ca), "leaf 1 is still not on the list");
+    is_counts(rdb, 2, 3, "entry cached after the update is hit");
+
+    /* and again, so the cache has to pick up the new filter a second time */
+    update = copy_filter_update(issuerHash, 0xFF);
+    (void) SecRevocationDbApplyUpdateWithDb(rdb, update, 3, NULL);
+    CFReleaseNull(update);
+    ok(is_on_list(rdb, leaf2, ca), "leaf 2 matches the restored filter");
+
+    SecRevocationDbDispose(rdb);
+    remove_db();
+    CFReleaseNull(issuerHash);
+    CFReleaseNull(leaf2);
+    CFReleaseNull(leaf1);
+    CFReleaseNull(ca);
+}
+
+int sd_20_revocation_filter_cache(int argc, char *const *argv)
+{
+    plan_tests(kTestCount);
+
+    tests();
+
+    return 0;
+}
@@ -5,3 +5,4 @@
 #include <regressions/test/testmore.h>
 
 ONE_TEST(sd_10_policytree)
+ONE_TEST(sd_20_revocation_filter_cache)
@@ -171,6 +171,71 @@ static CFArrayRef CopyCertsFromIndices(CFArrayRef offsets)
     return result;
 
 }
+
+/* Parsed system anchors for each normalized subject we have been asked about,
+   so trust evaluations stop re-parsing the same anchor DER every time.  Only
+   subjects that have anchors get an entry, which bounds the cache by the size
+   of the anchor table.  Entries are immutable arrays of SecCertificateRef and
+   the whole cache is dropped when the OTAPKI asset or trust store changes. */
+static dispatch_queue_t sAnchorCacheQueue = NULL;
+static CFMutableDictionaryRef sAnchorCache = NULL;   // normalized subject -> CFArray of SecCertificateRef
+static uint64_t sAnchorCacheAssetVersion = 0;
+static uint64_t sAnchorCacheTrustStoreVersion = 0;
+
+static CFArrayRef CopySystemAnchorsForSubject(SecOTAPKIRef otapkiref, CFDataRef nic)
+{
+    __block CFArrayRef result = NULL;
+
+    if (NULL == otapkiref || NULL == nic)
+    {
+        return result;
+    }
+
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sAnchorCacheQueue = dispatch_queue_create("com.apple.trustd.anchorcache", DISPATCH_QUEUE_SERIAL);
+    });
+
+    uint64_t assetVersion = SecOTAPKIGetAssetVersion(otapkiref);
+    uint64_t trustStoreVersion = SecOTAPKIGetTrustStoreVersion(otapkiref);
+
+    dispatch_sync(sAnchorCacheQueue, ^{
+        if (NULL == sAnchorCache ||
+            sAnchorCacheAssetVersion != assetVersion ||
+            sAnchorCacheTrustStoreVersion != trustStoreVersion)
+        {
+            CFReleaseNull(sAnchorCache);
+            sAnchorCache = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                                     &kCFTypeDictionaryKeyCallBacks,
+                                                     &kCFTypeDictionaryValueCallBacks);
+            sAnchorCacheAssetVersion = assetVersion;
+            sAnchorCacheTrustStoreVersion = trustStoreVersion;
+        }
+        if (NULL == sAnchorCache)
+        {
+            return;
+        }
+
+        result = (CFArrayRef)CFDictionaryGetValue(sAnchorCache, nic);
+        if (NULL == result)
+        {
+            CFArrayRef offsets = subject_to_anchors(nic);
+            CFArrayRef parsed = offsets ? CopyCertsFromIndices(offsets) : NULL;
+            /* CopyCertsFromIndices builds a mutable array; cache (and hand out) an immutable copy */
+            CFArrayRef anchors = parsed ? CFArrayCreateCopy(kCFAllocatorDefault, parsed) : NULL;
+            CFReleaseNull(parsed);
+            if (NULL != anchors)
+            {
+                CFDictionarySetValue(sAnchorCache, nic, anchors);
+                CFRelease(anchors);
+                result = anchors;
+            }
+        }
+        CFRetainSafe(result);
+    });
+
+    return result;
+}
 //#endif // SECITEM_SHIM_OSX
 
 /********************************************************
@@ -300,7 +365,6 @@ static bool SecSystemAnchorSourceCopyParents(SecCertificateSourceRef source, Sec
                                              void *context, SecCertificateSourceParents callback) {
     //#ifndef SECITEM_SHIM_OSX
     CFArrayRef parents = NULL;
-    CFArrayRef anchors = NULL;
     SecOTAPKIRef otapkiref = NULL;
 
     CFDataRef nic = SecCertificateGetNormalizedIssuerContent(certificate);
@@ -310,9 +374,7 @@ static bool SecSystemAnchorSourceCopyParents(SecCertificateSourceRef source, Sec
 
     otapkiref = SecOTAPKICopyCurrentOTAPKIRef();
     require_quiet(otapkiref, errOut);
-    anchors = subject_to_anchors(nic);
-    require_quiet(anchors, errOut);
-    parents = CopyCertsFromIndices(anchors);
+    parents = CopySystemAnchorsForSubject(otapkiref, nic);
 
 errOut:
     callback(context, parents);
@@ -367,7 +429,6 @@ static bool SecSystemAnchorSourceContains(SecCertificateSourceRef source,
     bool result = false;
     CFArrayRef anchors = NULL;
     SecOTAPKIRef otapkiref = NULL;
-    CFArrayRef cert_datas = NULL;
 
     CFDataRef nic = SecCertificateGetNormalizedSubjectContent(certificate);
     /* 64 bits cast: the worst that can happen here is we truncate the length and match an actual anchor.
@@ -376,40 +437,14 @@ static bool SecSystemAnchorSourceContains(SecCertificateSourceRef source,
 
     otapkiref = SecOTAPKICopyCurrentOTAPKIRef();
     require_quiet(otapkiref, errOut);
-    anchors = subject_to_anchors(nic);
+    anchors = CopySystemAnchorsForSubject(otapkiref, nic);
     require_quiet(anchors, errOut);
-    cert_datas = CopyCertDataFromIndices(anchors);
-    require_quiet(cert_datas, errOut);
 
-    CFIndex cert_length = SecCertificateGetLength(certificate);
-    const UInt8 *cert_data_ptr = SecCertificateGetBytePtr(certificate);
-
-    CFIndex num_cert_datas = CFArrayGetCount(cert_datas);
-    for (CFIndex idx = 0; idx < num_cert_datas; idx++)
-    {
-        CFDataRef cert_data = (CFDataRef)CFArrayGetValueAtIndex(cert_datas, idx);
-
-        if (NULL != cert_data)
-        {
-            if (CFGetTypeID(cert_data) == CFDataGetTypeID())
-            {
-                CFIndex  aCert_Length = CFDataGetLength(cert_data);
-                const UInt8*  aCert_Data_Ptr = CFDataGetBytePtr(cert_data);
-
-                if (aCert_Length == cert_length)
-                {
-                    if (!memcmp(cert_data_ptr, aCert_Data_Ptr, cert_length))
-                    {
-                        result = true;
-                        break;
-                    }
-                }
-            }
-        }
-    }
+    /* SecCertificate equality compares the DER */
+    result = CFArrayContainsValue(anchors, CFRangeMake(0, CFArrayGetCount(anchors)), certificate);
 
 errOut:
-    CFReleaseSafe(cert_datas);
+    CFReleaseSafe(anchors);
     CFReleaseSafe(otapkiref);
     return result;
 }
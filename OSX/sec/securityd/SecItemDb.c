@@ -1445,7 +1445,7 @@ static bool DeleteAllFromTableForMUSRView(SecDbConnectionRef dbt,
 
 fail:
     if (stmt) {
-        ok = SecDbFinalize(stmt, error);
+        ok = SecDbReleaseCachedStmt(dbt, sql2, stmt, error);
     }
     if (!ok)
         secwarning("DeleteAllFromTableForMUSRView failed for %@ for musr: %@: %@", sql2, musr, error ? *error : NULL);
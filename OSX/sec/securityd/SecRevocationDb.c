@@ -78,6 +78,7 @@ static CFStringRef kSecPrefsDomain          = CFSTR("com.apple.security");
 static CFStringRef kUpdateServerKey         = CFSTR("ValidUpdateServer");
 static CFStringRef kUpdateEnabledKey        = CFSTR("ValidUpdateEnabled");
 static CFStringRef kUpdateIntervalKey       = CFSTR("ValidUpdateInterval");
+static CFStringRef kInfoCacheSizeKey        = CFSTR("ValidInfoCacheSize");
 static CFStringRef kBoolTrueKey             = CFSTR("1");
 static CFStringRef kBoolFalseKey            = CFSTR("0");
 
@@ -143,18 +144,42 @@ CF_ENUM(CFIndex) {
 #define kSecRevocationDbUpdateFormat        3  /* current version we support */
 #define kSecRevocationDbMinUpdateFormat     2  /* minimum version we can use */
 
-#define kSecRevocationDbCacheSize           100
+#define kSecRevocationDbCacheSize           1024 /* default; see kInfoCacheSizeKey */
+#define kSecRevocationDbCacheShards         16   /* power of two */
+#define kSecRevocationDbFilterCacheSize     64   /* decoded N-To-1 filters */
+
+/* valid info cache: one hashed, doubly-linked LRU list per shard.
+   Entries are sharded on the first byte of the (SHA-256) cache key. */
+typedef struct __SecRevocationDbCacheEntry *SecRevocationDbCacheEntryRef;
+struct __SecRevocationDbCacheEntry {
+    CFDataRef cacheKey;
+    SecValidInfoRef validInfo;
+    SecRevocationDbCacheEntryRef prev;      /* toward most recently used */
+    SecRevocationDbCacheEntryRef next;      /* toward least recently used */
+};
+
+typedef struct {
+    os_unfair_lock lock;
+    CFMutableDictionaryRef entries;         /* cacheKey -> SecRevocationDbCacheEntryRef */
+    SecRevocationDbCacheEntryRef mru;
+    SecRevocationDbCacheEntryRef lru;
+    CFIndex count;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} SecRevocationDbCacheShard;
 
-typedef struct __SecRevocationDb *SecRevocationDbRef;
 struct __SecRevocationDb {
     SecDbRef db;
     dispatch_queue_t update_queue;
     bool updateInProgress;
     bool unsupportedVersion;
     bool changed;
-    CFMutableArrayRef info_cache_list;
-    CFMutableDictionaryRef info_cache;
-    os_unfair_lock info_cache_lock;
+    SecRevocationDbCacheShard info_cache[kSecRevocationDbCacheShards];
+    CFIndex info_cache_shard_size;
+    CFMutableDictionaryRef filter_cache;
+    uint64_t filter_cache_generation;       /* bumped each time the filters are invalidated */
+    os_unfair_lock filter_cache_lock;
 };
 
 typedef struct __SecRevocationDbConnection *SecRevocationDbConnectionRef;
@@ -164,6 +189,7 @@ struct __SecRevocationDbConnection {
     CFIndex precommitVersion;
     CFIndex precommitDbVersion;
     bool fullUpdate;
+    bool purgeCaches;                       /* purge in-memory caches after commit */
 };
 
 bool SecRevocationDbVerifyUpdate(void *update, CFIndex length);
@@ -1329,9 +1355,8 @@ setVersionAndExit:
 
 /* Database management */
 
-static SecDbRef SecRevocationDbCreate(CFStringRef path) {
+static SecDbRef SecRevocationDbCreate(CFStringRef path, bool readWrite) {
     /* only the db owner should open a read-write connection. */
-    __block bool readWrite = isDbOwner();
     mode_t mode = 0644;
 
     SecDbRef result = SecDbCreate(path, mode, readWrite, false, true, true, 1, ^bool (SecDbRef db, SecDbConnectionRef dbconn, bool didCreate, bool *callMeAgainForNextConnection, CFErrorRef *error) {
@@ -1358,10 +1383,15 @@ static SecDbRef SecRevocationDbCreate(CFStringRef path) {
     return result;
 }
 
+static bool SecRevocationDbCacheInit(SecRevocationDbRef rdb);
+static void SecRevocationDbCacheDestroy(SecRevocationDbRef rdb);
+static void SecRevocationDbCachePurge(SecRevocationDbRef db);
+static void SecRevocationDbFilterCacheInvalidate(SecRevocationDbRef db);
+
 static dispatch_once_t kSecRevocationDbOnce;
 static SecRevocationDbRef kSecRevocationDb = NULL;
 
-static SecRevocationDbRef SecRevocationDbInit(CFStringRef db_name) {
+static SecRevocationDbRef SecRevocationDbInit(CFStringRef db_name, bool owner) {
     SecRevocationDbRef rdb;
     dispatch_queue_attr_t attr;
 
@@ -1371,16 +1401,19 @@ static SecRevocationDbRef SecRevocationDbInit(CFStringRef db_name) {
     rdb->updateInProgress = false;
     rdb->unsupportedVersion = false;
     rdb->changed = false;
+    rdb->filter_cache = NULL;
+    rdb->filter_cache_generation = 0;
+    memset(rdb->info_cache, 0, sizeof(rdb->info_cache));
 
-    require(rdb->db = SecRevocationDbCreate(db_name), errOut);
+    require(rdb->db = SecRevocationDbCreate(db_name, owner), errOut);
     attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_BACKGROUND, 0);
     attr = dispatch_queue_attr_make_with_autorelease_frequency(attr, DISPATCH_AUTORELEASE_FREQUENCY_WORK_ITEM);
     require(rdb->update_queue = dispatch_queue_create(NULL, attr), errOut);
-    require(rdb->info_cache_list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks), errOut);
-    require(rdb->info_cache = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), errOut);
-    rdb->info_cache_lock = OS_UNFAIR_LOCK_INIT;
+    require(SecRevocationDbCacheInit(rdb), errOut);
+    require(rdb->filter_cache = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), errOut);
+    rdb->filter_cache_lock = OS_UNFAIR_LOCK_INIT;
 
-    if (!isDbOwner()) {
+    if (!owner) {
         /* register for changes signaled by the db owner instance */
         int out_token = 0;
         notify_register_dispatch(kSecRevocationDbChanged, &out_token, rdb->update_queue, ^(int __unused token) {
@@ -1397,6 +1430,8 @@ errOut:
             dispatch_release(rdb->update_queue);
         }
         CFReleaseSafe(rdb->db);
+        SecRevocationDbCacheDestroy(rdb);
+        CFReleaseSafe(rdb->filter_cache);
         free(rdb);
     }
     return NULL;
@@ -1422,7 +1457,7 @@ static void SecRevocationDbWith(void(^dbJob)(SecRevocationDbRef db)) {
     dispatch_once(&kSecRevocationDbOnce, ^{
         CFStringRef dbPath = SecRevocationDbCopyPath();
         if (dbPath) {
-            kSecRevocationDb = SecRevocationDbInit(dbPath);
+            kSecRevocationDb = SecRevocationDbInit(dbPath, isDbOwner());
             CFRelease(dbPath);
             if (kSecRevocationDb && isDbOwner()) {
                 /* check and update schema immediately after database is opened */
@@ -1441,6 +1476,7 @@ static void SecRevocationDbWith(void(^dbJob)(SecRevocationDbRef db)) {
 static bool SecRevocationDbPerformWrite(SecRevocationDbRef rdb, CFErrorRef *error,
                                         bool(^writeJob)(SecRevocationDbConnectionRef dbc, CFErrorRef *blockError)) {
     __block bool ok = true;
+    __block bool purgeCaches = false;
     __block CFErrorRef localError = NULL;
 
     ok &= SecDbPerformWrite(rdb->db, &localError, ^(SecDbConnectionRef dbconn) {
@@ -1448,10 +1484,16 @@ static bool SecRevocationDbPerformWrite(SecRevocationDbRef rdb, CFErrorRef *erro
             SecRevocationDbConnectionRef dbc = SecRevocationDbConnectionInit(rdb, dbconn, &localError);
             ok = ok && writeJob(dbc, &localError);
             *commit = ok;
+            purgeCaches = (dbc && dbc->purgeCaches);
             free(dbc);
         });
     });
     ok &= CFErrorPropagate(localError, error);
+    /* Readers see the old records until the transaction commits, and could
+       cache them again if we purged any earlier. */
+    if (ok && purgeCaches) {
+        SecRevocationDbCachePurge(rdb);
+    }
     return ok;
 }
 
@@ -1480,6 +1522,7 @@ static SecRevocationDbConnectionRef SecRevocationDbConnectionInit(SecRevocationD
         dbc->precommitVersion = _SecRevocationDbGetVersion(dbc, &localError);
         dbc->precommitDbVersion = _SecRevocationDbGetSchemaVersion(db, dbc, &localError);
         dbc->fullUpdate = false;
+        dbc->purgeCaches = false;
     }
     (void) CFErrorPropagate(localError, error);
     return dbc;
@@ -1493,6 +1536,102 @@ static CF_RETURNS_RETAINED CFDataRef createCacheKey(CFDataRef certHash, CFDataRe
     return result;
 }
 
+static CFIndex SecRevocationDbCacheCapacity(void) {
+    // allow pref to override the total number of cached entries, if it exists
+    CFIndex capacity = kSecRevocationDbCacheSize;
+    CFTypeRef value = (CFNumberRef)CFPreferencesCopyValue(kInfoCacheSizeKey, kSecPrefsDomain, kCFPreferencesAnyUser, kCFPreferencesCurrentHost);
+    if (isNumber(value)) {
+        CFIndex size = 0;
+        if (CFNumberGetValue((CFNumberRef)value, kCFNumberCFIndexType, &size) && size > 0) {
+            capacity = size;
+        }
+    }
+    CFReleaseNull(value);
+    return capacity;
+}
+
+static bool SecRevocationDbCacheInit(SecRevocationDbRef rdb) {
+    CFIndex capacity = SecRevocationDbCacheCapacity();
+    rdb->info_cache_shard_size = (capacity + kSecRevocationDbCacheShards - 1) / kSecRevocationDbCacheShards;
+    for (CFIndex ix = 0; ix < kSecRevocationDbCacheShards; ix++) {
+        SecRevocationDbCacheShard *shard = &rdb->info_cache[ix];
+        memset(shard, 0, sizeof(*shard));
+        shard->lock = OS_UNFAIR_LOCK_INIT;
+        /* values are entry pointers owned by the shard list */
+        shard->entries = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+        if (!shard->entries) {
+            return false;
+        }
+    }
+    secdebug("validcache", "cache capacity: %ld (%d shards)", (long)capacity, kSecRevocationDbCacheShards);
+    return true;
+}
+
+static SecRevocationDbCacheShard *SecRevocationDbCacheGetShard(SecRevocationDbRef db, CFDataRef cacheKey) {
+    uint8_t prefix = (cacheKey && CFDataGetLength(cacheKey) > 0) ? CFDataGetBytePtr(cacheKey)[0] : 0;
+    return &db->info_cache[prefix & (kSecRevocationDbCacheShards - 1)];
+}
+
+static void SecRevocationDbCacheShardUnlink(SecRevocationDbCacheShard *shard, SecRevocationDbCacheEntryRef entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        shard->mru = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard->lru = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void SecRevocationDbCacheShardPushFront(SecRevocationDbCacheShard *shard, SecRevocationDbCacheEntryRef entry) {
+    entry->prev = NULL;
+    entry->next = shard->mru;
+    if (shard->mru) {
+        shard->mru->prev = entry;
+    } else {
+        shard->lru = entry;
+    }
+    shard->mru = entry;
+}
+
+/* caller must hold the shard lock */
+static void SecRevocationDbCacheShardRemove(SecRevocationDbCacheShard *shard, SecRevocationDbCacheEntryRef entry) {
+    SecRevocationDbCacheShardUnlink(shard, entry);
+    CFDictionaryRemoveValue(shard->entries, entry->cacheKey);
+    shard->count--;
+    CFReleaseSafe(entry->cacheKey);
+    CFReleaseSafe(entry->validInfo);
+    free(entry);
+}
+
+/* caller must hold the shard lock */
+static void SecRevocationDbCacheShardRemoveAll(SecRevocationDbCacheShard *shard) {
+    SecRevocationDbCacheEntryRef entry = shard->mru;
+    while (entry) {
+        SecRevocationDbCacheEntryRef next = entry->next;
+        CFReleaseSafe(entry->cacheKey);
+        CFReleaseSafe(entry->validInfo);
+        free(entry);
+        entry = next;
+    }
+    CFDictionaryRemoveAllValues(shard->entries);
+    shard->mru = shard->lru = NULL;
+    shard->count = 0;
+}
+
+static void SecRevocationDbCacheDestroy(SecRevocationDbRef rdb) {
+    for (CFIndex ix = 0; ix < kSecRevocationDbCacheShards; ix++) {
+        SecRevocationDbCacheShard *shard = &rdb->info_cache[ix];
+        if (shard->entries) {
+            SecRevocationDbCacheShardRemoveAll(shard);
+            CFReleaseNull(shard->entries);
+        }
+    }
+}
+
 static CF_RETURNS_RETAINED SecValidInfoRef SecRevocationDbCacheRead(SecRevocationDbRef db,
                                                                      SecCertificateRef certificate,
                                                                      CFDataRef issuerHash) {
@@ -1500,34 +1639,37 @@ static CF_RETURNS_RETAINED SecValidInfoRef SecRevocationDbCacheRead(SecRevocatio
         return NULL;
     }
     SecValidInfoRef result = NULL;
-    if (!db || !db->info_cache || !db->info_cache_list) {
-        return result;
-    }
-    CFIndex ix = kCFNotFound;
     CFDataRef certHash = SecCertificateCopySHA256Digest(certificate);
     CFDataRef cacheKey = createCacheKey(certHash, issuerHash);
+    if (!cacheKey) {
+        CFReleaseSafe(certHash);
+        return NULL;
+    }
+    SecRevocationDbCacheShard *shard = SecRevocationDbCacheGetShard(db, cacheKey);
 
-    os_unfair_lock_lock(&db->info_cache_lock); // grab the cache lock before using the cache
-    if (0 <= (ix = CFArrayGetFirstIndexOfValue(db->info_cache_list,
-                                               CFRangeMake(0, CFArrayGetCount(db->info_cache_list)),
-                                               cacheKey))) {
-        result = (SecValidInfoRef)CFDictionaryGetValue(db->info_cache, cacheKey);
+    os_unfair_lock_lock(&shard->lock); // grab the shard lock before using the cache
+    SecRevocationDbCacheEntryRef entry = (SecRevocationDbCacheEntryRef)CFDictionaryGetValue(shard->entries, cacheKey);
+    if (entry) {
         // Verify this really is the right result
-        if (CFEqualSafe(result->certHash, certHash) && CFEqualSafe(result->issuerHash, issuerHash)) {
-            // Cache hit. Move the entry to the bottom of the list.
-            CFArrayRemoveValueAtIndex(db->info_cache_list, ix);
-            CFArrayAppendValue(db->info_cache_list, cacheKey);
+        if (CFEqualSafe(entry->validInfo->certHash, certHash) && CFEqualSafe(entry->validInfo->issuerHash, issuerHash)) {
+            // Cache hit. Move the entry to the front of the list.
+            SecRevocationDbCacheShardUnlink(shard, entry);
+            SecRevocationDbCacheShardPushFront(shard, entry);
+            result = entry->validInfo;
+            CFRetainSafe(result);
+            shard->hits++;
             secdebug("validcache", "cache hit: %@", cacheKey);
         } else {
             // Just remove this bad entry
-            CFArrayRemoveValueAtIndex(db->info_cache_list, ix);
-            CFDictionaryRemoveValue(db->info_cache, cacheKey);
+            SecRevocationDbCacheShardRemove(shard, entry);
+            shard->misses++;
             secdebug("validcache", "cache remove bad: %@", cacheKey);
-            secnotice("validcache", "found a bad valid info cache entry at %ld", (long)ix);
+            secnotice("validcache", "found a bad valid info cache entry");
         }
+    } else {
+        shard->misses++;
     }
-    CFRetainSafe(result);
-    os_unfair_lock_unlock(&db->info_cache_lock);
+    os_unfair_lock_unlock(&shard->lock);
     CFReleaseSafe(certHash);
     CFReleaseSafe(cacheKey);
     return result;
@@ -1535,42 +1677,144 @@ static CF_RETURNS_RETAINED SecValidInfoRef SecRevocationDbCacheRead(SecRevocatio
 
 static void SecRevocationDbCacheWrite(SecRevocationDbRef db,
                                        SecValidInfoRef validInfo) {
-    if (!db || !validInfo || !db->info_cache || !db->info_cache_list) {
+    if (!db || !validInfo) {
         return;
     }
 
     CFDataRef cacheKey = createCacheKey(validInfo->certHash, validInfo->issuerHash);
+    if (!cacheKey) {
+        return;
+    }
+    SecRevocationDbCacheShard *shard = SecRevocationDbCacheGetShard(db, cacheKey);
 
-    os_unfair_lock_lock(&db->info_cache_lock); // grab the cache lock before using the cache
+    os_unfair_lock_lock(&shard->lock); // grab the shard lock before using the cache
     // check to make sure another thread didn't add this entry to the cache already
-    if (0 > CFArrayGetFirstIndexOfValue(db->info_cache_list,
-                                        CFRangeMake(0, CFArrayGetCount(db->info_cache_list)),
-                                        cacheKey)) {
-        CFDictionaryAddValue(db->info_cache, cacheKey, validInfo);
-        if (kSecRevocationDbCacheSize <= CFArrayGetCount(db->info_cache_list)) {
-            // Remove least recently used cache entry.
-            secdebug("validcache", "cache remove stale: %@", CFArrayGetValueAtIndex(db->info_cache_list, 0));
-            CFDictionaryRemoveValue(db->info_cache, CFArrayGetValueAtIndex(db->info_cache_list, 0));
-            CFArrayRemoveValueAtIndex(db->info_cache_list, 0);
-        }
-        CFArrayAppendValue(db->info_cache_list, cacheKey);
-        secdebug("validcache", "cache add: %@", cacheKey);
-    }
-    os_unfair_lock_unlock(&db->info_cache_lock);
+    if (!CFDictionaryContainsKey(shard->entries, cacheKey)) {
+        SecRevocationDbCacheEntryRef entry = (SecRevocationDbCacheEntryRef)malloc(sizeof(*entry));
+        if (entry) {
+            if (db->info_cache_shard_size <= shard->count && shard->lru) {
+                // Remove least recently used cache entry.
+                secdebug("validcache", "cache remove stale: %@", shard->lru->cacheKey);
+                SecRevocationDbCacheShardRemove(shard, shard->lru);
+                shard->evictions++;
+            }
+            entry->cacheKey = CFRetainSafe(cacheKey);
+            entry->validInfo = CFRetainSafe(validInfo);
+            CFDictionaryAddValue(shard->entries, cacheKey, entry);
+            SecRevocationDbCacheShardPushFront(shard, entry);
+            shard->count++;
+            secdebug("validcache", "cache add: %@", cacheKey);
+        }
+    }
+    os_unfair_lock_unlock(&shard->lock);
     CFReleaseNull(cacheKey);
 }
 
+static void SecRevocationDbCacheGetCounts(SecRevocationDbRef db, uint64_t *hits, uint64_t *misses, uint64_t *evictions) {
+    uint64_t totalHits = 0, totalMisses = 0, totalEvictions = 0;
+    for (CFIndex ix = 0; db && ix < kSecRevocationDbCacheShards; ix++) {
+        SecRevocationDbCacheShard *shard = &db->info_cache[ix];
+        os_unfair_lock_lock(&shard->lock);
+        totalHits += shard->hits;
+        totalMisses += shard->misses;
+        totalEvictions += shard->evictions;
+        os_unfair_lock_unlock(&shard->lock);
+    }
+    if (hits) { *hits = totalHits; }
+    if (misses) { *misses = totalMisses; }
+    if (evictions) { *evictions = totalEvictions; }
+}
+
 static void SecRevocationDbCachePurge(SecRevocationDbRef db) {
-    if (!db || !db->info_cache || !db->info_cache_list) {
+    if (!db) {
         return;
     }
 
-    /* grab the cache lock and clear all entries */
-    os_unfair_lock_lock(&db->info_cache_lock);
-    CFArrayRemoveAllValues(db->info_cache_list);
-    CFDictionaryRemoveAllValues(db->info_cache);
-    secdebug("validcache", "cache purge");
-    os_unfair_lock_unlock(&db->info_cache_lock);
+    /* grab each shard lock and clear all entries; counters are cumulative */
+    for (CFIndex ix = 0; ix < kSecRevocationDbCacheShards; ix++) {
+        SecRevocationDbCacheShard *shard = &db->info_cache[ix];
+        os_unfair_lock_lock(&shard->lock);
+        SecRevocationDbCacheShardRemoveAll(shard);
+        os_unfair_lock_unlock(&shard->lock);
+    }
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    SecRevocationDbCacheGetCounts(db, &hits, &misses, &evictions);
+    secdebug("validcache", "cache purge (hits=%llu, misses=%llu, evictions=%llu)",
+             (unsigned long long)hits, (unsigned long long)misses, (unsigned long long)evictions);
+
+    /* decoded filters are keyed by groupId, which a full update can reassign */
+    SecRevocationDbFilterCacheInvalidate(db);
+}
+
+/* Decoded N-To-1 filter. The flattened 'xor' and 'params' plist stored in the
+   group record is inflated and parsed once per group, then kept as a CFData
+   containing this header, the parameter vector and the filter bits. */
+typedef struct {
+    uint32_t paramCount;
+    uint32_t bitsLength;    /* in bytes; follows the params */
+    uint32_t params[];
+} SecRevocationDbFilter;
+
+static const uint8_t *SecRevocationDbFilterGetBits(const SecRevocationDbFilter *filter) {
+    return (const uint8_t *)&filter->params[filter->paramCount];
+}
+
+static CFNumberRef SecRevocationDbFilterCacheKey(int64_t groupId) {
+    return CFNumberCreate(NULL, kCFNumberSInt64Type, &groupId);
+}
+
+/* Returns the current generation of the filter cache. A caller which reads
+   a group's data from the database must fetch this first, and pass it to
+   SecRevocationDbFilterCacheWrite, so that a filter decoded from records
+   replaced in the meantime is never cached. */
+static uint64_t SecRevocationDbFilterCacheGeneration(SecRevocationDbRef db) {
+    if (!db || !db->filter_cache) {
+        return 0;
+    }
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    uint64_t generation = db->filter_cache_generation;
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+    return generation;
+}
+
+static CF_RETURNS_RETAINED CFDataRef SecRevocationDbFilterCacheRead(SecRevocationDbRef db, int64_t groupId) {
+    if (!db || !db->filter_cache) {
+        return NULL;
+    }
+    CFNumberRef cacheKey = SecRevocationDbFilterCacheKey(groupId);
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    CFDataRef result = CFRetainSafe(CFDictionaryGetValue(db->filter_cache, cacheKey));
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+    CFReleaseSafe(cacheKey);
+    return result;
+}
+
+static void SecRevocationDbFilterCacheWrite(SecRevocationDbRef db, int64_t groupId, CFDataRef filter, uint64_t generation) {
+    if (!db || !db->filter_cache || !filter) {
+        return;
+    }
+    CFNumberRef cacheKey = SecRevocationDbFilterCacheKey(groupId);
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    if (generation == db->filter_cache_generation) {
+        /* the working set is a handful of groups; start over rather than
+           track recency if a scan of many issuers fills the cache */
+        if (CFDictionaryGetCount(db->filter_cache) >= kSecRevocationDbFilterCacheSize) {
+            CFDictionaryRemoveAllValues(db->filter_cache);
+        }
+        CFDictionaryAddValue(db->filter_cache, cacheKey, filter);
+    }
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+    CFReleaseSafe(cacheKey);
+}
+
+static void SecRevocationDbFilterCacheInvalidate(SecRevocationDbRef db) {
+    if (!db || !db->filter_cache) {
+        return;
+    }
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    CFDictionaryRemoveAllValues(db->filter_cache);
+    db->filter_cache_generation++;
+    os_unfair_lock_unlock(&db->filter_cache_lock);
 }
 
 static int64_t _SecRevocationDbGetVersion(SecRevocationDbConnectionRef dbc, CFErrorRef *error) {
@@ -1965,6 +2209,9 @@ bool _SecRevocationDbRemoveAllEntries(SecRevocationDbConnectionRef dbc, CFErrorR
     /* delete all entries */
     ok = ok && SecDbExec(dbc->dbconn, deleteAllEntriesSQL, &localError);
     secnotice("validupdate", "resetting database, result: %d (expected 1)", (ok) ? 1 : 0);
+    if (ok) {
+        dbc->purgeCaches = true;
+    }
 
     /* one more thing: update the schema version and format to current */
     ok = ok && _SecRevocationDbSetSchemaVersion(dbc, kSecRevocationDbSchemaVersion, &localError);
@@ -2818,8 +3065,8 @@ bool _SecRevocationDbApplyUpdate(SecRevocationDbConnectionRef dbc, CFDictionaryR
         ok = ok && _SecRevocationDbSetUpdateFormat(dbc, kSecRevocationDbUpdateFormat, &localError);
     }
 
-    /* purge the in-memory cache */
-    SecRevocationDbCachePurge(dbc->db);
+    /* purge the in-memory caches once this update has committed */
+    dbc->purgeCaches = true;
 
     dbc->db->updateInProgress = false;
 
@@ -2885,15 +3132,23 @@ errOut:
     return result;
 }
 
-static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
-                                           CFDataRef serialData,
-                                           CFDataRef xmlData) {
+static CF_RETURNS_RETAINED CFDataRef _SecRevocationDbCopyFilter(SecRevocationDbConnectionRef dbc,
+                                                                 int64_t groupId,
+                                                                 CFDataRef xmlData,
+                                                                 uint64_t generation) {
     /* N-To-1 filter implementation.
        The 'xmlData' parameter is a flattened XML dictionary,
        containing 'xor' and 'params' keys. First order of
-       business is to reconstitute the blob into components.
+       business is to reconstitute the blob into components,
+       which we only do once per group.
     */
-    bool result = false;
+    CFDataRef result = SecRevocationDbFilterCacheRead(dbc->db, groupId);
+    if (result) {
+        return result;
+    }
+    if (!xmlData) {
+        return NULL;
+    }
     CFRetainSafe(xmlData);
     CFDataRef propListData = xmlData;
     /* Expand data blob if needed */
@@ -2904,22 +3159,23 @@ static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
     }
     CFDataRef xor = NULL;
     CFArrayRef params = NULL;
+    CFMutableDataRef filterData = NULL;
     CFPropertyListRef nto1 = CFPropertyListCreateWithData(kCFAllocatorDefault, propListData, 0, NULL, NULL);
-    if (nto1) {
+    if (isDictionary(nto1)) {
         xor = (CFDataRef)CFDictionaryGetValue((CFDictionaryRef)nto1, CFSTR("xor"));
         params = (CFArrayRef)CFDictionaryGetValue((CFDictionaryRef)nto1, CFSTR("params"));
     }
-    uint8_t *hash = (xor) ? (uint8_t*)CFDataGetBytePtr(xor) : NULL;
-    CFIndex hashLen = (hash) ? CFDataGetLength(xor) : 0;
-    uint8_t *serial = (serialData) ? (uint8_t*)CFDataGetBytePtr(serialData) : NULL;
-    CFIndex serialLen = (serial) ? CFDataGetLength(serialData) : 0;
+    require(isData(xor) && CFDataGetLength(xor) > 0 && CFDataGetLength(xor) <= UINT32_MAX / 8, errOut);
+    require(isArray(params) && CFArrayGetCount(params) <= UINT32_MAX, errOut);
 
-    require(hash && serial && params, errOut);
-
-    const uint32_t FNV_OFFSET_BASIS = 2166136261;
-    const uint32_t FNV_PRIME = 16777619;
-    bool notInHash = false;
     CFIndex ix, count = CFArrayGetCount(params);
+    CFIndex hashLen = CFDataGetLength(xor);
+    CFIndex headerLen = sizeof(SecRevocationDbFilter) + (count * sizeof(uint32_t));
+    require(filterData = CFDataCreateMutable(NULL, headerLen + hashLen), errOut);
+    CFDataSetLength(filterData, headerLen);
+    SecRevocationDbFilter *filter = (SecRevocationDbFilter *)CFDataGetMutableBytePtr(filterData);
+    filter->paramCount = 0;
+    filter->bitsLength = (uint32_t)hashLen;
     for (ix = 0; ix < count; ix++) {
         int32_t param;
         CFNumberRef cfnum = (CFNumberRef)CFArrayGetValueAtIndex(params, ix);
@@ -2928,14 +3184,59 @@ static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
             secinfo("validupdate", "error processing filter params at index %ld", (long)ix);
             continue;
         }
-        /* process one param */
-        uint32_t hval = FNV_OFFSET_BASIS ^ param;
-        CFIndex i = serialLen;
-        while (i > 0) {
-            hval = ((hval ^ (serial[--i])) * FNV_PRIME) & 0xFFFFFFFF;
+        filter->params[filter->paramCount++] = (uint32_t)param;
+    }
+    /* drop the slots of any skipped params so the bits follow the vector */
+    CFDataSetLength(filterData, sizeof(SecRevocationDbFilter) + (filter->paramCount * sizeof(uint32_t)));
+    CFDataAppendBytes(filterData, CFDataGetBytePtr(xor), hashLen);
+
+    SecRevocationDbFilterCacheWrite(dbc->db, groupId, filterData, generation);
+    result = filterData;
+    filterData = NULL;
+
+errOut:
+    CFReleaseSafe(filterData);
+    CFReleaseSafe(nto1);
+    CFReleaseSafe(propListData);
+    return result;
+}
+
+static bool _SecRevocationDbSerialInFilter(CFDataRef serialData,
+                                           CFDataRef filterData) {
+    bool result = false;
+    const SecRevocationDbFilter *filter = (filterData) ? (const SecRevocationDbFilter *)CFDataGetBytePtr(filterData) : NULL;
+    const uint8_t *serial = (serialData) ? CFDataGetBytePtr(serialData) : NULL;
+    CFIndex serialLen = (serial) ? CFDataGetLength(serialData) : 0;
+    uint32_t hvalStack[16];
+    uint32_t *hval = hvalStack;
+
+    require(filter && serial, errOut);
+    if (filter->paramCount > sizeof(hvalStack) / sizeof(hvalStack[0])) {
+        require(hval = (uint32_t *)malloc(filter->paramCount * sizeof(uint32_t)), errOut);
+    }
+
+    /* Compute the FNV-1a hash of the serial for every param in a single
+       pass over its bytes (last to first), then probe the filter bits. */
+    const uint32_t FNV_OFFSET_BASIS = 2166136261;
+    const uint32_t FNV_PRIME = 16777619;
+    const uint32_t count = filter->paramCount;
+    uint32_t ix;
+    for (ix = 0; ix < count; ix++) {
+        hval[ix] = FNV_OFFSET_BASIS ^ filter->params[ix];
+    }
+    CFIndex i = serialLen;
+    while (i > 0) {
+        const uint8_t byte = serial[--i];
+        for (ix = 0; ix < count; ix++) {
+            hval[ix] = (hval[ix] ^ byte) * FNV_PRIME;
         }
-        hval = hval % (hashLen * 8);
-        if ((hash[hval/8] & (1 << (hval % 8))) == 0) {
+    }
+    const uint8_t *hash = SecRevocationDbFilterGetBits(filter);
+    const uint32_t hashBits = filter->bitsLength * 8;
+    bool notInHash = false;
+    for (ix = 0; ix < count; ix++) {
+        uint32_t bit = hval[ix] % hashBits;
+        if ((hash[bit/8] & (1 << (bit % 8))) == 0) {
             notInHash = true; /* definitely not in hash */
             break;
         }
@@ -2946,8 +3247,9 @@ static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
     }
 
 errOut:
-    CFReleaseSafe(nto1);
-    CFReleaseSafe(propListData);
+    if (hval != hvalStack) {
+        free(hval);
+    }
     return result;
 }
 
@@ -2959,6 +3261,8 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
     __block SecValidInfoFlags flags = 0;
     __block SecValidInfoFormat format = kSecValidInfoFormatUnknown;
     __block CFDataRef data = NULL;
+    CFDataRef filter = NULL;
+    uint64_t filterGeneration = 0;
 
     bool matched = false;
     bool isOnList = false;
@@ -2975,8 +3279,11 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
     require((certHash = SecCertificateCopySHA256Digest(certificate)) != NULL, errOut);
     require((groupId = _SecRevocationDbGroupIdForIssuerHash(dbc, issuerHash, &localError)) > 0, errOut);
 
-    /* Look up the group record to determine flags and format. */
-    format = _SecRevocationDbGetGroupFormat(dbc, groupId, &flags, &data, &localError);
+    /* Look up the group record to determine flags and format. If we already
+       have a decoded filter for this group, don't fetch its data blob. */
+    filterGeneration = SecRevocationDbFilterCacheGeneration(dbc->db);
+    filter = SecRevocationDbFilterCacheRead(dbc->db, groupId);
+    format = _SecRevocationDbGetGroupFormat(dbc, groupId, &flags, (filter) ? NULL : &data, &localError);
 
     if (format == kSecValidInfoFormatUnknown) {
         /* No group record found for this issuer. Don't return a SecValidInfoRef */
@@ -2994,7 +3301,10 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
         /* Perform a Bloom filter match against the serial. If matched is false,
            then the cert is definitely not in the list. But if matched is true,
            we don't know for certain, so we would need to check OCSP. */
-        matched = _SecRevocationDbSerialInFilter(dbc, serial, data);
+        if (!filter) {
+            filter = _SecRevocationDbCopyFilter(dbc, groupId, data, filterGeneration);
+        }
+        matched = _SecRevocationDbSerialInFilter(serial, filter);
     }
 
     if (matched) {
@@ -3028,6 +3338,7 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
 errOut:
     (void) CFErrorPropagate(localError, error);
     CFReleaseSafe(data);
+    CFReleaseSafe(filter);
     CFReleaseSafe(certHash);
     CFReleaseSafe(serial);
     CFReleaseSafe(notBeforeDate);
@@ -3192,6 +3503,18 @@ CFIndex SecRevocationDbGetSchemaVersion(void) {
     return result;
 }
 
+/* Return cumulative hit, miss and eviction counts for the valid info cache.
+ */
+void SecRevocationDbGetCacheCounts(uint64_t *hits, uint64_t *misses, uint64_t *evictions) {
+    /* SecRevocationDbWith may not call us back if there is no database */
+    if (hits) { *hits = 0; }
+    if (misses) { *misses = 0; }
+    if (evictions) { *evictions = 0; }
+    SecRevocationDbWith(^(SecRevocationDbRef db) {
+        SecRevocationDbCacheGetCounts(db, hits, misses, evictions);
+    });
+}
+
 /* Return the current update format of the revocation database.
  A version of 0 indicates the format was unknown.
  If the update format cannot be obtained, -1 is returned.
@@ -3206,3 +3529,49 @@ CFIndex SecRevocationDbGetUpdateFormat(void) {
     });
     return result;
 }
+
+/* === Test support === */
+
+SecRevocationDbRef SecRevocationDbCreateWithPath(CFStringRef path) {
+    return (path) ? SecRevocationDbInit(path, true) : NULL;
+}
+
+void SecRevocationDbDispose(SecRevocationDbRef rdb) {
+    if (!rdb) {
+        return;
+    }
+    if (rdb->update_queue) {
+        dispatch_release(rdb->update_queue);
+    }
+    CFReleaseSafe(rdb->db);
+    SecRevocationDbCacheDestroy(rdb);
+    CFReleaseSafe(rdb->filter_cache);
+    free(rdb);
+}
+
+bool SecRevocationDbApplyUpdateWithDb(SecRevocationDbRef rdb, CFDictionaryRef update, CFIndex version, CFErrorRef *error) {
+    if (!rdb || !update) {
+        return SecError(errSecParam, error, CFSTR("missing database or update"));
+    }
+    return SecRevocationDbPerformWrite(rdb, error, ^bool(SecRevocationDbConnectionRef dbc, CFErrorRef *blockError) {
+        return _SecRevocationDbApplyUpdate(dbc, update, version, blockError);
+    });
+}
+
+SecValidInfoRef SecRevocationDbCopyMatchingWithDb(SecRevocationDbRef rdb,
+                                                  SecCertificateRef certificate,
+                                                  SecCertificateRef issuer) {
+    __block SecValidInfoRef result = NULL;
+    if (!rdb) {
+        return NULL;
+    }
+    (void) SecRevocationDbPerformRead(rdb, NULL, ^bool(SecRevocationDbConnectionRef dbc, CFErrorRef *blockError) {
+        result = _SecRevocationDbCopyMatching(dbc, certificate, issuer);
+        return (bool)result;
+    });
+    return result;
+}
+
+void SecRevocationDbGetCacheCountsWithDb(SecRevocationDbRef rdb, uint64_t *hits, uint64_t *misses, uint64_t *evictions) {
+    SecRevocationDbCacheGetCounts(rdb, hits, misses, evictions);
+}
@@ -126,6 +126,16 @@ CFIndex SecRevocationDbGetVersion(void);
  */
 CFIndex SecRevocationDbGetSchemaVersion(void);
 
+/*!
+	@function SecRevocationDbGetCacheCounts
+	@abstract Returns cumulative statistics for the in-memory valid info cache.
+	@param hits On return, the number of lookups answered from the cache. May be NULL.
+	@param misses On return, the number of lookups that went to the database. May be NULL.
+	@param evictions On return, the number of entries dropped to stay within the cache capacity. May be NULL.
+	@discussion The capacity defaults to 1024 entries and may be overridden with the ValidInfoCacheSize preference in the com.apple.security domain.
+ */
+void SecRevocationDbGetCacheCounts(uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
 /*!
  @function SecValidUpdateVerifyAndIngest
  @abstract Callback for receiving update data.
@@ -167,6 +177,51 @@ extern const CFStringRef kValidUpdateCarryServer;
  */
 CFStringRef SecRevocationDbCopyUpdateSource(void);
 
+/*
+ The following functions operate on a private database instead of the
+ shared one, and are intended for testing only.
+ */
+typedef struct __SecRevocationDb *SecRevocationDbRef;
+
+/*!
+ @function SecRevocationDbCreateWithPath
+ @abstract Opens (creating if necessary) a read-write revocation database at the given path.
+ @param path The file system path of the database.
+ @result A database reference, which must be released with SecRevocationDbDispose, or NULL on failure.
+ */
+SecRevocationDbRef SecRevocationDbCreateWithPath(CFStringRef path);
+
+/*!
+ @function SecRevocationDbDispose
+ @abstract Closes a database opened with SecRevocationDbCreateWithPath and releases its caches.
+ */
+void SecRevocationDbDispose(SecRevocationDbRef rdb);
+
+/*!
+ @function SecRevocationDbApplyUpdateWithDb
+ @abstract Applies an update dictionary (with optional "full", "delete" and "update" keys) in a single write transaction.
+ @param rdb The database to update.
+ @param update The update dictionary.
+ @param version The database version after this update.
+ @param error On failure, an error describing what went wrong. May be NULL.
+ @result True if the update was committed.
+ */
+bool SecRevocationDbApplyUpdateWithDb(SecRevocationDbRef rdb, CFDictionaryRef update, CFIndex version, CFErrorRef *error);
+
+/*!
+ @function SecRevocationDbCopyMatchingWithDb
+ @abstract Equivalent to SecRevocationDbCopyMatching, but looks up the given database.
+ */
+SecValidInfoRef SecRevocationDbCopyMatchingWithDb(SecRevocationDbRef rdb,
+                                                  SecCertificateRef certificate,
+                                                  SecCertificateRef issuer);
+
+/*!
+ @function SecRevocationDbGetCacheCountsWithDb
+ @abstract Equivalent to SecRevocationDbGetCacheCounts, but reports on the given database.
+ */
+void SecRevocationDbGetCacheCountsWithDb(SecRevocationDbRef rdb, uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
 
 __END_DECLS
 
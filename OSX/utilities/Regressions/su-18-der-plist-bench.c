@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "utilities_regressions.h"
+
+#include "utilities/der_plist.h"
+#include "utilities/der_plist_internal.h"
+
+#include "utilities/SecCFRelease.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <stdlib.h>
+
+#define kTestCount 15
+#define kDefaultItemsPerClass 2500
+#define kIterations 5
+
+//
+// Something shaped like a keychain backup: a dictionary of item classes,
+// each an array of attribute dictionaries.
+//
+static CFDictionaryRef copy_item(int index, bool reversed)
+{
+    uint8_t secret[256];
+    uint8_t digest[20];
+    arc4random_buf(secret, sizeof(secret));
+    arc4random_buf(digest, sizeof(digest));
+
+    CFStringRef acct = CFStringCreateWithFormat(NULL, NULL, CFSTR("account-%d@example.com"), index);
+    CFStringRef svce = CFStringCreateWithFormat(NULL, NULL, CFSTR("com.example.service.%d"), index % 97);
+    CFDataRef data = CFDataCreate(NULL, secret, 32 + (index % 224));
+    CFDataRef sha1 = CFDataCreate(NULL, digest, sizeof(digest));
+    CFDateRef date = CFDateCreate(NULL, 500000000.0 + index);
+    CFNumberRef number = CFNumberCreate(NULL, kCFNumberIntType, &index);
+
+    const void *keys[] = {
+        CFSTR("acct"), CFSTR("svce"), CFSTR("agrp"), CFSTR("pdmn"), CFSTR("cdat"), CFSTR("mdat"),
+        CFSTR("v_Data"), CFSTR("sha1"), CFSTR("tomb"), CFSTR("sync"), CFSTR("rid"), CFSTR("labl"),
+    };
+    const void *values[] = {
+        acct, svce, CFSTR("com.example.group"), CFSTR("ak"), date, date,
+        data, sha1, kCFBooleanFalse, kCFBooleanTrue, number, CFSTR("label"),
+    };
+    const CFIndex count = sizeof(keys) / sizeof(keys[0]);
+
+    CFMutableDictionaryRef item = CFDictionaryCreateMutable(NULL, count, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    for (CFIndex n = 0; n < count; n++) {
+        CFIndex k = reversed ? count - 1 - n : n;
+        CFDictionarySetValue(item, keys[k], values[k]);
+    }
+
+    CFReleaseNull(acct);
+    CFReleaseNull(svce);
+    CFReleaseNull(data);
+    CFReleaseNull(sha1);
+    CFReleaseNull(date);
+    CFReleaseNull(number);
+    return item;
+}
+
+static CFDictionaryRef copy_backup(int itemsPerClass)
+{
+    CFStringRef classes[] = { CFSTR("genp"), CFSTR("inet"), CFSTR("keys"), CFSTR("cert") };
+    CFMutableDictionaryRef backup = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+    for (size_t c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+        CFMutableArrayRef items = CFArrayCreateMutable(NULL, itemsPerClass, &kCFTypeArrayCallBacks);
+        for (int i = 0; i < itemsPerClass; i++) {
+            CFDictionaryRef item = copy_item(i, false);
+            CFArrayAppendValue(items, item);
+            CFReleaseNull(item);
+        }
+        CFDictionarySetValue(backup, classes[c], items);
+        CFReleaseNull(items);
+    }
+    return backup;
+}
+
+static CFDataRef copy_encoding(CFPropertyListRef plist)
+{
+    size_t size = der_sizeof_plist(plist, NULL);
+    CFMutableDataRef data = CFDataCreateMutable(NULL, size);
+    CFDataSetLength(data, size);
+    uint8_t *der = CFDataGetMutableBytePtr(data);
+    uint8_t *der_end = der + size;
+    if (der_encode_plist(plist, NULL, der, der_end) != der) {
+        CFReleaseNull(data);
+    }
+    return data;
+}
+
+static void tests(int itemsPerClass)
+{
+    // DER SET order can't depend on how the dictionary was built
+    CFDictionaryRef forward = copy_item(7, false);
+    CFDictionaryRef backward = copy_item(7, true);
+    CFMutableDictionaryRef rebuilt = CFDictionaryCreateMutableCopy(NULL, 0, backward);
+    CFDictionarySetValue(rebuilt, CFSTR("v_Data"), CFDictionaryGetValue(forward, CFSTR("v_Data")));
+    CFDictionarySetValue(rebuilt, CFSTR("sha1"), CFDictionaryGetValue(forward, CFSTR("sha1")));
+    CFDataRef forwardDER = copy_encoding(forward);
+    CFDataRef rebuiltDER = copy_encoding(rebuilt);
+    ok(forwardDER && rebuiltDER && CFEqual(forwardDER, rebuiltDER), "encoding independent of insertion order");
+    CFReleaseNull(forward);
+    CFReleaseNull(backward);
+    CFReleaseNull(rebuilt);
+    CFReleaseNull(forwardDER);
+    CFReleaseNull(rebuiltDER);
+
+    CFDictionaryRef backup = copy_backup(itemsPerClass);
+    size_t size = der_sizeof_plist(backup, NULL);
+    ok(size > 0, "sized backup");
+
+    CFDataRef encoded = NULL;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < kIterations; i++) {
+        CFReleaseNull(encoded);
+        encoded = copy_encoding(backup);
+    }
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    ok(encoded != NULL, "encoded backup");
+    diag("encode: %d items, %zu bytes, %.2f ms/encode, %.1f MB/s", 4 * itemsPerClass, size,
+         elapsed * 1000 / kIterations, (double)size * kIterations / elapsed / (1024 * 1024));
+
+    CFPropertyListRef decoded = NULL;
+    const uint8_t *der = encoded ? CFDataGetBytePtr(encoded) : NULL;
+    const uint8_t *der_end = der ? der + CFDataGetLength(encoded) : NULL;
+    start = CFAbsoluteTimeGetCurrent();
+    const uint8_t *decode_end = der_decode_plist(NULL, kCFPropertyListImmutable, &decoded, NULL, der, der_end);
+    elapsed = CFAbsoluteTimeGetCurrent() - start;
+    ok(decode_end != NULL && decode_end == der_end, "decoded whole backup");
+    ok(decoded && CFEqual(decoded, backup), "round trip");
+    diag("decode: %.2f ms", elapsed * 1000);
+
+    CFDataRef reencoded = decoded ? copy_encoding(decoded) : NULL;
+    ok(reencoded && encoded && CFEqual(reencoded, encoded), "re-encoding is byte identical");
+
+    CFPropertyListRef borrowed = NULL;
+    start = CFAbsoluteTimeGetCurrent();
+    decode_end = encoded ? der_decode_plist_borrowed(encoded, kCFPropertyListImmutable, &borrowed, NULL, der, der_end) : NULL;
+    elapsed = CFAbsoluteTimeGetCurrent() - start;
+    ok(decode_end != NULL && decode_end == der_end, "borrowed decode of whole backup");
+    ok(borrowed && CFEqual(borrowed, backup), "borrowed round trip");
+    diag("borrowed decode: %.2f ms", elapsed * 1000);
+
+    // Borrowed values have to keep the DER they point into alive
+    CFStringRef keys[] = { CFSTR("ascii"), CFSTR("caf\u00e9 \u2603") };
+    uint8_t bytes[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    CFDataRef value = CFDataCreate(NULL, bytes, sizeof(bytes));
+    const void *values[] = { value, value };
+    CFDictionaryRef small = CFDictionaryCreate(NULL, (const void **)keys, values, 2, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFDataRef smallDER = copy_encoding(small);
+    CFPropertyListRef smallDecoded = smallDER ? CFPropertyListCreateWithDERDataNoCopy(NULL, smallDER, 0, NULL, NULL) : NULL;
+    ok(smallDecoded && CFEqual(smallDecoded, small), "non-ASCII keys survive borrowed decode");
+    CFReleaseNull(smallDER);
+    ok(smallDecoded && CFEqual(smallDecoded, small), "borrowed values outlive the caller's reference");
+
+    CFReleaseNull(smallDecoded);
+    CFReleaseNull(small);
+    CFReleaseNull(value);
+
+    // An empty value last in the DER borrows a pointer to the very end of it
+    CFStringRef empty = CFSTR("");
+    CFDataRef emptyData = CFDataCreate(NULL, NULL, 0);
+    CFDictionaryRef emptyString = CFDictionaryCreate(NULL, (const void **)keys, (const void **)&empty, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFDictionaryRef emptyDataValue = CFDictionaryCreate(NULL, (const void **)keys, (const void **)&emptyData, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFPropertyListRef empties[] = { empty, emptyData, emptyString, emptyDataValue };
+    const char *emptyNames[] = { "empty string", "empty data", "empty string value", "empty data value" };
+    for (size_t ix = 0; ix < sizeof(empties) / sizeof(empties[0]); ix++) {
+        CFDataRef emptyDER = copy_encoding(empties[ix]);
+        CFPropertyListRef emptyDecoded = emptyDER ? CFPropertyListCreateWithDERDataNoCopy(NULL, emptyDER, 0, NULL, NULL) : NULL;
+        CFReleaseNull(emptyDER);
+        ok(emptyDecoded && CFEqual(emptyDecoded, empties[ix]), "borrowed decode of %s", emptyNames[ix]);
+        CFReleaseNull(emptyDecoded);
+    }
+    CFReleaseNull(emptyDataValue);
+    CFReleaseNull(emptyString);
+    CFReleaseNull(emptyData);
+    CFReleaseNull(borrowed);
+
+    CFReleaseNull(reencoded);
+    CFReleaseNull(decoded);
+    CFReleaseNull(encoded);
+    CFReleaseNull(backup);
+}
+
+int su_18_der_plist_bench(int argc, char *const *argv)
+{
+    int itemsPerClass = (argc > 1) ? atoi(argv[1]) : kDefaultItemsPerClass;
+    if (itemsPerClass <= 0)
+        itemsPerClass = kDefaultItemsPerClass;
+
+    plan_tests(kTestCount);
+    tests(itemsPerClass);
+
+    return 0;
+}
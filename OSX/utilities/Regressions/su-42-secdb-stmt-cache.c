@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <utilities/SecCFRelease.h>
+#include <utilities/SecDb.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <string.h>
+
+#include "utilities_regressions.h"
+
+#define kTestCount 24
+
+static void tests(void)
+{
+    const char *home_var = getenv("HOME");
+    CFStringRef dbName = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("%s/Library/Keychains/su-42-sqldb.db"), home_var ? home_var : "");
+
+    SecDbRef db = SecDbCreate(dbName, 0600, true, true, true, true, kSecDbMaxIdleHandles, NULL);
+    CFReleaseNull(dbName);
+    ok(db, "SecDbCreate");
+
+    __block int commits = 0;
+    SecDbAddNotifyPhaseBlock(db, ^(SecDbConnectionRef dbconn, SecDbTransactionPhase phase, SecDbTransactionSource source, CFArrayRef changes) {
+        if (phase == kSecDbTransactionDidCommit)
+            commits++;
+    });
+
+    __block CFErrorRef error = NULL;
+    ok(SecDbPerformWrite(db, &error, ^void (SecDbConnectionRef dbconn) {
+        ok(SecDbExec(dbconn, CFSTR("DROP TABLE IF EXISTS tablea; CREATE TABLE tablea(key INTEGER,value BLOB);"), &error),
+           "exec: %@", error);
+        CFReleaseNull(error);
+
+        uint64_t hits0 = 0, misses0 = 0, hits = 0, misses = 0;
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits0, &misses0);
+
+        // The same insert, over and over: one prepare, then cache hits with fresh bindings each time.
+        CFStringRef insert = CFSTR("INSERT INTO tablea(key,value)VALUES(?,?);");
+        __block bool inserted = true;
+        for (int key = 0; key < 10; key++) {
+            inserted &= SecDbPrepare(dbconn, insert, &error, ^void (sqlite3_stmt *stmt) {
+                inserted &= SecDbBindInt(stmt, 1, key, &error);
+                inserted &= SecDbStep(dbconn, stmt, &error, NULL);
+            });
+        }
+        ok(inserted, "insert 10 rows: %@", error);
+        CFReleaseNull(error);
+
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits, &misses);
+        is(misses - misses0, (uint64_t)1, "one cache miss for the repeated insert");
+        is(hits - hits0, (uint64_t)9, "nine cache hits for the repeated insert");
+
+        // Bindings must not leak from one use of the cached statement to the next.
+        CFStringRef count = CFSTR("SELECT COUNT(*) FROM tablea WHERE value IS NULL AND key >= ?;");
+        __block int rows = -1;
+        ok(SecDbPrepare(dbconn, count, &error, ^void (sqlite3_stmt *stmt) {
+            SecDbBindInt(stmt, 1, 5, &error);
+            SecDbStep(dbconn, stmt, &error, ^(bool *stop) {
+                rows = sqlite3_column_int(stmt, 0);
+            });
+        }), "SecDbPrepare: %@", error);
+        CFReleaseNull(error);
+        is(rows, 5, "5 rows with key >= 5");
+
+        ok(SecDbPrepare(dbconn, count, &error, ^void (sqlite3_stmt *stmt) {
+            SecDbStep(dbconn, stmt, &error, ^(bool *stop) {
+                rows = sqlite3_column_int(stmt, 0);
+            });
+        }), "SecDbPrepare: %@", error);
+        CFReleaseNull(error);
+        is(rows, 0, "unbound parameter is NULL again after the statement was returned to the cache");
+
+        // A nested use of the same sql gets its own statement.
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits0, &misses0);
+        ok(SecDbPrepare(dbconn, count, &error, ^void (sqlite3_stmt *outer) {
+            ok(SecDbPrepare(dbconn, count, &error, ^void (sqlite3_stmt *inner) {
+                ok(inner != outer, "nested user of the same sql gets a private statement");
+            }), "nested SecDbPrepare: %@", error);
+        }), "SecDbPrepare: %@", error);
+        CFReleaseNull(error);
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits, &misses);
+        is(hits - hits0, (uint64_t)1, "outer use hits the cache");
+        is(misses - misses0, (uint64_t)1, "nested use misses the cache");
+
+        // Failing steps still hand the statement back in a reusable state.
+        ok(SecDbExec(dbconn, CFSTR("CREATE UNIQUE INDEX tablea_key ON tablea(key);"), &error), "exec: %@", error);
+        CFReleaseNull(error);
+        ok(!SecDbPrepare(dbconn, insert, &error, ^void (sqlite3_stmt *stmt) {
+            SecDbBindInt(stmt, 1, 1, NULL);
+            SecDbStep(dbconn, stmt, NULL, NULL);
+        }), "duplicate insert fails");
+        CFReleaseNull(error);
+        ok(SecDbPrepare(dbconn, insert, &error, ^void (sqlite3_stmt *stmt) {
+            SecDbBindInt(stmt, 1, 100, &error);
+            SecDbStep(dbconn, stmt, &error, NULL);
+        }), "cached insert works after a failure: %@", error);
+        CFReleaseNull(error);
+
+        // Committing changes notifies observers, and must leave the cache alone.
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits0, &misses0);
+        ok(SecDbTransaction(dbconn, kSecDbExclusiveTransactionType, &error, ^(bool *commit) {
+            SecDbPrepare(dbconn, insert, &error, ^void (sqlite3_stmt *stmt) {
+                SecDbBindInt(stmt, 1, 200, &error);
+                SecDbStep(dbconn, stmt, &error, NULL);
+            });
+            SecDbRecordChange(dbconn, NULL, kCFNull);
+        }), "transaction with changes: %@", error);
+        CFReleaseNull(error);
+        is(commits, 1, "observer saw the commit");
+        ok(SecDbPrepare(dbconn, insert, &error, ^void (sqlite3_stmt *stmt) {
+            SecDbBindInt(stmt, 1, 201, &error);
+            SecDbStep(dbconn, stmt, &error, NULL);
+        }), "cached insert after commit: %@", error);
+        CFReleaseNull(error);
+        SecDbConnectionGetStatementCacheCounts(dbconn, &hits, &misses);
+        is(misses - misses0, (uint64_t)0, "commit did not drop the statement cache");
+
+        // Exactly one statement for the insert is alive on the handle, so it can be finalized and closed.
+        int insertStatements = 0;
+        for (sqlite3_stmt *stmt = sqlite3_next_stmt(SecDbHandle(dbconn), NULL); stmt; stmt = sqlite3_next_stmt(SecDbHandle(dbconn), stmt))
+            if (!strcmp(sqlite3_sql(stmt), "INSERT INTO tablea(key,value)VALUES(?,?);"))
+                insertStatements++;
+        is(insertStatements, 1, "no orphaned statements after commit");
+
+        ok(SecDbExec(dbconn, CFSTR("DROP TABLE tablea;"), &error), "exec: %@", error);
+        CFReleaseNull(error);
+    }), "SecDbPerformWrite: %@", error);
+    CFReleaseNull(error);
+
+    CFReleaseNull(db);
+}
+
+int su_42_secdb_stmt_cache(int argc, char *const *argv)
+{
+    plan_tests(kTestCount);
+    tests();
+
+    return 0;
+}
@@ -15,5 +15,7 @@ ONE_TEST(su_14_cfarray_der)
 ONE_TEST(su_15_cfdictionary_der)
 ONE_TEST(su_16_cfdate_der)
 ONE_TEST(su_17_cfset_der)
+ONE_TEST(su_18_der_plist_bench)
 OFF_ONE_TEST(su_40_secdb)
 ONE_TEST(su_41_secdb_stress)
+ONE_TEST(su_42_secdb_stmt_cache)
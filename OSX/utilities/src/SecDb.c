@@ -55,10 +55,25 @@ struct __OpaqueSecDbStatement {
     sqlite3_stmt *stmt;
 };
 
+// A prepared statement cached by its connection, keyed by its sql text.
+// Entries are kept on a doubly linked list in most recently used order.
+typedef struct SecDbCachedStmt {
+    struct SecDbCachedStmt *prev;
+    struct SecDbCachedStmt *next;
+    CFStringRef sql;
+    sqlite3_stmt *stmt;
+    bool inUse;     // handed out by SecDbCopyStmt and not yet returned
+} SecDbCachedStmt;
+
 struct __OpaqueSecDbConnection {
     CFRuntimeBase _base;
 
-    //CFMutableDictionaryRef statements;
+    // Prepared statement cache; statements is sql -> SecDbCachedStmt * (NONRETAINED values)
+    CFMutableDictionaryRef statements;
+    SecDbCachedStmt *mruStatement;
+    SecDbCachedStmt *lruStatement;
+    uint64_t statementCacheHits;
+    uint64_t statementCacheMisses;
 
     SecDbRef db;     // NONRETAINED, since db or block retains us
     bool readOnly;
@@ -77,6 +92,8 @@ struct __OpaqueSecDbConnection {
     CFMutableArrayRef changes;
 };
 
+static void SecDbConnectionPurgeStatements(SecDbConnectionRef dbconn);
+
 struct __OpaqueSecDb {
     CFRuntimeBase _base;
 
@@ -840,6 +857,7 @@ static bool SecDbTruncate(SecDbConnectionRef dbconn, CFErrorRef *error)
     }
     __block bool ok = SecDbFileControl(dbconn, SQLITE_TRUNCATE_DATABASE, &flags, error);
     if (!ok) {
+        SecDbConnectionPurgeStatements(dbconn);
         sqlite3_close(dbconn->handle);
         dbconn->handle = NULL;
         CFStringPerformWithCString(dbconn->db->db_path, ^(const char *path) {
@@ -888,6 +906,7 @@ static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *er
             // Explicitly close our connection, plus all other open connections to this db.
             bool closed = true;
             if (dbconn->handle) {
+                SecDbConnectionPurgeStatements(dbconn);
                 closed &= SecDbError(sqlite3_close(dbconn->handle), error, CFSTR("close"));
                 dbconn->handle = NULL;
             }
@@ -896,6 +915,7 @@ static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *er
             for (idx = 0; idx < count; idx++) {
                 SecDbConnectionRef dbconn = (SecDbConnectionRef) CFArrayGetValueAtIndex(db->connections, idx);
                 if (dbconn && dbconn->handle) {
+                    SecDbConnectionPurgeStatements(dbconn);
                     closed &= SecDbError(sqlite3_close(dbconn->handle), error, CFSTR("close"));
                     dbconn->handle = NULL;
                 }
@@ -1084,6 +1104,11 @@ SecDbConnectionCreate(SecDbRef db, bool readOnly, CFErrorRef *error)
     dbconn->corruptionError = NULL;
     dbconn->handle = NULL;
     dbconn->changes = CFArrayCreateMutableForCFTypes(kCFAllocatorDefault);
+    dbconn->statements = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    dbconn->mruStatement = NULL;
+    dbconn->lruStatement = NULL;
+    dbconn->statementCacheHits = 0;
+    dbconn->statementCacheMisses = 0;
 
 done:
     return dbconn;
@@ -1283,12 +1308,14 @@ static void
 SecDbConnectionDestroy(CFTypeRef value)
 {
     SecDbConnectionRef dbconn = (SecDbConnectionRef)value;
+    SecDbConnectionPurgeStatements(dbconn);
     if (dbconn->handle) {
         sqlite3_close(dbconn->handle);
     }
     dbconn->db = NULL;
     CFReleaseNull(dbconn->changes);
     CFReleaseNull(dbconn->corruptionError);
+    CFReleaseNull(dbconn->statements);
 
 }
 
@@ -1477,10 +1504,93 @@ static sqlite3_stmt *SecDbCopyStatementWithTailRange(SecDbConnectionRef dbconn,
     return stmt;
 }
 
+// MARK: -
+// MARK: Prepared statement cache
+
+static void SecDbCachedStmtUnlink(SecDbConnectionRef dbconn, SecDbCachedStmt *entry) {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        dbconn->mruStatement = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        dbconn->lruStatement = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void SecDbCachedStmtMakeMRU(SecDbConnectionRef dbconn, SecDbCachedStmt *entry) {
+    entry->prev = NULL;
+    entry->next = dbconn->mruStatement;
+    if (dbconn->mruStatement)
+        dbconn->mruStatement->prev = entry;
+    dbconn->mruStatement = entry;
+    if (!dbconn->lruStatement)
+        dbconn->lruStatement = entry;
+}
+
+// Forget about a cache entry. Its statement is finalized unless it's still handed out,
+// in which case SecDbReleaseCachedStmt will finalize it since it's no longer cached.
+static void SecDbCachedStmtRemove(SecDbConnectionRef dbconn, SecDbCachedStmt *entry) {
+    SecDbCachedStmtUnlink(dbconn, entry);
+    CFDictionaryRemoveValue(dbconn->statements, entry->sql);
+    if (!entry->inUse)
+        SecDbFinalize(entry->stmt, NULL);
+    CFReleaseNull(entry->sql);
+    free(entry);
+}
+
+// Finalize all cached statements; must be called before closing the connection's handle.
+static void SecDbConnectionPurgeStatements(SecDbConnectionRef dbconn) {
+    while (dbconn->mruStatement)
+        SecDbCachedStmtRemove(dbconn, dbconn->mruStatement);
+}
+
+static void SecDbCachedStmtInsert(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt) {
+    // Evict the least recently used idle statement if we're full.
+    if (CFDictionaryGetCount(dbconn->statements) >= kSecDbMaxCachedStatements) {
+        SecDbCachedStmt *victim = dbconn->lruStatement;
+        while (victim && victim->inUse)
+            victim = victim->prev;
+        if (!victim)
+            return; // Everything is in use, don't cache this one.
+        SecDbCachedStmtRemove(dbconn, victim);
+    }
+    SecDbCachedStmt *entry = calloc(1, sizeof(*entry));
+    if (!entry)
+        return;
+    entry->sql = CFStringCreateCopy(kCFAllocatorDefault, sql);
+    entry->stmt = stmt;
+    entry->inUse = true;
+    CFDictionarySetValue(dbconn->statements, entry->sql, entry);
+    SecDbCachedStmtMakeMRU(dbconn, entry);
+}
+
+void SecDbConnectionGetStatementCacheCounts(SecDbConnectionRef dbconn, uint64_t *hits, uint64_t *misses) {
+    if (hits)
+        *hits = dbconn->statementCacheHits;
+    if (misses)
+        *misses = dbconn->statementCacheMisses;
+}
+
 sqlite3_stmt *SecDbCopyStmt(SecDbConnectionRef dbconn, CFStringRef sql, CFStringRef *tail, CFErrorRef *error) {
-    // TODO: Add caching and cache lookup of statements
+    if (sql) {
+        SecDbCachedStmt *entry = (SecDbCachedStmt *)CFDictionaryGetValue(dbconn->statements, sql);
+        if (entry && !entry->inUse) {
+            entry->inUse = true;
+            SecDbCachedStmtUnlink(dbconn, entry);
+            SecDbCachedStmtMakeMRU(dbconn, entry);
+            dbconn->statementCacheHits++;
+            return entry->stmt;
+        }
+    }
+    dbconn->statementCacheMisses++;
+
     CFRange sqlTail = {};
     sqlite3_stmt *stmt = SecDbCopyStatementWithTailRange(dbconn, sql, &sqlTail, error);
+    // Only single statement sql is cached, and only one copy of it (a nested user of the same sql gets a private statement).
+    if (stmt && sqlTail.length == 0 && !CFDictionaryContainsKey(dbconn->statements, sql))
+        SecDbCachedStmtInsert(dbconn, sql, stmt);
     if (sqlTail.length > 0) {
         CFStringRef excess = CFStringCreateWithSubstring(CFGetAllocator(sql), sql, sqlTail);
         if (tail) {
@@ -1497,11 +1607,19 @@ sqlite3_stmt *SecDbCopyStmt(SecDbConnectionRef dbconn, CFStringRef sql, CFString
     return stmt;
 }
 
-/*
- TODO: Could do a hack here with a custom kCFAllocatorNULL allocator for a second CFRuntimeBase inside a SecDbStatement,
- TODO: Better yet make a full blow SecDbStatement instance whenever SecDbCopyStmt is called.  Then, when the statement is released, in the Dispose method, we Reset and ClearBindings the sqlite3_stmt * and hand it back to the SecDb with the original CFStringRef for the sql (or hash thereof) as an argument. */
+/* Return a statement obtained from SecDbCopyStmt. If it's the cached statement for sql, it is reset and
+ has its bindings cleared so the next SecDbCopyStmt can reuse it; otherwise it is finalized. */
 bool SecDbReleaseCachedStmt(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt, CFErrorRef *error) {
     if (stmt) {
+        SecDbCachedStmt *entry = sql ? (SecDbCachedStmt *)CFDictionaryGetValue(dbconn->statements, sql) : NULL;
+        if (entry && entry->stmt == stmt && entry->inUse) {
+            entry->inUse = false;
+            // sqlite3_reset reports the error of the last step, same as sqlite3_finalize would have.
+            // The statement is reset regardless, so it stays cached either way.
+            bool ok = SecDbReset(stmt, error);
+            ok &= SecDbClearBindings(stmt, ok ? error : NULL);
+            return ok;
+        }
         return SecDbFinalize(stmt, error);
     }
     return true;
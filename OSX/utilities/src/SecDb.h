@@ -42,6 +42,7 @@ enum {
     kSecDbMaxReaders = 4,
     kSecDbMaxWriters = 1,
     kSecDbMaxIdleHandles = 3,
+    kSecDbMaxCachedStatements = 32,
 };
 
 // MARK: SecDbTransactionType
@@ -173,6 +174,7 @@ bool SecDbFinalize(sqlite3_stmt *stmt, CFErrorRef *error);
 sqlite3_stmt *SecDbPrepareV2(SecDbConnectionRef dbconn, const char *sql, size_t sqlLen, const char **sqlTail, CFErrorRef *error);
 sqlite3_stmt *SecDbCopyStmt(SecDbConnectionRef dbconn, CFStringRef sql, CFStringRef *tail, CFErrorRef *error);
 bool SecDbReleaseCachedStmt(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt, CFErrorRef *error);
+void SecDbConnectionGetStatementCacheCounts(SecDbConnectionRef dbconn, uint64_t *hits, uint64_t *misses);
 bool SecDbWithSQL(SecDbConnectionRef dbconn, CFStringRef sql, CFErrorRef *error, bool(^perform)(sqlite3_stmt *stmt));
 bool SecDbForEach(SecDbConnectionRef dbconn, sqlite3_stmt *stmt, CFErrorRef *error, bool(^row)(int row_index));
 
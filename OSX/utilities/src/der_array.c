@@ -39,7 +39,7 @@ const uint8_t* der_decode_array(CFAllocatorRef allocator, CFOptionFlags mutabili
     if (NULL == der)
         return NULL;
 
-    CFMutableArrayRef result = CFArrayCreateMutable(allocator, 0, &kCFTypeArrayCallBacks);
+    CFMutableArrayRef result = CFArrayCreateMutable(der_object_allocator(allocator, mutability), 0, &kCFTypeArrayCallBacks);
 
     const uint8_t *elements_end;
     const uint8_t *current_element = ccder_decode_sequence_tl(&elements_end, der, der_end);
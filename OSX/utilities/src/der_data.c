@@ -47,7 +47,7 @@ const uint8_t* der_decode_data_mutable(CFAllocatorRef allocator, CFOptionFlags m
         return NULL;
     }
 
-    *data = CFDataCreateMutable(allocator, 0);
+    *data = CFDataCreateMutable(der_object_allocator(allocator, mutability), 0);
 
     if (NULL == *data) {
         SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create data"), NULL, error);
@@ -75,7 +75,10 @@ const uint8_t* der_decode_data(CFAllocatorRef allocator, CFOptionFlags mutabilit
         return NULL;
     }
     
-    *data = CFDataCreate(allocator, payload, payload_size);
+    if (mutability & kSecDERDecodeBorrowBytes)
+        *data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, payload, payload_size, allocator);
+    else
+        *data = CFDataCreate(allocator, payload, payload_size);
 
     if (NULL == *data) {
         SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create data"), NULL, error);
@@ -268,7 +268,7 @@ const uint8_t* der_decode_date(CFAllocatorRef allocator, CFOptionFlags mutabilit
     CFAbsoluteTime at = 0;
     der = der_decode_generalizedtime_body(&at, error, der, der_end);
     if (der) {
-        *date = CFDateCreate(allocator, at);
+        *date = CFDateCreate(der_object_allocator(allocator, mutability), at);
         if (NULL == *date) {
             SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create date"), NULL, error);
             return NULL;
@@ -77,7 +77,7 @@ const uint8_t* der_decode_dictionary(CFAllocatorRef allocator, CFOptionFlags mut
     }
     
     
-    CFMutableDictionaryRef dict = CFDictionaryCreateMutable(allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFMutableDictionaryRef dict = CFDictionaryCreateMutable(der_object_allocator(allocator, mutability), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
     
     if (NULL == dict) {
         SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create dictionary"), NULL, error);
@@ -171,74 +171,51 @@ static uint8_t* der_encode_key_value(CFPropertyListRef key, CFPropertyListRef va
 struct encode_context {
     bool         success;
     CFErrorRef * error;
-    CFMutableArrayRef list;
-    CFAllocatorRef allocator;
+    const uint8_t *der;
+    uint8_t *der_end;
+    struct der_element_table table;
 };
 
-static void add_sequence_to_array(const void *key_void, const void *value_void, void *context_void)
+static void encode_key_value_in_place(const void *key_void, const void *value_void, void *context_void)
 {
     struct encode_context *context = (struct encode_context *) context_void;
     if (context->success) {
         CFTypeRef key = (CFTypeRef) key_void;
         CFTypeRef value = (CFTypeRef) value_void;
 
-        size_t der_size = der_sizeof_key_value(key, value, context->error);
-        if (der_size == 0) {
-            context-> success = false;
-        } else {
-            CFMutableDataRef encoded_kv = CFDataCreateMutable(context->allocator, der_size);
-            CFDataSetLength(encoded_kv, der_size);
-
-            uint8_t* const encode_begin = CFDataGetMutableBytePtr(encoded_kv);
-            uint8_t* encode_end = encode_begin + der_size;
-
-            encode_end = der_encode_key_value(key, value, context->error, encode_begin, encode_end);
-
-            if (encode_end != NULL) {
-                CFDataDeleteBytes(encoded_kv, CFRangeMake(0, (encode_end - encode_begin)));
-                CFArrayAppendValue(context->list, encoded_kv);
-            } else {
-                context-> success = false;
-            }
+        uint8_t *element_end = context->der_end;
+        context->der_end = der_encode_key_value(key, value, context->error, context->der, context->der_end);
 
-            CFReleaseNull(encoded_kv);
+        if (context->der_end != NULL) {
+            struct der_encoded_element *element = &context->table.elements[context->table.count++];
+            element->start = context->der_end;
+            element->length = (size_t)(element_end - context->der_end);
+        } else {
+            context->success = false;
         }
     }
 }
 
-static CFComparisonResult cfdata_compare_contents(const void *val1, const void *val2, void *context __unused)
-{
-    return CFDataCompare((CFDataRef) val1, (CFDataRef) val2);
-}
-
 
 uint8_t* der_encode_dictionary(CFDictionaryRef dictionary, CFErrorRef *error,
                                const uint8_t *der, uint8_t *der_end)
 {
-    CFMutableArrayRef elements = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
-    
-    struct encode_context context = { .success = true, .error = error, .list = elements };
-    CFDictionaryApplyFunction(dictionary, add_sequence_to_array, &context);
-    
-    if (!context.success) {
-        CFReleaseNull(elements);
+    if (NULL == der_end)
         return NULL;
-    }
-    
-    CFRange allOfThem = CFRangeMake(0, CFArrayGetCount(elements));
 
-    CFArraySortValues(elements, allOfThem, cfdata_compare_contents, NULL);
+    struct encode_context context = { .success = true, .error = error, .der = der, .der_end = der_end };
+    if (!der_element_table_init(&context.table, CFDictionaryGetCount(dictionary), error))
+        return NULL;
 
-    uint8_t* original_der_end = der_end;
+    CFDictionaryApplyFunction(dictionary, encode_key_value_in_place, &context);
 
-    for(CFIndex position = CFArrayGetCount(elements); position > 0;) {
-        --position;
-        CFDataRef data = CFArrayGetValueAtIndex(elements, position);
-        der_end = ccder_encode_body(CFDataGetLength(data), CFDataGetBytePtr(data), der, der_end);
-    }
+    if (context.success)
+        context.success = der_sort_encoded_elements(&context.table, context.der_end, der_end, error);
 
-    CFReleaseNull(elements);
+    der_element_table_destroy(&context.table);
 
-    return ccder_encode_constructed_tl(CCDER_CONSTRUCTED_SET, original_der_end, der, der_end);
+    if (!context.success)
+        return NULL;
 
+    return ccder_encode_constructed_tl(CCDER_CONSTRUCTED_SET, der_end, der, context.der_end);
 }
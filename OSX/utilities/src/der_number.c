@@ -69,7 +69,7 @@ const uint8_t* der_decode_number(CFAllocatorRef allocator, CFOptionFlags mutabil
         }
     }
 
-    *number = CFNumberCreate(allocator, kCFNumberLongLongType, &value);
+    *number = CFNumberCreate(der_object_allocator(allocator, mutability), kCFNumberLongLongType, &value);
     
     if (*number == NULL) {
         SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Number allocation failed"), NULL, error);
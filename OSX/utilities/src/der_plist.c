@@ -152,6 +152,71 @@ uint8_t* der_encode_plist(CFPropertyListRef pl, CFErrorRef *error,
     }
 }
 
+//
+// Borrowed decoding
+//
+// CFData and CFString leaves point straight into the DER instead of copying
+// it out. They get an allocator whose info is the CFData holding the DER as
+// their bytes deallocator: CF retains it for as long as any of them is alive,
+// and it in turn retains the owner. Freeing borrowed bytes does nothing, and
+// the allocator is never handed out to allocate objects.
+//
+
+static const void *der_borrow_retain(const void *info) {
+    return CFRetain(info);
+}
+
+static void der_borrow_release(const void *info) {
+    CFRelease(info);
+}
+
+static void *der_borrow_allocate(CFIndex size, CFOptionFlags hint, void *info) {
+    return CFAllocatorAllocate(kCFAllocatorDefault, size, hint);
+}
+
+static void *der_borrow_reallocate(void *ptr, CFIndex newsize, CFOptionFlags hint, void *info) {
+    return CFAllocatorReallocate(kCFAllocatorDefault, ptr, newsize, hint);
+}
+
+static void der_borrow_deallocate(void *ptr, void *info) {
+    // Only ever handed borrowed bytes (which may be the end of the DER for an empty
+    // final value); they belong to the owner.
+}
+
+const uint8_t* der_decode_plist_borrowed(CFDataRef owner, CFOptionFlags mutability,
+                                         CFPropertyListRef* pl, CFErrorRef *error,
+                                         const uint8_t* der, const uint8_t *der_end)
+{
+    if (NULL == der)
+        return NULL;
+
+    const uint8_t *owner_start = CFDataGetBytePtr(owner);
+    if (der < owner_start || der_end > owner_start + CFDataGetLength(owner) || der > der_end) {
+        SecCFDERCreateError(kSecDERErrorUnknownEncoding, CFSTR("DER not within its owner"), NULL, error);
+        return NULL;
+    }
+
+    CFAllocatorContext context = {
+        .version = 0,
+        .info = (void *) owner,
+        .retain = der_borrow_retain,
+        .release = der_borrow_release,
+        .allocate = der_borrow_allocate,
+        .reallocate = der_borrow_reallocate,
+        .deallocate = der_borrow_deallocate,
+    };
+    CFAllocatorRef borrowing = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    if (NULL == borrowing) {
+        SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create allocator"), NULL, error);
+        return NULL;
+    }
+
+    der = der_decode_plist(borrowing, mutability | kSecDERDecodeBorrowBytes, pl, error, der, der_end);
+    CFRelease(borrowing);
+    return der;
+}
+
+
 // Similar to CFPropertyListCreateData
 
 CFDataRef CFPropertyListCreateDERData(CFAllocatorRef allocator, CFPropertyListRef plist, CFErrorRef *error) {
@@ -183,3 +248,17 @@ CFPropertyListRef CFPropertyListCreateWithDERData(CFAllocatorRef allocator, CFDa
     }
     return plist;
 }
+
+CFPropertyListRef CFPropertyListCreateWithDERDataNoCopy(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags options, CFPropertyListFormat *format, CFErrorRef *error) {
+    CFPropertyListRef plist = NULL;
+    const uint8_t *der = CFDataGetBytePtr(data);
+    const uint8_t *der_end = der + CFDataGetLength(data);
+    der = der_decode_plist_borrowed(data, kCFPropertyListMutableContainers, &plist, error, der, der_end);
+    if (der && der != der_end) {
+        SecCFDERCreateError(kSecDERErrorUnknownEncoding, CFSTR("trailing garbage after plist item"), NULL, error);
+        CFReleaseNull(plist);
+    } else if (format) {
+        *format = kCFPropertyListDERFormat_v1_0;
+    }
+    return plist;
+}
@@ -59,10 +59,21 @@ const uint8_t* der_decode_plist(CFAllocatorRef pl, CFOptionFlags mutability,
                                 CFPropertyListRef* cf, CFErrorRef *error,
                                 const uint8_t* der, const uint8_t *der_end);
 
+// As der_decode_plist, except that CFData and CFString values reference the
+// DER in place rather than copying it. der..der_end must lie within owner,
+// which is retained until the last object referencing it has been released
+// and must not be modified in the meantime.
+const uint8_t* der_decode_plist_borrowed(CFDataRef owner, CFOptionFlags mutability,
+                                         CFPropertyListRef* cf, CFErrorRef *error,
+                                         const uint8_t* der, const uint8_t *der_end);
+
 CFDataRef CFPropertyListCreateDERData(CFAllocatorRef allocator, CFPropertyListRef plist, CFErrorRef *error);
 
 CFPropertyListRef CFPropertyListCreateWithDERData(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags options, CFPropertyListFormat *format, CFErrorRef *error);
 
+// CFPropertyListCreateWithDERData using der_decode_plist_borrowed; the result keeps data alive.
+CFPropertyListRef CFPropertyListCreateWithDERDataNoCopy(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags options, CFPropertyListFormat *format, CFErrorRef *error);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -25,6 +25,74 @@
 #include "utilities/der_plist_internal.h"
 #include "utilities/SecCFError.h"
 #include "utilities/SecCFRelease.h"
+#include "utilities/der_plist.h"
 #include <CoreFoundation/CoreFoundation.h>
+#include <stdlib.h>
+#include <string.h>
 
 CFStringRef sSecDERErrorDomain = CFSTR("com.apple.security.cfder.error");
+
+bool der_element_table_init(struct der_element_table *table, CFIndex capacity, CFErrorRef *error)
+{
+    table->count = 0;
+    table->elements = table->small;
+    if (capacity > (CFIndex)(sizeof(table->small) / sizeof(table->small[0]))) {
+        table->elements = malloc((size_t)capacity * sizeof(struct der_encoded_element));
+        if (table->elements == NULL)
+            return SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to allocate element table"), NULL, error);
+    }
+    return true;
+}
+
+void der_element_table_destroy(struct der_element_table *table)
+{
+    if (table->elements != table->small)
+        free(table->elements);
+    table->elements = NULL;
+}
+
+// Same ordering as CFDataCompare: bytewise, then shorter first
+static int der_encoded_element_compare(const void *left_void, const void *right_void)
+{
+    const struct der_encoded_element *left = left_void;
+    const struct der_encoded_element *right = right_void;
+    size_t shortest = (left->length <= right->length) ? left->length : right->length;
+
+    int comparison = memcmp(left->start, right->start, shortest);
+    if (comparison == 0 && left->length != right->length)
+        comparison = (left->length < right->length) ? -1 : 1;
+    return comparison;
+}
+
+bool der_sort_encoded_elements(struct der_element_table *table,
+                               uint8_t *elements_start, const uint8_t *elements_end, CFErrorRef *error)
+{
+    // Elements were encoded back to front, so the last one recorded sits lowest.
+    bool sorted = true;
+    for (size_t i = 1; sorted && i < table->count; i++) {
+        sorted = der_encoded_element_compare(&table->elements[i], &table->elements[i - 1]) <= 0;
+    }
+    if (sorted)
+        return true;
+
+    qsort(table->elements, table->count, sizeof(struct der_encoded_element), der_encoded_element_compare);
+
+    // One copy of the whole run to lay the elements back down in order
+    size_t total = (size_t)(elements_end - elements_start);
+    uint8_t small_arena[512];
+    uint8_t *arena = (total <= sizeof(small_arena)) ? small_arena : malloc(total);
+    if (arena == NULL)
+        return SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to allocate sort arena"), NULL, error);
+    memcpy(arena, elements_start, total);
+
+    uint8_t *position = elements_start;
+    for (size_t i = 0; i < table->count; i++) {
+        const struct der_encoded_element *element = &table->elements[i];
+        memcpy(position, arena + (element->start - elements_start), element->length);
+        position += element->length;
+    }
+
+    if (arena != small_arena)
+        free(arena);
+    return true;
+}
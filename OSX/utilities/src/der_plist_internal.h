@@ -32,6 +32,15 @@
 #define SecCFDERCreateError(errorCode, descriptionString, previousError, newError) \
     SecCFCreateErrorWithFormat(errorCode, sSecDERErrorDomain, previousError, newError, NULL, descriptionString)
 
+// Borrowed decoding (see der_decode_plist_borrowed) sets this private bit in
+// the mutability it passes down. CFData and CFString decoders then reference
+// the DER, with allocator as their bytes deallocator, and everything else is
+// created with der_object_allocator() instead.
+#define kSecDERDecodeBorrowBytes ((CFOptionFlags) 1 << 31)
+
+static inline CFAllocatorRef der_object_allocator(CFAllocatorRef allocator, CFOptionFlags mutability) {
+    return (mutability & kSecDERDecodeBorrowBytes) ? kCFAllocatorDefault : allocator;
+}
 
 // CFArray <-> DER
 size_t der_sizeof_array(CFArrayRef array, CFErrorRef *error);
@@ -136,4 +145,27 @@ enum {
     CCDER_CONSTRUCTED_CFSET = CCDER_PRIVATE | CCDER_SET,
 };
 
+// Unordered collections (CFDictionary, CFSet) encode each element straight
+// into the destination, noting where it went, and then put the elements in
+// DER SET order with der_sort_encoded_elements.
+struct der_encoded_element {
+    const uint8_t *start;
+    size_t         length;
+};
+
+// Table of der_encoded_element, on the stack for small collections
+struct der_element_table {
+    struct der_encoded_element *elements;
+    size_t count;
+    struct der_encoded_element small[16];
+};
+
+bool der_element_table_init(struct der_element_table *table, CFIndex capacity, CFErrorRef *error);
+void der_element_table_destroy(struct der_element_table *table);
+
+// Reorder the elements recorded in table, which exactly fill
+// [elements_start, elements_end), into ascending order.
+bool der_sort_encoded_elements(struct der_element_table *table,
+                               uint8_t *elements_start, const uint8_t *elements_end, CFErrorRef *error);
+
 #endif
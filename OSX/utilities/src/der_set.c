@@ -48,8 +48,8 @@ const uint8_t* der_decode_set(CFAllocatorRef allocator, CFOptionFlags mutability
         return NULL;
     }
     
-    CFMutableSetRef theSet = (set && *set) ? CFSetCreateMutableCopy(allocator, 0, *set)
-                                           : CFSetCreateMutable(allocator, 0, &kCFTypeSetCallBacks);
+    CFMutableSetRef theSet = (set && *set) ? CFSetCreateMutableCopy(der_object_allocator(allocator, mutability), 0, *set)
+                                           : CFSetCreateMutable(der_object_allocator(allocator, mutability), 0, &kCFTypeSetCallBacks);
     
     if (NULL == theSet) {
         SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to create set"), NULL, error);
@@ -117,70 +117,48 @@ size_t der_sizeof_set(CFSetRef dict, CFErrorRef *error)
 struct encode_context {
     bool         success;
     CFErrorRef * error;
-    CFMutableArrayRef list;
-    CFAllocatorRef allocator;
+    const uint8_t *der;
+    uint8_t *der_end;
+    struct der_element_table table;
 };
 
-static void add_sequence_to_array(const void *value_void, void *context_void)
+static void encode_value_in_place(const void *value_void, void *context_void)
 {
     struct encode_context *context = (struct encode_context *) context_void;
     if (context->success) {
-        size_t der_size = der_sizeof_plist(value_void, context->error);
-        if (der_size == 0) {
-            context-> success = false;
+        uint8_t *element_end = context->der_end;
+        context->der_end = der_encode_plist(value_void, context->error, context->der, context->der_end);
+
+        if (context->der_end != NULL) {
+            struct der_encoded_element *element = &context->table.elements[context->table.count++];
+            element->start = context->der_end;
+            element->length = (size_t)(element_end - context->der_end);
         } else {
-            CFMutableDataRef value = CFDataCreateMutable(context->allocator, der_size);
-            CFDataSetLength(value, der_size);
-            
-            uint8_t* const encode_begin = CFDataGetMutableBytePtr(value);
-            uint8_t *encode_end = encode_begin + der_size;
-            
-            encode_end = der_encode_plist(value_void, context->error, encode_begin, encode_end);
-            
-            if (encode_end != NULL) {
-                CFDataDeleteBytes(value, CFRangeMake(0, (encode_end - encode_begin)));
-                CFArrayAppendValue(context->list, value);
-            } else {
-                context-> success = false;
-            }
-            CFReleaseNull(value);
+            context->success = false;
         }
     }
 }
 
-static CFComparisonResult cfdata_compare_contents(const void *val1, const void *val2, void *context __unused)
-{
-    return CFDataCompare((CFDataRef) val1, (CFDataRef) val2);
-}
-
 
 uint8_t* der_encode_set(CFSetRef set, CFErrorRef *error,
                                const uint8_t *der, uint8_t *der_end)
 {
-    CFMutableArrayRef elements = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
-    
-    struct encode_context context = { .success = true, .error = error, .list = elements };
-    CFSetApplyFunction(set, add_sequence_to_array, &context);
-    
-    if (!context.success) {
-        CFReleaseNull(elements);
+    if (NULL == der_end)
         return NULL;
-    }
-    
-    CFRange allOfThem = CFRangeMake(0, CFArrayGetCount(elements));
-    
-    CFArraySortValues(elements, allOfThem, cfdata_compare_contents, NULL);
 
-    uint8_t* original_der_end = der_end;
-    
-    for(CFIndex position = CFArrayGetCount(elements); position > 0;) {
-        --position;
-        CFDataRef data = CFArrayGetValueAtIndex(elements, position);
-        der_end = ccder_encode_body(CFDataGetLength(data), CFDataGetBytePtr(data), der, der_end);
-    }
-    
-    CFReleaseNull(elements);
-    
-    return ccder_encode_constructed_tl(CCDER_CONSTRUCTED_CFSET, original_der_end, der, der_end);
-    
+    struct encode_context context = { .success = true, .error = error, .der = der, .der_end = der_end };
+    if (!der_element_table_init(&context.table, CFSetGetCount(set), error))
+        return NULL;
+
+    CFSetApplyFunction(set, encode_value_in_place, &context);
+
+    if (context.success)
+        context.success = der_sort_encoded_elements(&context.table, context.der_end, der_end, error);
+
+    der_element_table_destroy(&context.table);
+
+    if (!context.success)
+        return NULL;
+
+    return ccder_encode_constructed_tl(CCDER_CONSTRUCTED_CFSET, der_end, der, context.der_end);
 }
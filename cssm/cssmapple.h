@@ -1147,7 +1147,14 @@ enum {
 	 * Output: Nothing, returns CSSMERR_CL_VERIFICATION_FAILURE on
 	 *         on failure.
 	 */
-	CSSM_APPLEX509CL_VERIFY_CSR
+	CSSM_APPLEX509CL_VERIFY_CSR,
+
+	/*
+	 * Obtain statistics for the CL's cache of decoded certs.
+	 * Input:  Nothing.
+	 * Output: allocated CSSM_APPLE_CL_CERT_CACHE_STATS.
+	 */
+	CSSM_APPLEX509CL_GET_CERT_CACHE_STATS
 };
 
 /*
@@ -1173,6 +1180,17 @@ typedef struct {
 	const char				*challengeString;
 } CSSM_APPLE_CL_CSR_REQUEST;
 
+/*
+ * Output of CL's CSSM_APPLEX509CL_GET_CERT_CACHE_STATS Passthrough. Counts
+ * are process-wide, since all CL sessions share one cache.
+ */
+typedef struct {
+	uint64					hits;			// field fetches which found the cert decoded
+	uint64					misses;			// field fetches which decoded the cert
+	uint64					evictions;		// certs dropped to make room for others
+	uint32					entries;		// certs currently cached
+} CSSM_APPLE_CL_CERT_CACHE_STATS;
+
 /*
  * When a CRL with no NextUpdate field is encountered, we use this time
  * as the NextUpdate attribute when storing in a DB. It represents the